@@ -15,6 +15,7 @@
 #include "grib.h"
 #include "common.h"
 #include "readgriball.h"
+#include "inline.h"
 
 #define SYNOPSYS               "[form] [<parameter file>]"
 #define BIG_BUFFER_SIZE        (300*MILLION)
@@ -85,8 +86,8 @@ static void testToJson (char *out, size_t maxLen) {
    char strWind [MAX_SIZE_LINE] = "";
    char strCurrent [MAX_SIZE_LINE] = "";
    char strConf [MAX_SIZE_LINE] = "";
-   formatThousandSep (strWind, sizeof strWind, (int) sizeof(FlowP) * (zone.nTimeStamp + 1) * zone.nbLat * zone.nbLon);
-   formatThousandSep (strCurrent, sizeof strCurrent, (int) sizeof(FlowP) * (currentZone.nTimeStamp + 1) * currentZone.nbLat * currentZone.nbLon);
+   formatThousandSep (strWind, sizeof strWind, (int) (N_FLOW_PLANES * flowValueSize (&zone)) * zone.nTimeStamp * zone.nbLat * zone.nbLon);
+   formatThousandSep (strCurrent, sizeof strCurrent, (int) (N_FLOW_PLANES * flowValueSize (&currentZone)) * currentZone.nTimeStamp * currentZone.nbLat * currentZone.nbLon);
    if (fileExists (parameterFileName)) {
       snprintf (strConf, sizeof strConf, "Exist: %s", parameterFileName);
    }
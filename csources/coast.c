@@ -0,0 +1,461 @@
+/*! High resolution coastal tiles of isSea grid.
+   isSea grid (0.1 degree) is kept for open sea and inland. Each cell crossed by the coast line has in addition
+   a tile of COAST_SUB x COAST_SUB cells (0.005 degree) so that narrow passages stay open.
+   A bitset tells coastal cells; rank of a cell in this bitset (table of counts per 64 bits word + popcount)
+   gives its tile, so that lookup is O(1) and costs one test for cells that are not coastal (see inline.h).
+   File (made by coastTilesBuild, loaded with mmap by readCoastTiles):
+      CoastHeader, mixed bitset (COAST_N_WORDS * 8 bytes), rank (COAST_N_WORDS uint32), tiles (nTiles * COAST_TILE_BYTES)
+   Source of coast line is an ASCII file of polygons: "lon lat" per line, polygons separated by lines
+   beginning with '>' (GMT multiple segment format, e.g. output of: gmt gshhg gshhs_f.b).
+   Land is inside an odd number of polygons (lakes and islands in lakes follow). Polygons may cross the
+   antimeridian (e.g. Eurasia in GSHHS); North pole must be outside of all polygons.
+   Distance to coast (tCoastDist): for each isSea cell, distance to nearest land or coastal cell, computed once
+   when isSea table changes, so that segments shorter than this clearance need no land test (see segmentClear).
+   compilation: gcc -c coast.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "glibwrapper.h"
+#include "r3types.h"
+#include "r3util.h"
+#include "inline.h"
+#include "coast.h"
+
+/*! header of coastal tiles file */
+typedef struct {
+   char     magic [8];                  // COAST_MAGIC
+   uint32_t nLon;                       // IS_SEA_N_LON
+   uint32_t nLat;                       // IS_SEA_N_LAT
+   uint32_t sub;                        // COAST_SUB
+   uint32_t nTiles;
+} CoastHeader;
+
+CoastTiles coastTiles = {0};
+
+static void *coastMapBase = NULL;
+static size_t coastMapLen = 0;
+static int coastFd = -1;                // coastal tiles file, kept open to restore tiles
+
+uint8_t *tCoastDist = NULL;             // distance to coast of each isSea cell, see coastDistUpdate
+static bool coastDistStale = true;      // isSea table or tiles changed since tCoastDist computed
+
+/*! release coastal tiles */
+void freeCoastTiles (void) {
+   if (coastMapBase != NULL) munmap (coastMapBase, coastMapLen);
+   if (coastFd >= 0) close (coastFd);
+   coastMapBase = NULL;
+   coastMapLen = 0;
+   coastFd = -1;
+   memset (&coastTiles, 0, sizeof coastTiles);
+   coastDistStale = true;
+}
+
+/*! distance to coast to be computed again: isSea table or tiles changed */
+void coastDistInvalidate (void) {
+   coastDistStale = true;
+}
+
+/*! release distance to coast */
+void freeCoastDist (void) {
+   free (tCoastDist);
+   tCoastDist = NULL;
+   coastDistStale = true;
+}
+
+/*! squared distance transform of f (n values): d [q] = min over p of (q - p)^2 + f [p].
+   Lower envelope of parabolas (Felzenszwalb Huttenlocher). v: room for n, z: room for n + 1 */
+static void coastEdt1 (const double *f, int n, double *d, int *v, double *z) {
+   int k = 0;
+   v [0] = 0;
+   z [0] = -INFINITY;
+   z [1] = INFINITY;
+   for (int q = 1; q < n; q++) {
+      double s;
+      while ((s = ((f [q] + (double) q * q) - (f [v [k]] + (double) v [k] * v [k])) / (2.0 * (q - v [k]))) <= z [k]) k -= 1;
+      k += 1;
+      v [k] = q;
+      z [k] = s;
+      z [k + 1] = INFINITY;
+   }
+   k = 0;
+   for (int q = 0; q < n; q++) {
+      while (z [k + 1] < q) k += 1;
+      d [q] = (double) (q - v [k]) * (q - v [k]) + f [v [k]];
+   }
+}
+
+/*! compute distance to coast if isSea table or tiles changed: for each isSea cell, Euclidean distance in isSea cells
+   from its center to center of nearest land or coastal cell, rounded down, capped to COAST_DIST_MAX.
+   Separable transform: vertical distance by two sweeps on rows, then lower envelope of parabolas on each row,
+   longitude wrapped at antimeridian. return false on memory error (tCoastDist then NULL) */
+bool coastDistUpdate (const uint8_t *isSeaArray) {
+   const int nCol = IS_SEA_N_LON - 1, pad = COAST_DIST_MAX + 1, m = nCol + 2 * pad;
+   if (! coastDistStale && ((tCoastDist != NULL) || (isSeaArray == NULL))) return true;
+   freeCoastDist ();
+   if (isSeaArray == NULL) return true;
+   uint16_t *g = malloc ((size_t) IS_SEA_N_LAT * nCol * sizeof (uint16_t));  // vertical distance, col 0 and nCol merged
+   double *f = malloc (m * sizeof (double)), *d = malloc (m * sizeof (double)), *z = malloc ((m + 1) * sizeof (double));
+   int *v = malloc (m * sizeof (int));
+   bool ok = (g != NULL) && (f != NULL) && (d != NULL) && (z != NULL) && (v != NULL)
+      && ((tCoastDist = malloc (SIZE_T_IS_SEA)) != NULL);
+   for (int row = 0; ok && (row < IS_SEA_N_LAT); row++) {
+      for (int c = 0; c < nCol; c++) {
+         const int i = row * IS_SEA_N_LON + c, i2 = i + (c == 0 ? nCol : 0);
+         const bool source = ! isSeaBit (isSeaArray, i) || isCoastal (i) || ! isSeaBit (isSeaArray, i2) || isCoastal (i2);
+         g [row * nCol + c] = source ? 0 : (row == 0) ? pad : MIN (g [(row - 1) * nCol + c] + 1, pad);
+      }
+   }
+   for (int row = IS_SEA_N_LAT - 2; ok && (row >= 0); row--)
+      for (int c = 0; c < nCol; c++)
+         g [row * nCol + c] = MIN (g [row * nCol + c], g [(row + 1) * nCol + c] + 1);
+   for (int row = 0; ok && (row < IS_SEA_N_LAT); row++) {
+      for (int k = 0; k < m; k++) {
+         const int c = ((k - pad) % nCol + nCol) % nCol;
+         f [k] = (double) g [row * nCol + c] * g [row * nCol + c];
+      }
+      coastEdt1 (f, m, d, v, z);
+      for (int c = 0; c < nCol; c++)
+         tCoastDist [row * IS_SEA_N_LON + c] = (uint8_t) MIN ((int) sqrt (d [c + pad]), COAST_DIST_MAX);
+      tCoastDist [row * IS_SEA_N_LON + nCol] = tCoastDist [row * IS_SEA_N_LON];
+   }
+   if (ok) coastDistStale = false;
+   else {
+      fprintf (stderr, "In coastDistUpdate, Error Malloc\n");
+      freeCoastDist ();
+   }
+   free (g);
+   free (f);
+   free (d);
+   free (z);
+   free (v);
+   return ok;
+}
+
+/*! restore tile of coastal cell i as in file, after updateIsSeaWithForbiddenAreas changed it */
+void coastTileRestore (int i) {
+   uint8_t *tile = (uint8_t *) coastTile (i);
+   if (pread (coastFd, tile, COAST_TILE_BYTES, (uint8_t *) tile - (uint8_t *) coastMapBase) != COAST_TILE_BYTES)
+      fprintf (stderr, "In coastTileRestore, Error reading tile of cell: %d\n", i);
+}
+
+/*! map coastal tiles file. Private mapping: tiles written by updateIsSeaWithForbiddenAreas are copied,
+   file gives back original (coastTileRestore).
+   return false if file absent or not a coastal tiles file */
+bool readCoastTiles (const char *fileName) {
+   CoastHeader h;
+   struct stat st;
+   freeCoastTiles ();
+   const int fd = open (fileName, O_RDONLY);
+   if (fd < 0) {
+      fprintf (stderr, "In readCoastTiles, Error cannot open: %s\n", fileName);
+      return false;
+   }
+   if ((fstat (fd, &st) != 0) || (pread (fd, &h, sizeof h, 0) != (ssize_t) sizeof h)
+      || (memcmp (h.magic, COAST_MAGIC, sizeof h.magic) != 0)
+      || (h.nLon != IS_SEA_N_LON) || (h.nLat != IS_SEA_N_LAT) || (h.sub != COAST_SUB)
+      || ((size_t) st.st_size != sizeof h + COAST_N_WORDS * (8 + sizeof (uint32_t)) + (size_t) h.nTiles * COAST_TILE_BYTES)) {
+      fprintf (stderr, "In readCoastTiles, Error invalid coastal tiles file: %s\n", fileName);
+      close (fd);
+      return false;
+   }
+   void *base = mmap (NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+   if (base == MAP_FAILED) {
+      fprintf (stderr, "In readCoastTiles, Error mmap: %s\n", fileName);
+      close (fd);
+      return false;
+   }
+   coastFd = fd;
+   coastMapBase = base;
+   coastMapLen = st.st_size;
+   coastTiles.mixed = (const uint8_t *) base + sizeof h;
+   coastTiles.rank = (const uint32_t *) (coastTiles.mixed + COAST_N_WORDS * 8);
+   coastTiles.tiles = (uint8_t *) (coastTiles.rank + COAST_N_WORDS);
+   coastTiles.nTiles = h.nTiles;
+   return true;
+}
+
+/*! polygons of coast line file, vertices in one array */
+typedef struct {
+   Point *pt;
+   size_t n, cap;
+   size_t *start;                       // first vertex of each polygon, start [nPoly] = n
+   size_t nPoly, capPoly;
+} CoastPolygons;
+
+/*! read coast line file (GMT multiple segment format). return false on error */
+static bool coastPolygonsRead (const char *fileName, CoastPolygons *cp) {
+   char line [MAX_SIZE_LINE];
+   double lon, lat;
+   bool newPoly = true, memOk = true;
+   FILE *f = fopen (fileName, "r");
+   if (f == NULL) {
+      fprintf (stderr, "In coastPolygonsRead, Error cannot open: %s\n", fileName);
+      return false;
+   }
+   memset (cp, 0, sizeof *cp);
+   while (memOk && (fgets (line, sizeof line, f) != NULL)) {
+      if (line [0] == '>') {
+         newPoly = true;
+         continue;
+      }
+      if (sscanf (line, "%lf%*[ \t,]%lf", &lon, &lat) != 2) continue;
+      if (newPoly) {
+         if (cp->nPoly + 1 >= cp->capPoly) {
+            cp->capPoly = cp->capPoly ? 2 * cp->capPoly : 1024;
+            size_t *tmp = realloc (cp->start, cp->capPoly * sizeof (size_t));
+            if ((memOk = (tmp != NULL)) == false) break;
+            cp->start = tmp;
+         }
+         cp->start [cp->nPoly++] = cp->n;
+         newPoly = false;
+      }
+      if (cp->n >= cp->cap) {
+         cp->cap = cp->cap ? 2 * cp->cap : 65536;
+         Point *tmp = realloc (cp->pt, cp->cap * sizeof (Point));
+         if ((memOk = (tmp != NULL)) == false) break;
+         cp->pt = tmp;
+      }
+      cp->pt [cp->n].lat = lat;
+      cp->pt [cp->n].lon = norm180 (lon);
+      cp->n += 1;
+   }
+   fclose (f);
+   if (! memOk || (cp->nPoly == 0)) {
+      fprintf (stderr, "In coastPolygonsRead, Error %s: %s\n", memOk ? "no polygon" : "memory allocation", fileName);
+      free (cp->pt);
+      free (cp->start);
+      return false;
+   }
+   cp->start [cp->nPoly] = cp->n;
+   return true;
+}
+
+/*! high resolution row and col (may be fractional) of point */
+static inline double coastRow (double lat) { return (-lat * 10 + 900.5) * COAST_SUB; }
+static inline double coastCol (double lon) { return (lon * 10 + 1800.5) * COAST_SUB; }
+
+/*! high resolution columns of one turn: columns c and c + COAST_PERIOD are the same place */
+#define COAST_PERIOD ((IS_SEA_N_LON - 1) * COAST_SUB)
+
+/*! edge j of polygon p: vertex j to next vertex */
+static inline void coastEdge (const CoastPolygons *cp, size_t p, size_t j, const Point **a, const Point **b) {
+   const size_t first = cp->start [p], last = cp->start [p + 1] - 1;
+   *a = &cp->pt [j];
+   *b = &cp->pt [(j == last) ? first : j + 1];
+}
+
+/*! lon of b unwrapped from a, so that edge a b is the short way */
+static inline double coastUnwrap (const Point *a, const Point *b) {
+   return a->lon + remainder (b->lon - a->lon, 360.0);
+}
+
+/*! true if edge a b crosses antimeridian (half open: vertex on it belongs to its east side).
+   *latX: latitude of crossing */
+static bool coastAntimeridian (const Point *a, const Point *b, double *latX) {
+   const double bLon = coastUnwrap (a, b);
+   const double fa = floor ((a->lon + 180.0) / 360.0), fb = floor ((bLon + 180.0) / 360.0);
+   if (fa == fb) return false;
+   const double x = 360.0 * MAX (fa, fb) - 180.0;
+   *latX = a->lat + (b->lat - a->lat) * (x - a->lon) / (bLon - a->lon);
+   return true;
+}
+
+/*! mark coastal cell of high resolution (r, c), c unwrapped. Both columns of antimeridian are marked */
+static inline void coastMarkCell (int r, int c, uint8_t *mixed) {
+   r = CLAMP (r, 0, IS_SEA_N_LAT * COAST_SUB - 1);
+   c = ((c % COAST_PERIOD) + COAST_PERIOD) % COAST_PERIOD;
+   for (; c < IS_SEA_N_LON * COAST_SUB; c += COAST_PERIOD) {
+      const int i = (r / COAST_SUB) * IS_SEA_N_LON + c / COAST_SUB;
+      mixed [i >> 3] |= (uint8_t) (1u << (i & 7));
+   }
+}
+
+/*! mark coastal cells crossed by edge a b: Amanatides-Woo traversal of isSea cells, as gridSegmentSea,
+   so that a cell whose corner only is clipped by the edge is marked */
+static void coastMarkEdge (const Point *a, const Point *b, uint8_t *mixed) {
+   const double x = coastCol (a->lon) / COAST_SUB, y = coastRow (a->lat) / COAST_SUB;
+   const double dx = coastCol (coastUnwrap (a, b)) / COAST_SUB - x, dy = coastRow (b->lat) / COAST_SUB - y;
+   int cx = floor (x), cy = floor (y);
+   const int stepX = (dx > 0) ? 1 : -1, stepY = (dy > 0) ? 1 : -1;
+   const double tDeltaX = (dx != 0) ? fabs (1.0 / dx) : INFINITY;
+   const double tDeltaY = (dy != 0) ? fabs (1.0 / dy) : INFINITY;
+   double tMaxX = (dx != 0) ? (cx + (stepX > 0) - x) / dx : INFINITY;
+   double tMaxY = (dy != 0) ? (cy + (stepY > 0) - y) / dy : INFINITY;
+   while (true) {
+      coastMarkCell (cy * COAST_SUB, cx * COAST_SUB, mixed);
+      if (fmin (tMaxX, tMaxY) >= 1.0) break;
+      if (tMaxX < tMaxY) {
+         cx += stepX;
+         tMaxX += tDeltaX;
+      }
+      else {
+         cy += stepY;
+         tMaxY += tDeltaY;
+      }
+   }
+   coastMarkCell ((int) floor (y + dy) * COAST_SUB, (int) floor (x + dx) * COAST_SUB, mixed);   // against rounding of t
+}
+
+static int compareDouble (const void *a, const void *b) {
+   const double x = *(const double *) a, y = *(const double *) b;
+   return (x > y) - (x < y);
+}
+
+/*! number of sorted crossings west of col */
+static size_t coastCountWest (const double *cross, size_t nCross, double col) {
+   size_t lo = 0, hi = nCross;
+   while (lo < hi) {
+      const size_t mid = (lo + hi) / 2;
+      if (cross [mid] < col) lo = mid + 1;
+      else hi = mid;
+   }
+   return lo;
+}
+
+/*! fill tiles of coastal cells of isSea row iLat. Scanline on each high resolution row:
+   crossings of edges of band, folded on one turn from antimeridian, are sorted. Land if odd parity of
+   crossings west of cell center plus amParity of row: crossings of antimeridian north of row, so that
+   the path west to antimeridian then north to pole, outside of polygons, is counted whole */
+static void coastFillRow (const CoastPolygons *cp, const uint32_t *edges, size_t nEdges, int iLat,
+   const uint8_t *amParity, const uint8_t *mixed, const uint32_t *rank, uint8_t *tiles, double *cross) {
+   const double colW = coastCol (-180.0), colE = colW + COAST_PERIOD;
+   for (int sr = 0; sr < COAST_SUB; sr++) {
+      const double rowC = iLat * COAST_SUB + sr + 0.5;          // center of high resolution row
+      const size_t parity = amParity [iLat * COAST_SUB + sr];
+      size_t nCross = 0;
+      for (size_t e = 0; e < nEdges; e++) {
+         const Point *a = &cp->pt [edges [2 * e]], *b = &cp->pt [edges [2 * e + 1]];
+         const double ra = coastRow (a->lat), rb = coastRow (b->lat);
+         if ((ra > rowC) == (rb > rowC)) continue;
+         const double ca = coastCol (a->lon), cb = coastCol (coastUnwrap (a, b));
+         const double c = ca + (rowC - ra) * (cb - ca) / (rb - ra);
+         cross [nCross++] = c - COAST_PERIOD * floor ((c - colW) / COAST_PERIOD);
+      }
+      qsort (cross, nCross, sizeof (double), compareDouble);
+      size_t k = 0;
+      for (int iLon = 0; iLon < IS_SEA_N_LON; iLon++) {
+         const int i = iLat * IS_SEA_N_LON + iLon;
+         if (! isSeaBit (mixed, i)) continue;
+         uint64_t word;
+         memcpy (&word, mixed + ((i >> 6) << 3), sizeof word);
+         uint8_t *tile = tiles + (size_t) (rank [i >> 6] + __builtin_popcountll (word & ((UINT64_C (1) << (i & 63)) - 1))) * COAST_TILE_BYTES;
+         for (int sc = 0; sc < COAST_SUB; sc++) {
+            const double colC = iLon * COAST_SUB + sc + 0.5;
+            size_t west;
+            if (colC < colW) west = coastCountWest (cross, nCross, colC + COAST_PERIOD);
+            else if (colC >= colE) west = coastCountWest (cross, nCross, colC - COAST_PERIOD);
+            else {
+               while ((k < nCross) && (cross [k] < colC)) k++;
+               west = k;
+            }
+            if (((west + parity) & 1) == 0) tile [(sr * COAST_SUB + sc) >> 3] |= (uint8_t) (1u << ((sr * COAST_SUB + sc) & 7));
+         }
+      }
+   }
+}
+
+/*! build coastal tiles file outFileName from coast line file polyFileName. return false on error */
+bool coastTilesBuild (const char *polyFileName, const char *outFileName) {
+   CoastPolygons cp;
+   char tmpName [MAX_SIZE_FILE_NAME + 8];
+   bool ok = false;
+   if (! coastPolygonsRead (polyFileName, &cp)) return false;
+
+   uint8_t *mixed = calloc (COAST_N_WORDS, 8);
+   uint32_t *rank = calloc (COAST_N_WORDS, sizeof (uint32_t));
+   size_t *bandCount = calloc (IS_SEA_N_LAT + 1, sizeof (size_t));
+   uint8_t *amParity = calloc (IS_SEA_N_LAT * COAST_SUB + 1, 1);
+   uint32_t *bandEdges = NULL;
+   uint8_t *tiles = NULL;
+   double *cross = NULL;
+   if ((mixed == NULL) || (rank == NULL) || (bandCount == NULL) || (amParity == NULL)) goto end;
+
+   // coastal cells, antimeridian crossings, and edges of each isSea row (band): counting then filling
+   for (size_t p = 0; p < cp.nPoly; p++) {
+      for (size_t j = cp.start [p]; j < cp.start [p + 1]; j++) {
+         const Point *a, *b;
+         double latX;
+         coastEdge (&cp, p, j, &a, &b);
+         coastMarkEdge (a, b, mixed);
+         if (coastAntimeridian (a, b, &latX))      // toggles parity of high resolution rows south of crossing
+            amParity [CLAMP ((int) floor (coastRow (latX) + 0.5), 0, IS_SEA_N_LAT * COAST_SUB)] ^= 1;
+         const int r0 = CLAMP ((int) floor (fmin (coastRow (a->lat), coastRow (b->lat))) / COAST_SUB, 0, IS_SEA_N_LAT - 1);
+         const int r1 = CLAMP ((int) floor (fmax (coastRow (a->lat), coastRow (b->lat))) / COAST_SUB, 0, IS_SEA_N_LAT - 1);
+         for (int r = r0; r <= r1; r++) bandCount [r + 1] += 1;
+      }
+   }
+   for (int r = 1; r < IS_SEA_N_LAT * COAST_SUB; r++) amParity [r] ^= amParity [r - 1];
+   size_t maxBand = 0;
+   for (int r = 0; r < IS_SEA_N_LAT; r++) {
+      maxBand = MAX (maxBand, bandCount [r + 1]);
+      bandCount [r + 1] += bandCount [r];
+   }
+   if ((bandEdges = malloc (MAX (bandCount [IS_SEA_N_LAT], 1) * 2 * sizeof (uint32_t))) == NULL) goto end;
+   if ((cross = malloc (MAX (maxBand, 1) * sizeof (double))) == NULL) goto end;
+   size_t *fill = calloc (IS_SEA_N_LAT, sizeof (size_t));
+   if (fill == NULL) goto end;
+   for (size_t p = 0; p < cp.nPoly; p++) {
+      for (size_t j = cp.start [p]; j < cp.start [p + 1]; j++) {
+         const Point *a, *b;
+         coastEdge (&cp, p, j, &a, &b);
+         const int r0 = CLAMP ((int) floor (fmin (coastRow (a->lat), coastRow (b->lat))) / COAST_SUB, 0, IS_SEA_N_LAT - 1);
+         const int r1 = CLAMP ((int) floor (fmax (coastRow (a->lat), coastRow (b->lat))) / COAST_SUB, 0, IS_SEA_N_LAT - 1);
+         for (int r = r0; r <= r1; r++) {
+            const size_t e = bandCount [r] + fill [r]++;
+            bandEdges [2 * e] = (uint32_t) (a - cp.pt);
+            bandEdges [2 * e + 1] = (uint32_t) (b - cp.pt);
+         }
+      }
+   }
+   free (fill);
+
+   uint32_t nTiles = 0;
+   for (size_t w = 0; w < COAST_N_WORDS; w++) {
+      uint64_t word;
+      memcpy (&word, mixed + w * 8, sizeof word);
+      rank [w] = nTiles;
+      nTiles += __builtin_popcountll (word);
+   }
+   if ((tiles = calloc (MAX (nTiles, 1), COAST_TILE_BYTES)) == NULL) goto end;
+   for (int r = 0; r < IS_SEA_N_LAT; r++)
+      coastFillRow (&cp, bandEdges + 2 * bandCount [r], bandCount [r + 1] - bandCount [r], r, amParity, mixed, rank, tiles, cross);
+
+   CoastHeader h = {.nLon = IS_SEA_N_LON, .nLat = IS_SEA_N_LAT, .sub = COAST_SUB, .nTiles = nTiles};
+   memcpy (h.magic, COAST_MAGIC, sizeof h.magic);
+   snprintf (tmpName, sizeof tmpName, "%s.tmp", outFileName);
+   FILE *f = fopen (tmpName, "wb");
+   if (f == NULL) {
+      fprintf (stderr, "In coastTilesBuild, Error cannot create: %s\n", tmpName);
+      goto end;
+   }
+   ok = (fwrite (&h, sizeof h, 1, f) == 1)
+      && (fwrite (mixed, 8, COAST_N_WORDS, f) == COAST_N_WORDS)
+      && (fwrite (rank, sizeof (uint32_t), COAST_N_WORDS, f) == COAST_N_WORDS)
+      && (fwrite (tiles, COAST_TILE_BYTES, nTiles, f) == nTiles);
+   if ((fclose (f) != 0) || ! ok || (rename (tmpName, outFileName) != 0)) {
+      fprintf (stderr, "In coastTilesBuild, Error writing: %s\n", outFileName);
+      remove (tmpName);
+      ok = false;
+   }
+   else printf ("Coast tiles   : %s, %zu polygons, %zu points, %u coastal cells\n", outFileName, cp.nPoly, cp.n, nTiles);
+end:
+   if (! ok && ((mixed == NULL) || (rank == NULL) || (bandCount == NULL) || (amParity == NULL) || (bandEdges == NULL) || (cross == NULL) || (tiles == NULL)))
+      fprintf (stderr, "In coastTilesBuild, Error memory allocation\n");
+   free (mixed);
+   free (rank);
+   free (bandCount);
+   free (amParity);
+   free (bandEdges);
+   free (tiles);
+   free (cross);
+   free (cp.pt);
+   free (cp.start);
+   return ok;
+}
@@ -0,0 +1,7 @@
+extern bool   readCoastTiles (const char *fileName);
+extern void   freeCoastTiles (void);
+extern bool   coastTilesBuild (const char *polyFileName, const char *outFileName);
+extern void   coastTileRestore (int i);
+extern void   coastDistInvalidate (void);
+extern void   freeCoastDist (void);
+extern bool   coastDistUpdate (const uint8_t *isSeaArray);
@@ -18,6 +18,11 @@
 #include "grib.h"
 #include "polar.h"
 #include "readgriball.h"
+#include "gribcache.h"
+#include "gribcatalog.h"
+#include "coast.h"
+#include "forbidzone.h"
+#include "corridor.h"
 
 ClientRequest clientReq;
 // global filter for REQ_DIR request
@@ -53,6 +58,28 @@ void buildInitialOfShortNameList(const Zone *zone, char *str, size_t len) {
    str [i] = '\0';
 }
 
+/*! load land mask and coastal tiles, unless already loaded from same unchanged files
+   (same name, mtime, size and inode): forbidden zones are then updated incrementally instead of from scratch */
+static void landMaskLoad (void) {
+   static char loadedKey [2 * MAX_SIZE_FILE_NAME + 128] = "";
+   char key [sizeof loadedKey];
+   struct stat stSea = {0}, stCoast = {0};
+   stat (par.isSeaFileName, &stSea);
+   stat (par.coastFileName, &stCoast);
+   snprintf (key, sizeof key, "%s %lld %lld %llu %s %lld %lld %llu",
+      par.isSeaFileName, (long long) stSea.st_mtime, (long long) stSea.st_size, (unsigned long long) stSea.st_ino,
+      par.coastFileName, (long long) stCoast.st_mtime, (long long) stCoast.st_size, (unsigned long long) stCoast.st_ino);
+   if ((tIsSea != NULL) && (strcmp (key, loadedKey) == 0)) return;
+   freeIsSea ();
+   freeCoastTiles ();
+   loadedKey [0] = '\0';
+   if (par.isSeaFileName [0] != '\0')
+      tIsSea = readIsSea (par.isSeaFileName);
+   if ((tIsSea != NULL) && (par.coastFileName [0] != '\0') && readCoastTiles (par.coastFileName))
+      printf ("Coast tiles    : %u coastal cells from: %s\n", coastTiles.nTiles, par.coastFileName);
+   if (tIsSea != NULL) strlcpy (loadedKey, key, sizeof loadedKey);
+}
+
 /*! Make initialization  
    return false if readParam or readGribAll fail */
 bool initContext (const char *parameterFileName, const char *pattern) {
@@ -74,17 +101,18 @@ bool initContext (const char *parameterFileName, const char *pattern) {
       mostRecentFile (directory, ".gr", pattern, par.gribFileName, sizeof par.gribFileName);
    }
    if (par.gribFileName [0] != '\0') {
-      readGribRet = readGribAll (par.gribFileName, &zone, WIND);
+      readGribRet = gribCacheLoad (par.gribFileName, &zone, WIND);
       if (! readGribRet) {
          fprintf (stderr, "In initContext, Error: Unable to read grib file: %s\n ", par.gribFileName);
          return false;
       }
       printf ("Grib loaded    : %s\n", par.gribFileName);
       printf ("Grib DateTime0 : %s\n", gribDateTimeToStr (zone.dataDate [0], zone.dataTime [0], str, sizeof str));
+      if (par.nGribLayers > 0) gribLayersLoad ();
    }
 
    if (par.currentGribFileName [0] != '\0') {
-      readGribRet = readGribAll (par.currentGribFileName, &zone, WIND);
+      readGribRet = gribCacheLoad (par.currentGribFileName, &currentZone, CURRENT);
       printf ("Cur grib loaded: %s\n", par.currentGribFileName);
       printf ("Grib DateTime0 : %s\n", gribDateTimeToStr (currentZone.dataDate [0], currentZone.dataTime [0], str, sizeof str));
    }
@@ -103,8 +131,8 @@ bool initContext (const char *parameterFileName, const char *pattern) {
    }
 
    if (par.forbidFileName [0] != '\0') {
-      if (readGeoJson(par.forbidFileName, forbidZones, MAX_N_FORBID_ZONE, &par.nForbidZone)) {
-         printf ("Loaded         : %d forbid zones from: %s\n", par.nForbidZone, par.forbidFileName);
+      if (readGeoJson (par.forbidFileName)) {
+         printf ("Loaded         : %d forbid zones, %d rings from: %s\n", forbidNPolygons (), par.nForbidZone, par.forbidFileName);
       }
       else {
          fprintf(stderr, "In initContext, Error reading geojson %s\n", par.forbidFileName);
@@ -113,9 +141,10 @@ bool initContext (const char *parameterFileName, const char *pattern) {
    nIsoc = 0;
    route.n = 0;
    route.destinationReached = false;
-   if (par.isSeaFileName [0] != '\0')
-      tIsSea = readIsSea (par.isSeaFileName);
+   landMaskLoad ();
    updateIsSeaWithForbiddenAreas ();
+   coastDistUpdate (tIsSea);
+   forbidIndexBuild ();
    return true;
 }
 
@@ -192,9 +221,10 @@ static bool matchFilter (const char *filename, const char **filter) {
  */
 char *nearestPortToStrJson (double lat, double lon, char *out, size_t maxLen) {
    char selectedPort [MAX_SIZE_NAME];
-   int idPort = nearestPort (lat, lon, par.tidesFileName, selectedPort, sizeof selectedPort);
+   double dist;
+   int idPort = nearestPort (lat, lon, par.tidesFileName, selectedPort, sizeof selectedPort, &dist);
    if (idPort != 0) {
-      snprintf (out, maxLen, "{\n  \"nearestPort\": \"%s\",\n  \"idPort\": %d\n}\n", selectedPort, idPort);
+      snprintf (out, maxLen, "{\n  \"nearestPort\": \"%s\",\n  \"idPort\": %d,\n  \"distance\": %.2lf\n}\n", selectedPort, idPort, dist);
    }
    else snprintf (out, maxLen, "{\"error\": \"Tide File %s not found\"}\n", par.tidesFileName);
    return out;
@@ -214,7 +244,6 @@ char *nearestPortToStrJson (double lat, double lon, char *out, size_t maxLen) {
 char *listDirToStrJson (char *root, char *dir, bool sortByName, const char *pattern, const char **filter, char *out, size_t maxLen) {
    char line [MAX_SIZE_LINE];
    char fullPath [MAX_SIZE_LINE];
-   char filePath [MAX_SIZE_LINE * 2];
    const char *sep = (dir && dir [0] != '/') ? "/" : "";
    if (maxLen == 0) return out;
    out[0] = '\0';
@@ -222,8 +251,10 @@ char *listDirToStrJson (char *root, char *dir, bool sortByName, const char *patt
    // Path directory
    snprintf (fullPath, sizeof fullPath, "%s%s%s", root ? root : "", sep,  dir ? dir : "");
 
-   DIR *d = opendir(fullPath);
-   if (!d) {
+   // regular files of directory, from catalog
+   const CatalogFile *files;
+   size_t nFiles;
+   if (! catalogFiles (fullPath, &files, &nFiles)) {
       fprintf(stderr, "In listDirToStrJson Error opening directory '%s': %s\n", fullPath, strerror(errno));
       snprintf (out, maxLen, "{\"error\":\"Error opening directory\"}");
       return out;
@@ -233,24 +264,13 @@ char *listDirToStrJson (char *root, char *dir, bool sortByName, const char *patt
    FileInfo *arr = NULL;
    size_t n = 0, cap = 0;
 
-   struct dirent *ent;
-   while ((ent = readdir(d)) != NULL) {
-      const char *fileName = ent->d_name;
-      if (strcmp(fileName, ".") == 0 || strcmp(fileName, "..") == 0) continue;
+   for (size_t k = 0; k < nFiles; k++) {
+      const char *fileName = files [k].name;
 
       // suffix filter
       if (!matchFilter(fileName, filter)) continue;
       // prefix (pattern) filter
       if (pattern && ! g_str_has_prefix(fileName, pattern)) continue;
-      snprintf (filePath, sizeof filePath, "%s/%s", fullPath, fileName);
-      
-      struct stat st;
-      if (stat(filePath, &st) != 0) {
-         fprintf(stderr, "In listDirToStrJson Error retrieving info for '%s': %s\n", filePath, strerror(errno));
-         continue;
-      }
-
-      if (!S_ISREG(st.st_mode)) continue;
 
       /* push_back */
       if (n == cap) {
@@ -263,12 +283,11 @@ char *listDirToStrJson (char *root, char *dir, bool sortByName, const char *patt
          arr = tmp; cap = newcap;
       }
       arr[n].name  = strdup(fileName);
-      arr[n].size  = st.st_size;
-      arr[n].mtime = st.st_mtime;
+      arr[n].size  = files [k].size;
+      arr[n].mtime = files [k].mtime;
       if (!arr[n].name) { fprintf(stderr, "OOM on strdup\n"); continue; }
       n++;
    }
-   closedir(d);
 
    if (n > 1) qsort(arr, n, sizeof(*arr), sortByName ? compareByName : compareByMtime);
 
@@ -364,6 +383,29 @@ bool decodeFormReq (const char *req, ClientRequest *clientReq) {
          }
          g_strfreev(wpCoords);
       }
+      else if (g_str_has_prefix (parts[i], "corridor=")) {
+         char *corPart = parts[i] + strlen ("corridor="); // After "corridor="
+         if (*corPart == '\0') {
+            g_strfreev(parts);
+            return false;  // parsing error
+         }
+         // corridor polyline parsing
+         char **corCoords = g_strsplit (corPart, ";", -1);
+         if (! corCoords) {
+            fprintf (stderr, "In decodeFormReq, Error parsing corridor\n");
+            g_strfreev(parts);
+            return false;
+         }
+         for (int i = 0; corCoords[i] && clientReq->nCorridor < MAX_N_CORRIDOR; i++) {
+            double lat, lon;
+            if (sscanf(corCoords[i], "%lf,%lf", &lat, &lon) == 2) {
+               clientReq->corridor [clientReq->nCorridor].lat = lat;
+               clientReq->corridor [clientReq->nCorridor].lon = lon;
+               clientReq->nCorridor += 1;
+            }
+         }
+         g_strfreev(corCoords);
+      }
       else if (g_str_has_prefix (parts[i], "cmd=")) {
          char *cmdPart = parts[i] + strlen ("cmd="); // After cmd="
          if (*cmdPart == '\0') { 
@@ -437,41 +479,33 @@ bool decodeFormReq (const char *req, ClientRequest *clientReq) {
       else if (sscanf (parts[i], "constCurrentS=%lf",    &clientReq->constCurrentS) == 1);      // const current speed
       else if (sscanf (parts[i], "constCurrentD=%lf",    &clientReq->constCurrentD) == 1);      // const current direction 
       else if (sscanf (parts[i], "constCurrentD=%lf",    &clientReq->constCurrentD) == 1);      // const current direction 
+      else if (sscanf (parts[i], "corridorWidth=%lf",    &clientReq->corridorWidth) == 1);      // corridor half width
       else fprintf (stderr, "In decodeFormReq Unknown value: %s\n", parts [i]);
    }
    g_strfreev (parts);
    return clientReq->type == REQ_KILL ||  (clientReq->type >= 0 && clientReq->type < MAX_TYPE);  
 }
 
-/*! Generate Json array for polygon */
-static void polygonToJson (MyPolygon *po, char *str, size_t maxLen) {
+/*! Generate Json array for polygon ring, appended at res + len. return new length */
+static size_t polygonToJson (const MyPolygon *po, char *res, size_t len, size_t maxLen) {
    const int n = po->n;
-   char temp [128];
-   double lat, lon;
-
-   strlcpy (str, "  [", maxLen);
-   for (int k = 0; k < n; k++) {
-      lat = (po->points [k].lat);
-      lon = (po->points [k].lon);
-      snprintf (temp, sizeof temp, "[%.4lf, %.4lf]%s", lat, lon, (k < n-1) ? ", " : "");
-      strlcat (str,temp, maxLen); 
-   }
-   strlcat (str, "]", maxLen);
+   len += snprintf (res + len, maxLen - len, "  [");
+   for (int k = 0; (k < n) && (len < maxLen); k++)
+      len += snprintf (res + len, maxLen - len, "[%.4lf, %.4lf]%s", po->points [k].lat, po->points [k].lon, (k < n-1) ? ", " : "");
+   if (len < maxLen) len += snprintf (res + len, maxLen - len, "]");
+   return len;
 }
 
-/*! Exclusion zone is an array of polygons */
+/*! Exclusion zone is an array of polygon rings */
 void forbidToJson (char *res, size_t maxLen) {
-   char str [1000];
-   strlcpy (res, "[\n", maxLen);
+   size_t len = strlcpy (res, "[\n", maxLen);
    printf ("Number of polygon: %d\n", par.nForbidZone);
    
-   for (int i = 0; i < par.nForbidZone; i++) {
-      polygonToJson (&forbidZones [i], str, sizeof str);
-      strlcat (res, str, maxLen);
-      if (i < par.nForbidZone -1) strlcat (res, ",", maxLen);
-      strlcat (res, "\n", maxLen);
+   for (int i = 0; (i < par.nForbidZone) && (len < maxLen); i++) {
+      len = polygonToJson (&forbidZones [i], res, len, maxLen);
+      if (len < maxLen) len += snprintf (res + len, maxLen - len, "%s\n", (i < par.nForbidZone -1) ? "," : "");
    }
-   strlcat (res, "]\n", maxLen);
+   if (len < maxLen) strlcat (res, "]\n", maxLen);
 }
 
 static inline double round4(double x) {
@@ -480,24 +514,23 @@ static inline double round4(double x) {
 
 /*!
  * update Grib file if required 
+ * decoding MAY TAKE TIME unless grib is already in grib cache
  */
 bool updateWindGrib (ClientRequest *clientReq, char *checkMessage, size_t maxLen) {
    char strGrib [MAX_SIZE_FILE_NAME];
    if (clientReq->gribName [0] == '\0') return false;
-   // change grib if requested MAY TAKE TIME !!!!
    buildRootName (clientReq->gribName, strGrib, sizeof strGrib);
    printf ("Grib Found: %s\n", strGrib);
-   if (strncmp (par.gribFileName, strGrib, strlen (strGrib)) != 0) {
-      if (readGribAll (strGrib, &zone, WIND)) {
-         strlcpy (par.gribFileName, strGrib, sizeof par.gribFileName);
-         printf ("Grib loaded   : %s\n", strGrib);
-      }
-      else {
-         snprintf (checkMessage, maxLen, "3: Error reading Grib: %s", clientReq->gribName);
-         printf ("In updateWindGrib: Error reading Grib: %s\n", clientReq->gribName);
-         return false;
-      }
-   }  
+   if (gribCacheLoad (strGrib, &zone, WIND)) {
+      strlcpy (par.gribFileName, strGrib, sizeof par.gribFileName);
+      printf ("Grib loaded   : %s\n", strGrib);
+      if (par.nGribLayers > 0) gribLayersLoad ();
+   }
+   else {
+      snprintf (checkMessage, maxLen, "3: Error reading Grib: %s", clientReq->gribName);
+      printf ("In updateWindGrib: Error reading Grib: %s\n", clientReq->gribName);
+      return false;
+   }
    return true;
 }
 
@@ -518,16 +551,13 @@ bool updateCurrentGrib (ClientRequest *clientReq, char *checkMessage, size_t max
 
    buildRootName (clientReq->currentGribName, strGrib, sizeof strGrib);
    printf ("Current Grib Found: %s\n", strGrib);
-   if (strncmp (par.currentGribFileName, strGrib, strlen (strGrib)) != 0) {
-      printf ("current readGrib: %s\n", strGrib);
-      if (readGribAll (strGrib, &currentZone, CURRENT)) {
-         strlcpy (par.currentGribFileName, strGrib, sizeof par.currentGribFileName);
-         printf ("Current Grib loaded   : %s\n", strGrib);
-      }
-      else {
-         snprintf (checkMessage, maxLen, "4bis: Error reading Current Grib: %s", clientReq->currentGribName);
-         return false;
-      }
+   if (gribCacheLoad (strGrib, &currentZone, CURRENT)) {
+      strlcpy (par.currentGribFileName, strGrib, sizeof par.currentGribFileName);
+      printf ("Current Grib loaded   : %s\n", strGrib);
+   }
+   else {
+      snprintf (checkMessage, maxLen, "4bis: Error reading Current Grib: %s", clientReq->currentGribName);
+      return false;
    }
    return true;
 }
@@ -575,6 +605,43 @@ void infoCoordToJson (double lat, double lon, ClientRequest *clientReq, char *re
    strlcat (res, "  ]\n}\n", maxLen);
 }
 
+/*! build userCorridor from polyline of clientReq. No corridor if polyline empty.
+   return false with checkMessage if corridor invalid or if boats, way points or destination outside */
+static bool corridorUpdate (const ClientRequest *clientReq, char *checkMessage, size_t maxLen) {
+   double lat [MAX_N_CORRIDOR], lon [MAX_N_CORRIDOR];
+   corridorFree (&userCorridor);
+   if (clientReq->nCorridor == 0) return true;
+   if ((clientReq->nCorridor < 2) || (clientReq->corridorWidth <= 0.0)) {
+      snprintf (checkMessage, maxLen, "10: Corridor requires at least 2 points and corridorWidth > 0");
+      return false;
+   }
+   for (int i = 0; i < clientReq->nCorridor; i += 1) {
+      lat [i] = clientReq->corridor [i].lat;
+      lon [i] = clientReq->corridor [i].lon;
+   }
+   if (! corridorBuild (&userCorridor, clientReq->nCorridor, lat, lon, NULL, clientReq->corridorWidth, 0.0)) {
+      snprintf (checkMessage, maxLen, "10: Corridor cannot be built");
+      return false;
+   }
+   for (int i = 0; i < clientReq->nBoats; i += 1) {
+      if (! corridorContains (&userCorridor, clientReq->boats [i].lat, clientReq->boats [i].lon, 0.0)) {
+         snprintf (checkMessage, maxLen, "11: Competitor outside corridor, name: %s, lat: %.6lf, lon: %.6lf",
+            clientReq->boats [i].name, clientReq->boats [i].lat, clientReq->boats [i].lon);
+         corridorFree (&userCorridor);
+         return false;
+      }
+   }
+   for (int i = 0; i < clientReq->nWp; i += 1) {
+      if (! corridorContains (&userCorridor, clientReq->wp [i].lat, clientReq->wp [i].lon, 0.0)) {
+         snprintf (checkMessage, maxLen, "11: WP or Dest. outside corridor, lat: %.2lf, lon: %.2lf",
+            clientReq->wp [i].lat, clientReq->wp [i].lon);
+         corridorFree (&userCorridor);
+         return false;
+      }
+   }
+   return true;
+}
+
 /*! check validity of parameters */
 bool checkParamAndUpdate (ClientRequest *clientReq, char *checkMessage, size_t maxLen) {
    char strPolar [MAX_SIZE_FILE_NAME];
@@ -709,6 +776,7 @@ bool checkParamAndUpdate (ClientRequest *clientReq, char *checkMessage, size_t m
          snprintf (checkMessage, maxLen, "9: start Time not in Grib time window");
       return false;
    }
+   if (! corridorUpdate (clientReq, checkMessage, maxLen)) return false;
 
    par.tStep = clientReq->timeStep / 3600.0;
    par.pOr.lat = clientReq->boats [0].lat;
@@ -719,84 +787,33 @@ bool checkParamAndUpdate (ClientRequest *clientReq, char *checkMessage, size_t m
    return true;
 }
 
-/*!
- * \brief Approximate great-circle segment length in nautical miles.
- *
- * This function estimates the distance between two geographic points
- * (lat0, lon0) and (lat1, lon1) in nautical miles (NM) using a local
- * equirectangular projection. For routing validation this is accurate
- * enough and cheaper than a full haversine.
- *
- * Latitudes and longitudes are expressed in decimal degrees.
- *
- * \return Approximate distance in nautical miles.
- */
-static double approxSegmentLengthNm(double lat0, double lon0, double lat1, double lon1) {
-   const double dlatDeg = lat1 - lat0;
-   const double dlonDeg = lon1 - lon0;
-   const double latMidRad = ((lat0 + lat1) * 0.5) * DEG_TO_RAD;
-   const double dlatNm = dlatDeg * 60.0;
-   const double dlonNm = dlonDeg * 60.0 * cos(latMidRad);
-
-   return hypot(dlatNm, dlonNm);
-}
 /*!
  * \brief Check if the straight segment between (lat0, lon0) and (lat1, lon1)
  *        stays entirely over allowed sea areas.
  *
- * The function samples intermediate points along the geodesic segment
- * (approximated as a straight interpolation in lat/lon space) and calls
- * isSea(lat, lon) on each sample.
+ * The segment (straight in lat/lon space) is walked cell by cell over the
+ * isSea grid (Amanatides-Woo traversal, see segmentSea in inline.h), at high
+ * resolution in coastal cells when coastal tiles are loaded. Exact forbidden
+ * zone boundaries are then checked with the zone index (forbidzone.c).
  *
  * Rationale:
  * - Each endpoint is already supposed to be valid water, but in practice
  *   a straight line between two valid nodes may cross land (e.g. cutting
  *   across a headland or an island).
- * - We discretize the segment into small steps in nautical miles (NM).
- *   Finer step -> safer, but more calls to isSea().
- *
- * Assumptions:
- * - isSea(lat, lon) is fast (array lookup).
- * - Lat/lon variations between the two points are small enough that
- *   linear interpolation in degrees is acceptable for validation.
+ * - Every crossed cell is tested once: no cell is missed, whatever the
+ *   segment length, and no cell is tested twice.
  *
  * \param lat0 start latitude  in decimal degrees
  * \param lon0 start longitude in decimal degrees
  * \param lat1 end latitude    in decimal degrees
  * \param lon1 end longitude   in decimal degrees
  *
- * \return true  if all sampled points are at sea (and not in forbidden areas)
- * \return false if any sampled point is on land / forbidden
+ * \return true  if all crossed cells are at sea (and not in forbidden areas)
+ * \return false if any crossed cell is on land / forbidden
  */
 static bool segmentOverSea(double lat0, double lon0, double lat1, double lon1) {
-   // 1. Defensive check on endpoints */
-   const double epsilon = 1e-12;
-   if (!isSea (tIsSea, lat0, lon0)) return false;
-   if (!isSea (tIsSea, lat1, lon1)) return false;
-
-   // 2. Degenerate segment (same point or extremely close) */
-   const double dlat = lat1 - lat0;
-   const double dlon = lon1 - lon0;
-   if (fabs(dlat) < epsilon  && fabs(dlon) < epsilon) return true; // Same point, already tested */
-
-   // 3. Estimate segment length in NM */
-   double lengthNm = approxSegmentLengthNm(lat0, lon0, lat1, lon1);
-
-   // 4. Choose max spacing between checks.
-   const double stepNm = 1.0;
-
-   // 5. Compute how many intervals we need.
-   int steps = (int)ceil(lengthNm / stepNm);
-   steps = CLAMP (steps, 1, 2000); // hard cap to avoid crazy loops
-   
-   //Sample intermediate points.  We skip i=0 and i=steps because those are endpoints, already checked.
-   for (int i = 1; i < steps; i++) {
-      const double t = (double)i / (double)steps;
-      const double lat = lat0 + t * (lat1 - lat0);   // Linear interpolation in lat/lon space.
-      const double lon = lon0 + t * (lon1 - lon0);
-      if (!isSea(tIsSea, lat, lon)) return false;
-   }
-   return true;
+   return (segmentClear (lat0, lon0, lat1, lon1) || segmentSea (tIsSea, lat0, lon0, lat1, lon1, false))
+      && ! forbidSegmentCrosses (lat0, lon0, lat1, lon1);
 }
 
 /*!
@@ -0,0 +1,130 @@
+/*! Corridor: band of given half width around a polyline, used to prune routing candidates.
+   Optional times at vertices restrict the band at time t to segments sailed within a time margin of t.
+   Index: each segment is listed in the cells of CORRIDOR_CELL degrees that its band may reach (CSR arrays),
+   so that a point query only measures the few segments of its cell.
+   Distance: local equirectangular projection centered on the point, valid for bands up to a few hundred NM.
+   compilation: gcc -c corridor.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include "glibwrapper.h"
+#include "r3types.h"
+#include "inline.h"
+#include "corridor.h"
+
+#define CORRIDOR_ROWS ((int) (180.0 / CORRIDOR_CELL))
+#define CORRIDOR_COLS ((int) (360.0 / CORRIDOR_CELL))
+
+/*! row of cell for lat */
+static inline int corridorRow (double lat) {
+   const int r = (int) floor ((90.0 - lat) / CORRIDOR_CELL);
+   return MAX (0, MIN (CORRIDOR_ROWS - 1, r));
+}
+
+/*! column of cell for lon, any lon accepted */
+static inline int corridorCol (double lon) {
+   const int c = (int) floor (lon / CORRIDOR_CELL) % CORRIDOR_COLS;
+   return (c < 0) ? c + CORRIDOR_COLS : c;
+}
+
+/*! segment i counted in (fill NULL) or written to each cell its band may reach */
+static void corridorSegCells (const Corridor *c, int i, int *count, int *fill) {
+   const double hwDeg = c->halfWidth / 60.0;
+   const double latMin = MAX (-90.0, MIN (c->lat [i], c->lat [i + 1]) - hwDeg);
+   const double latMax = MIN (90.0, MAX (c->lat [i], c->lat [i + 1]) + hwDeg);
+   const double cosMin = cos (DEG_TO_RAD * MAX (fabs (latMin), fabs (latMax)));
+   const double lonMargin = hwDeg / MAX (cosMin, 0.01);
+   const double lonMin = MIN (c->lon [i], c->lon [i + 1]) - lonMargin;
+   const double lonMax = MAX (c->lon [i], c->lon [i + 1]) + lonMargin;
+   const int c0 = (int) floor (lonMin / CORRIDOR_CELL);
+   const int nCols = MIN (CORRIDOR_COLS, (int) floor (lonMax / CORRIDOR_CELL) - c0 + 1);
+   for (int r = corridorRow (latMax); r <= corridorRow (latMin); r++) {
+      for (int k = 0; k < nCols; k++) {
+         const int cell = r * CORRIDOR_COLS + corridorCol ((c0 + k + 0.5) * CORRIDOR_CELL);
+         if (fill != NULL) c->cellSeg [fill [cell]++] = i;
+         else count [cell] += 1;
+      }
+   }
+}
+
+/*! build corridor c of halfWidth (NM) around polyline of n vertices. time may be NULL (no time constraint).
+   return false if error */
+bool corridorBuild (Corridor *c, int n, const double *lat, const double *lon, const double *time,
+                    double halfWidth, double timeMargin) {
+   const int nCells = CORRIDOR_ROWS * CORRIDOR_COLS;
+   int *fill = NULL;
+   corridorFree (c);
+   if ((n < 2) || (halfWidth <= 0)) {
+      fprintf (stderr, "In corridorBuild, Error n: %d, halfWidth: %.2lf\n", n, halfWidth);
+      return false;
+   }
+   c->lat = malloc (n * sizeof (double));
+   c->lon = malloc (n * sizeof (double));
+   c->time = (time != NULL) ? malloc (n * sizeof (double)) : NULL;
+   c->cellStart = calloc (nCells + 1, sizeof (int));
+   fill = malloc (nCells * sizeof (int));
+   if (! c->lat || ! c->lon || ((time != NULL) && ! c->time) || ! c->cellStart || ! fill) {
+      fprintf (stderr, "In corridorBuild, Error Memory allocation: %d\n", n);
+      free (fill);
+      corridorFree (c);
+      return false;
+   }
+   c->n = n;
+   c->halfWidth = halfWidth;
+   c->timeMargin = timeMargin;
+   for (int i = 0; i < n; i++) {
+      c->lat [i] = lat [i];
+      c->lon [i] = (i == 0) ? lon [0] : c->lon [i - 1] + remainder (lon [i] - c->lon [i - 1], 360.0);
+      if (time != NULL) c->time [i] = time [i];
+   }
+
+   int *count = c->cellStart + 1;
+   for (int i = 0; i < n - 1; i++) corridorSegCells (c, i, count, NULL);
+   for (int cell = 0; cell < nCells; cell++) c->cellStart [cell + 1] += c->cellStart [cell];
+   if ((c->cellSeg = malloc (MAX (1, c->cellStart [nCells]) * sizeof (int))) == NULL) {
+      fprintf (stderr, "In corridorBuild, Error Memory allocation: %d\n", c->cellStart [nCells]);
+      free (fill);
+      corridorFree (c);
+      return false;
+   }
+   memcpy (fill, c->cellStart, nCells * sizeof (int));
+   for (int i = 0; i < n - 1; i++) corridorSegCells (c, i, NULL, fill);
+   free (fill);
+   return true;
+}
+
+/*! true if (lat, lon) at time t (hours after start) is inside corridor c */
+bool corridorContains (const Corridor *c, double lat, double lon, double t) {
+   const int cell = corridorRow (lat) * CORRIDOR_COLS + corridorCol (lon);
+   const double kx = 60.0 * cos (DEG_TO_RAD * lat);
+   const double hw2 = c->halfWidth * c->halfWidth;
+   for (int k = c->cellStart [cell]; k < c->cellStart [cell + 1]; k++) {
+      const int i = c->cellSeg [k];
+      if ((c->time != NULL) && ((c->time [i + 1] < t - c->timeMargin) || (c->time [i] > t + c->timeMargin)))
+         continue;
+      // segment [AB] in NM, origin at point
+      const double ax = remainder (c->lon [i] - lon, 360.0) * kx;
+      const double ay = (c->lat [i] - lat) * 60.0;
+      const double bx = ax + (c->lon [i + 1] - c->lon [i]) * kx;
+      const double by = (c->lat [i + 1] - lat) * 60.0;
+      const double dx = bx - ax, dy = by - ay;
+      const double len2 = dx * dx + dy * dy;
+      double u = (len2 > 0.0) ? -(ax * dx + ay * dy) / len2 : 0.0;
+      u = MAX (0.0, MIN (1.0, u));
+      const double hx = ax + u * dx, hy = ay + u * dy;
+      if (hx * hx + hy * hy <= hw2) return true;
+   }
+   return false;
+}
+
+/*! release corridor c. c is then empty (n == 0) */
+void corridorFree (Corridor *c) {
+   free (c->lat);
+   free (c->lon);
+   free (c->time);
+   free (c->cellStart);
+   free (c->cellSeg);
+   memset (c, 0, sizeof *c);
+}
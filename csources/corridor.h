@@ -0,0 +1,4 @@
+extern bool   corridorBuild (Corridor *c, int n, const double *lat, const double *lon, const double *time,
+                             double halfWidth, double timeMargin);
+extern bool   corridorContains (const Corridor *c, double lat, double lon, double t);
+extern void   corridorFree (Corridor *c);
@@ -20,6 +20,8 @@
 #include "inline.h"
 #include "r3util.h"
 #include "grib.h"
+#include "forbidzone.h"
+#include "corridor.h"
 
 #define MAX_N_INTERVAL      1000                    // for chooseDeparture
 #define LIMIT               1                       // for forwardSectorOptimize
@@ -36,6 +38,7 @@ IsoDesc *isoDesc = NULL;                        // Isochrone meta data. Array on
 int     maxNIsoc = 0;                           // Max number of isochrones based on based on Grib zone time stamp and isochrone time step
 int     nIsoc = 0;                              // total number of isochrones 
 Pp      lastClosest;                            // closest point to destination in last isochrone computed
+Corridor userCorridor;                          // corridor of routing request. Candidates outside pruned if userCorridor.n > 0
 
 /*! store sail route calculated in engine.c by routing */  
 SailRoute route;
@@ -47,6 +50,7 @@ ChooseDeparture chooseDeparture;                // for choice of departure time
 static double pOrToPDestCog = 0.0;              // cog from pOr to pDest.
 static int    pId = 1;                          // global ID for points. -1 and 0 are reserved for pOr and pDest
 static double tDeltaCurrent = 0.0;              // delta time in hours between wind zone and current zone
+static Corridor routeCorridor;                  // corridor around coarse route. Candidates outside pruned if routeCorridor.n > 0
 
 typedef struct {
    double vmc;
@@ -215,6 +219,30 @@ static inline int optimize (const Pp *pOr, const Pp *pDest, int nIsoc, int algo,
    return 0;
 }
 
+/*! make parent buffers of buildNextIsochrone at least n long. return false if no memory */
+static bool parentBufReserve (int n, double **lat, double **lon, WindVal **wind) {
+   static double *bufLat = NULL, *bufLon = NULL;
+   static WindVal *bufWind = NULL;
+   static int cap = 0;
+   if (n > cap) {
+      double *newLat = realloc (bufLat, n * sizeof (double));
+      if (newLat != NULL) bufLat = newLat;
+      double *newLon = realloc (bufLon, n * sizeof (double));
+      if (newLon != NULL) bufLon = newLon;
+      WindVal *newWind = realloc (bufWind, n * sizeof (WindVal));
+      if (newWind != NULL) bufWind = newWind;
+      if (newLat == NULL || newLon == NULL || newWind == NULL) {
+         fprintf (stderr, "In parentBufReserve, Error Memory allocation: %d\n", n);
+         return false;
+      }
+      cap = n;
+   }
+   *lat = bufLat;
+   *lon = bufLon;
+   *wind = bufWind;
+   return true;
+}
+
 /*! build the new list describing the next isochrone, starting from isoList 
   returns length of the newlist built or -1 if error*/
 static int buildNextIsochrone (const Pp *pOr, const Pp *pDest, const Pp *isoList, int isoLen,
@@ -222,23 +250,42 @@ static int buildNextIsochrone (const Pp *pOr, const Pp *pDest, const Pp *isoList
    static const double epsilon = 0.01;
    Pp newPt;
    int lenNewL = 0;
-   double u, v, gust, w, twa, sog, uCurr = 0.0, vCurr = 0.0, currTwd, currTws, vDirectCap;
+   double w, twa, sog, uCurr = 0.0, vCurr = 0.0, currTwd, currTws, vDirectCap;
    double dLat, dLon, penalty, efficiency;
    double waveCorrection, invDenominator, twd, tws;
+   double *parentLat, *parentLon;
+   WindVal *parentWind;
    int bidon; // useless
+   const double tNew = t + dt - par.startTimeInHours;   // time of new points after start, for corridor
 
    *bestVmc = 0;
    *biggestOrthoVmc = 0;
 
+   // wind of all parents in one call: time bracket and weights shared
+   if (! parentBufReserve (isoLen, &parentLat, &parentLon, &parentWind)) return -1;
+   for (int k = 0; k < isoLen; k++) {
+      parentLat [k] = isoList [k].lat;
+      parentLon [k] = isoList [k].lon;
+   }
+   const bool fusedCurrent = findWindGribBatch (t, isoLen, parentLat, parentLon, parentWind);
+
    for (int k = 0; k < isoLen; k++) {
       const Pp *isoPt = &isoList[k];
 
       if (!isInZone (isoPt->lat, isoPt->lon, &zone) && (par.constWindTws == 0)) continue;
 
-      findWindGrib (isoPt->lat, isoPt->lon, t, &u, &v, &gust, &w, &twd, &tws);
+      w = parentWind [k].w;
+      twd = parentWind [k].twd;
+      tws = parentWind [k].tws;
       if (tws > par.maxWind) continue; // avoid location where wind speed too high...
 
-      if (par.withCurrent) findCurrentGrib (isoPt->lat, isoPt->lon, t - tDeltaCurrent, &uCurr, &vCurr, &currTwd, &currTws);
+      if (par.withCurrent) {
+         if (fusedCurrent) {
+            uCurr = parentWind [k].uCurr;
+            vCurr = parentWind [k].vCurr;
+         }
+         else findCurrentGrib (isoPt->lat, isoPt->lon, t - tDeltaCurrent, &uCurr, &vCurr, &currTwd, &currTws);
+      }
 
       vDirectCap = orthoCap (isoPt->lat, isoPt->lon, pDest->lat, pDest->lon);
       const bool useMotor = (maxSpeedInPolarAt (tws * par.xWind, &polMat) < par.threshold) && (par.motorSpeed > 0);
@@ -292,13 +339,20 @@ static int buildNextIsochrone (const Pp *pOr, const Pp *pDest, const Pp *isoList
 
          newPt.lat = isoPt->lat + dLat / 60.0;
          newPt.lon = isoPt->lon + dLon / 60.0;
+         if ((routeCorridor.n > 0) && ! corridorContains (&routeCorridor, newPt.lat, newPt.lon, tNew))
+            continue;                                                      // outside corridor of coarse route
+         if ((userCorridor.n > 0) && ! corridorContains (&userCorridor, newPt.lat, newPt.lon, tNew))
+            continue;                                                      // outside corridor of request
          newPt.id = pId++;
          newPt.father = isoPt->id;
          newPt.vmc = 0.0;
          newPt.orthoVmc = 0.0;
          // newPt.sector = 0;
 
-         if (par.allwaysSea || isSeaTolerant(tIsSea, newPt.lat, newPt.lon)) {
+         if (par.allwaysSea || ((segmentClear (isoPt->lat, isoPt->lon, newPt.lat, newPt.lon)  // offshore: no land test
+               || (isSeaTolerant(tIsSea, newPt.lat, newPt.lon)
+               && (! par.segmentCheck || segmentSea (tIsSea, isoPt->lat, isoPt->lon, newPt.lat, newPt.lon, true))))
+            && ((par.nForbidZone <= 0) || ! forbidSegmentCrosses (isoPt->lat, isoPt->lon, newPt.lat, newPt.lon)))) {
             newPt.dd = orthoDist (newPt.lat, newPt.lon, pDest->lat, pDest->lon);
             const double alpha = orthoCap (pOr->lat, pOr->lon, newPt.lat, newPt.lon) - pOrToPDestCog;
             const double newPtToPorDist = orthoDist (newPt.lat, newPt.lon, pOr->lat, pOr->lon);
@@ -877,12 +931,13 @@ static inline bool goalP (const Pp *pA, const Pp *pB, const Pp *pDest, double t,
 
 /*! true if goal can be reached directly in dt from isochrone 
   update isoDesc
-  side effect : pDest.father can be modified ! */
+  side effect : pDest.father can be modified ! Father is the fastest point among segments reaching goal */
 static inline bool goal (Pp *pDest, Pp *isoList, int len, double t, double dt, double *lastStepDuration, bool *motor, int *amure) {
-   double bestTime = DBL_MAX;
+   double bestTime = DBL_MAX, bestReachTime = DBL_MAX;
    double time, distance;
    bool destinationReached = false;
-   int sail;
+   bool segMotor;
+   int sail, segAmure;
    // double minDistance = 9999.99;
    const Pp *prev = &isoList[0];
    bool bestFirst;
@@ -890,24 +945,22 @@ static inline bool goal (Pp *pDest, Pp *isoList, int len, double t, double dt, d
    for (int k = 1; k < len; k++) {
       const Pp *curr = &isoList[k];
       if (par.allwaysSea || isSeaTolerant(tIsSea, curr->lat, curr->lon)) {
-         if (goalP (prev, curr, pDest, t, dt, &time, &distance, motor, amure, &sail, &bestFirst)) {
+         const bool reached = goalP (prev, curr, pDest, t, dt, &time, &distance, &segMotor, &segAmure, &sail, &bestFirst);
+         if (reached && (time < bestReachTime)) {
+            bestReachTime = time;
             destinationReached = true;
+            pDest->father = bestFirst ? prev->id : curr->id;
+            pDest->motor = *motor = segMotor;
+            pDest->amure = *amure = segAmure;
+            pDest->sail = sail;
          }
-         if (time < bestTime) {
-            bestTime = time;
-            if (destinationReached) {
-               pDest->father = bestFirst ? prev->id : curr->id;
-               pDest->motor = *motor;
-               pDest->amure = *amure;
-               pDest->sail = sail;
-            }
-         }
+         if (time < bestTime) bestTime = time;
          // if (distance < minDistance) minDistance = distance;
       }
       prev = curr; 
    }
    // isoDesc[nIsoc -1].distance = minDistance;
-   *lastStepDuration = bestTime;
+   *lastStepDuration = destinationReached ? bestReachTime : bestTime;
    return destinationReached;
 }
 
@@ -1082,6 +1135,11 @@ static int routing (Pp *pOr, Pp *pDest, int toIndexWp, double t, double dt, doub
          return -1;
       }
       isoDesc [nIsoc].size = optimize (pOr, pDest, nIsoc, par.opt, tempList, lTempList, &isocArray [nIsoc * MAX_SIZE_ISOC]);
+      if ((isoDesc [nIsoc].size == 0) && (routeCorridor.n > 0)) { // corridor too narrow: full search by routingLaunch
+         fprintf (stderr, "In routing, isochrone empty in corridor at isoc: %d\n", nIsoc);
+         free (tempList);
+         return NIL;
+      }
       if (isoDesc [nIsoc].size == 0) { // no Wind ... we copy
          fprintf (stderr, "In routing, no wind at isoc: %d\n", nIsoc);
          replicate (nIsoc);
@@ -1107,6 +1165,7 @@ static void initRouting (void) {
    memset (sector, 0, sizeof(sector));
    lastClosest = par.pOr;
    tDeltaCurrent = zoneTimeDiff (&currentZone, &zone); // global variable
+   if (par.withCurrent) resampleCurrentOnWind ();      // no effect unless par.currentOnWind
    par.pOr.id = -1;
    par.pOr.father = -1;
    par.pDest.id = 0;
@@ -1180,21 +1239,14 @@ static void checkArrival (SailRoute *route, Pp *pDest) {
    );
 }
 
-/*! launch routing with parameters */
-void *routingLaunch (void) {
-   double lastStepDuration = 0.0;
+/*! routing from par.pOr to par.pDest through wayPoints. Return routing value of last leg */
+static int routingAllLegs (double *lastStepDuration) {
    Pp pNext;
-   initRouting ();
-   route.competitorIndex = competitors.runIndex;
-   fprintf (stdout, "In routingLaunch: competitor index: %d, name: %s\n", competitors.runIndex, competitors.t[competitors.runIndex].name);
    int ret = -1;
-   const double start = monotonic (); 
    double wayPointStartTime = par.startTimeInHours;
-
-   fprintf (stdout, "Before Routing, pDest ID: %d, Father: %d\n", par.pDest.id, par.pDest.father);
-   //Launch routing
+   *lastStepDuration = 0.0;
    if (wayPoints.n == 0) {
-      ret = routing (&par.pOr, &par.pDest, -1, wayPointStartTime, par.tStep, &lastStepDuration);
+      ret = routing (&par.pOr, &par.pDest, -1, wayPointStartTime, par.tStep, lastStepDuration);
    }
    else {
       for (int i = 0; i < wayPoints.n; i ++) {
@@ -1202,15 +1254,15 @@ void *routingLaunch (void) {
          pNext.lon = wayPoints.t[i].lon;
          pNext.id = -2 - i;
          if (i == 0) {
-            ret = routing (&par.pOr, &pNext, i, wayPointStartTime, par.tStep, &lastStepDuration);
+            ret = routing (&par.pOr, &pNext, i, wayPointStartTime, par.tStep, lastStepDuration);
          }
          else {
-            ret = routing (&isocArray [(nIsoc-1) * MAX_SIZE_ISOC + 0], &pNext, i, wayPointStartTime, par.tStep, &lastStepDuration);
+            ret = routing (&isocArray [(nIsoc-1) * MAX_SIZE_ISOC + 0], &pNext, i, wayPointStartTime, par.tStep, lastStepDuration);
          }
          fprintf (stdout, "After Waypoint; %d, ret: %d, pNext ID: %d, Father: %d\n", i, ret, pNext.id, pNext.father);
-         route.lastStepWpDuration [i] = lastStepDuration;
+         route.lastStepWpDuration [i] = *lastStepDuration;
          if (ret > 0) {
-            wayPointStartTime = par.startTimeInHours + (nIsoc * par.tStep) + lastStepDuration;
+            wayPointStartTime = par.startTimeInHours + (nIsoc * par.tStep) + *lastStepDuration;
             isocArray [nIsoc * MAX_SIZE_ISOC + 0].lat = pNext.lat;
             isocArray [nIsoc * MAX_SIZE_ISOC + 0].lon = pNext.lon;
             isocArray [nIsoc * MAX_SIZE_ISOC + 0].father = pNext.father;
@@ -1227,9 +1279,91 @@ void *routingLaunch (void) {
          else break;
       }
       if (ret > 0) {
-         ret = routing (&isocArray [(nIsoc-1) * MAX_SIZE_ISOC + 0], &par.pDest, -1, wayPointStartTime, par.tStep, &lastStepDuration);
+         ret = routing (&isocArray [(nIsoc-1) * MAX_SIZE_ISOC + 0], &par.pDest, -1, wayPointStartTime, par.tStep, lastStepDuration);
       } 
    }
+   return ret;
+}
+
+/*! release isochrones and route of previous pass before initRouting */
+static void routingRelease (void) {
+   free (isocArray);
+   free (isoDesc);
+   free (route.t);
+   isocArray = NULL;
+   isoDesc = NULL;
+   route.t = NULL;
+}
+
+/*! routing with coarse settings already in par, then routeCorridor built around the route.
+   Return false if no corridor */
+static bool coarseRouteCorridor (void) {
+   double lastStepDuration;
+   bool ok = false;
+   initRouting ();
+   const int ret = routingAllLegs (&lastStepDuration);
+   if (ret > 0) {
+      route.lastStepDuration = lastStepDuration;
+      route.nWayPoints = wayPoints.n;
+      route.destinationReached = (par.pDest.father != 0);
+      if (storeRoute (&route, &par.pOr, (route.destinationReached) ? &par.pDest : &lastClosest)) {
+         statRoute (&route);                                    // times of route points
+         double *lat = malloc (3 * route.n * sizeof (double));
+         if (lat != NULL) {
+            double *lon = lat + route.n, *hours = lon + route.n;
+            for (int i = 0; i < route.n; i++) {
+               lat [i] = route.t [i].lat;
+               lon [i] = route.t [i].lon;
+               hours [i] = route.t [i].time;
+            }
+            ok = corridorBuild (&routeCorridor, route.n, lat, lon, hours, par.corridorWidth, par.corridorTimeMargin);
+            free (lat);
+         }
+      }
+   }
+   fprintf (stdout, "In coarseCorridor: factor: %d, ret: %d, coarse duration: %.2lf, corridor: %s\n", 
+      par.coarseFactor, ret, ok ? route.duration : -1.0, ok ? "yes" : "no");
+   return ok;
+}
+
+/*! coarse pass: routing with tStep and cogStep multiplied and nSectors divided by par.coarseFactor,
+   then routeCorridor built around the coarse route. par is restored on this single exit path.
+   Return false if no corridor */
+static bool coarseCorridor (void) {
+   const double tStep = par.tStep;
+   const int cogStep = par.cogStep, nSectors = par.nSectors;
+   par.tStep = tStep * par.coarseFactor;
+   par.cogStep = cogStep * par.coarseFactor;
+   par.nSectors = MAX (1, nSectors / par.coarseFactor);
+   const bool ok = coarseRouteCorridor ();
+   par.tStep = tStep;
+   par.cogStep = cogStep;
+   par.nSectors = nSectors;
+   routingRelease ();
+   return ok;
+}
+
+/*! launch routing with parameters */
+void *routingLaunch (void) {
+   double lastStepDuration = 0.0;
+   const double start = monotonic (); 
+   if ((par.coarseFactor > 1) && ! coarseCorridor () && (g_atomic_int_get (&route.ret) == ROUTING_STOPPED))
+      return NULL;
+   initRouting ();
+   route.competitorIndex = competitors.runIndex;
+   fprintf (stdout, "In routingLaunch: competitor index: %d, name: %s\n", competitors.runIndex, competitors.t[competitors.runIndex].name);
+
+   fprintf (stdout, "Before Routing, pDest ID: %d, Father: %d\n", par.pDest.id, par.pDest.father);
+   int ret = routingAllLegs (&lastStepDuration);
+   if ((routeCorridor.n > 0) && (ret != ROUTING_STOPPED) && ((ret <= 0) || (par.pDest.father == 0))) {
+      fprintf (stdout, "In routingLaunch: destination unreached in corridor, ret: %d, full search\n", ret);
+      corridorFree (&routeCorridor);
+      routingRelease ();
+      initRouting ();
+      route.competitorIndex = competitors.runIndex;
+      ret = routingAllLegs (&lastStepDuration);
+   }
+   corridorFree (&routeCorridor);
    fprintf (stdout, "After Routing, ret: %d, pDest ID: %d, Father: %d\n", ret, par.pDest.id, par.pDest.father);
    if (ret == -1) {
       g_atomic_int_set (&route.ret, ROUTING_ERROR); // -1
@@ -3,6 +3,7 @@ extern IsoDesc   *isoDesc;                      // one dimension array for isoch
 extern int       nIsoc;                         // number of isochrones calculated  by routing
 extern int       maxNIsoc;                      // max number of Isoc considering Grib meta information and timestep
 extern Pp        lastClosest;                   // closest point to destination in last isochrone computed
+extern Corridor  userCorridor;                  // corridor of routing request, empty if none
 extern ChooseDeparture chooseDeparture;         // for choice of departure time
 extern HistoryRouteList historyRoute;           // history of calculated routes
 extern SailRoute route;                         // current route
@@ -0,0 +1,609 @@
+/*! Forbidden zones: storage, GeoJSON reader and spatial index for exact queries at routing time.
+   Zones are rings (forbidZones, par.nForbidZone): outer ring then holes sharing same zone, even-odd rule.
+   Points of all rings are in one contiguous array, ring after ring.
+   GeoJSON file read in one pass on a buffered stream: Polygon and MultiPolygon with holes, no size limit.
+   Index: bucket grid over bounding box of all zones, about one edge per cell. Each cell keeps the edges crossing it
+   and the zones containing its center (computed once by scanline, even-odd rule like ray casting).
+   Point query: zones of cell center toggled by edges of the cell crossed by segment center -> point.
+   Segment query: start point query, then edges of the cells crossed by the segment.
+   Both cost a few edge tests whatever the number of zones and vertices.
+   compilation: gcc -c forbidzone.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <float.h>
+#include "glibwrapper.h"
+#include "r3types.h"
+#include "r3util.h"
+#include "forbidzone.h"
+
+#define FORBID_MAX_GRID      512       // max number of rows or columns of bucket grid
+#define FORBID_MAX_TOGGLE    64        // max zones met in one cell for point query
+#define GEOJSON_MAX_DEPTH    128       // max nesting of objects and arrays in GeoJSON file
+#define GEOJSON_BUFFER       65536     // read buffer of GeoJSON file
+
+MyPolygon *forbidZones = NULL;         // rings of forbidden zones, par.nForbidZone entries
+static int capZones = 0;
+static Point *forbidPoints = NULL;     // points of all rings, ring after ring
+static size_t nForbidPoints = 0, capPoints = 0;
+static size_t ringFirst = 0;           // first point of ring being built
+static int nPolygons = 0;              // number of zones (outer rings)
+static int holeZone = -1;              // zone of last outer ring kept, -1 if dropped
+
+/*! state of storage, to drop what is added after */
+typedef struct {
+   int nRings, nPolygons, holeZone;
+   size_t nPoints;
+} ForbidMark;
+
+/*! append point to ring being built. return false on memory error */
+bool forbidPointAdd (double lat, double lon) {
+   if (nForbidPoints >= capPoints) {
+      const size_t newCap = capPoints ? 2 * capPoints : 1024;
+      Point *tmp = realloc (forbidPoints, newCap * sizeof (Point));
+      if (tmp == NULL) {
+         fprintf (stderr, "In forbidPointAdd, Error Memory allocation\n");
+         return false;
+      }
+      forbidPoints = tmp;
+      capPoints = newCap;
+      size_t first = 0;
+      for (int r = 0; r < par.nForbidZone; r++) {
+         forbidZones [r].points = forbidPoints + first;
+         first += forbidZones [r].n;
+      }
+   }
+   forbidPoints [nForbidPoints++] = (Point) {lat, lon};
+   return true;
+}
+
+/*! close ring made of points added since last close. Outer ring starts a new zone, hole belongs to zone of
+   last outer ring. Closing point equal to first point dropped, ring with less than 3 points ignored.
+   return false on memory error */
+bool forbidRingClose (bool hole) {
+   const Point *p = forbidPoints + ringFirst;
+   int n = (int) (nForbidPoints - ringFirst);
+   if ((n > 1) && (p [0].lat == p [n - 1].lat) && (p [0].lon == p [n - 1].lon)) n -= 1;
+   if ((n < 3) || (hole && (holeZone < 0))) {
+      nForbidPoints = ringFirst;
+      if (! hole) holeZone = -1;
+      return true;
+   }
+   if (par.nForbidZone >= capZones) {
+      const int newCap = capZones ? 2 * capZones : 64;
+      MyPolygon *tmp = realloc (forbidZones, newCap * sizeof (MyPolygon));
+      if (tmp == NULL) {
+         fprintf (stderr, "In forbidRingClose, Error Memory allocation\n");
+         return false;
+      }
+      forbidZones = tmp;
+      capZones = newCap;
+   }
+   if (! hole) holeZone = nPolygons++;
+   forbidZones [par.nForbidZone++] = (MyPolygon) {n, forbidPoints + ringFirst, holeZone};
+   nForbidPoints = ringFirst + n;
+   ringFirst = nForbidPoints;
+   return true;
+}
+
+/*! number of forbidden zones (a zone is an outer ring with its holes) */
+int forbidNPolygons (void) {
+   return nPolygons;
+}
+
+/*! free forbidden zones */
+void forbidZonesFree (void) {
+   free (forbidZones);
+   free (forbidPoints);
+   forbidZones = NULL;
+   forbidPoints = NULL;
+   capZones = 0;
+   nForbidPoints = capPoints = ringFirst = 0;
+   nPolygons = 0;
+   holeZone = -1;
+   par.nForbidZone = 0;
+}
+
+static ForbidMark forbidMarkGet (void) {
+   return (ForbidMark) {par.nForbidZone, nPolygons, holeZone, ringFirst};
+}
+
+/*! drop rings and points added since mark m */
+static void forbidRollback (const ForbidMark *m) {
+   par.nForbidZone = m->nRings;
+   nPolygons = m->nPolygons;
+   holeZone = m->holeZone;
+   nForbidPoints = ringFirst = m->nPoints;
+}
+
+/*! buffered reader of GeoJSON file */
+typedef struct {
+   FILE *f;
+   size_t pos, len;
+   int line;
+   char buf [GEOJSON_BUFFER];
+} GeoStream;
+
+/*! next char, not consumed. EOF at end of file */
+static inline int geoPeek (GeoStream *s) {
+   if (s->pos >= s->len) {
+      s->len = fread (s->buf, 1, sizeof s->buf, s->f);
+      s->pos = 0;
+      if (s->len == 0) return EOF;
+   }
+   return (unsigned char) s->buf [s->pos];
+}
+
+/*! next char, consumed */
+static inline int geoGet (GeoStream *s) {
+   const int c = geoPeek (s);
+   if (c != EOF) {
+      s->pos += 1;
+      if (c == '\n') s->line += 1;
+   }
+   return c;
+}
+
+/*! next char not blank, not consumed */
+static int geoSkip (GeoStream *s) {
+   int c;
+   while (((c = geoPeek (s)) == ' ') || (c == '\n') || (c == '\r') || (c == '\t')) geoGet (s);
+   return c;
+}
+
+/*! consume string. First maxLen - 1 chars copied in str (escaped chars without backslash).
+   return false if not terminated */
+static bool geoString (GeoStream *s, char *str, size_t maxLen) {
+   size_t n = 0;
+   int c;
+   geoGet (s);                                     // opening quote
+   while ((c = geoGet (s)) != '"') {
+      if ((c == '\\') && ((c = geoGet (s)) == EOF)) return false;
+      if (c == EOF) return false;
+      if (n + 1 < maxLen) str [n++] = (char) c;
+   }
+   if (maxLen > 0) str [n] = '\0';
+   return true;
+}
+
+/*! consume number. return false if not a number */
+static bool geoNumber (GeoStream *s, double *v) {
+   char str [MAX_SIZE_NUMBER];
+   char *end;
+   size_t n = 0;
+   int c;
+   while (((c = geoPeek (s)) >= '0' && c <= '9') || (c == '-') || (c == '+') || (c == '.') || (c == 'e') || (c == 'E')) {
+      if (n + 1 < sizeof str) str [n++] = (char) c;
+      geoGet (s);
+   }
+   str [n] = '\0';
+   *v = strtod (str, &end);
+   return (n > 0) && (*end == '\0');
+}
+
+static bool geoValue (GeoStream *s, int depth);
+
+/*! consume array of coordinates. Positions [lon, lat, ...] added to ring being built, arrays of positions close a ring,
+   hole if not first ring of its polygon. height: 1 for position, 2 for ring, 3 for polygon, 4 for multipolygon */
+static bool geoCoords (GeoStream *s, int depth, int index, int *height) {
+   if ((depth > GEOJSON_MAX_DEPTH) || (geoSkip (s) != '[')) return false;
+   geoGet (s);
+   int c = geoSkip (s);
+   *height = 1;
+   if (c == '[') {
+      int childHeight = 0;
+      for (int k = 0; ; k++) {
+         int h;
+         if (! geoCoords (s, depth + 1, k, &h)) return false;
+         if (k == 0) childHeight = h;
+         if ((c = geoSkip (s)) == ']') break;
+         if (c != ',') return false;
+         geoGet (s);
+      }
+      *height = childHeight + 1;
+   }
+   else if (c != ']') {
+      double v [2] = {0};
+      for (int k = 0; ; k++) {
+         double x;
+         if (! geoNumber (s, &x)) return false;
+         if (k < 2) v [k] = x;
+         if ((c = geoSkip (s)) == ']') {
+            if (k < 1) return false;
+            break;
+         }
+         if (c != ',') return false;
+         geoGet (s);
+         geoSkip (s);
+      }
+      if (! forbidPointAdd (v [1], v [0])) return false;
+   }
+   geoGet (s);                                     // closing bracket
+   return (*height != 2) || forbidRingClose (index > 0);
+}
+
+/*! consume object. Rings of coordinates kept only if type is Polygon or MultiPolygon */
+static bool geoObject (GeoStream *s, int depth) {
+   char key [MAX_SIZE_NAME], type [MAX_SIZE_NAME] = "";
+   bool hasCoords = false;
+   int height = 0;
+   ForbidMark mark = forbidMarkGet ();
+   geoGet (s);
+   int c = geoSkip (s);
+   if (c == '}') {
+      geoGet (s);
+      return true;
+   }
+   while (true) {
+      if ((c != '"') || ! geoString (s, key, sizeof key) || (geoSkip (s) != ':')) return false;
+      geoGet (s);
+      c = geoSkip (s);
+      if ((strcmp (key, "coordinates") == 0) && (c == '[') && ! hasCoords) {
+         mark = forbidMarkGet ();
+         if (! geoCoords (s, depth + 1, 0, &height)) return false;
+         hasCoords = true;
+      }
+      else if ((strcmp (key, "type") == 0) && (c == '"')) {
+         if (! geoString (s, type, sizeof type)) return false;
+      }
+      else if (! geoValue (s, depth + 1)) return false;
+      if ((c = geoSkip (s)) == '}') break;
+      if (c != ',') return false;
+      geoGet (s);
+      c = geoSkip (s);
+   }
+   geoGet (s);
+   if (hasCoords && ! (((strcmp (type, "Polygon") == 0) && (height == 3))
+      || ((strcmp (type, "MultiPolygon") == 0) && (height == 4))))
+      forbidRollback (&mark);
+   return true;
+}
+
+/*! consume any JSON value */
+static bool geoValue (GeoStream *s, int depth) {
+   if (depth > GEOJSON_MAX_DEPTH) return false;
+   int c = geoSkip (s);
+   double x;
+   switch (c) {
+   case '{': return geoObject (s, depth);
+   case '"': return geoString (s, NULL, 0);
+   case '[':
+      geoGet (s);
+      if (geoSkip (s) == ']') break;
+      while (true) {
+         if (! geoValue (s, depth + 1)) return false;
+         if ((c = geoSkip (s)) == ']') break;
+         if (c != ',') return false;
+         geoGet (s);
+      }
+      break;
+   default:
+      if ((c == '-') || ((c >= '0') && (c <= '9'))) return geoNumber (s, &x);
+      if ((c < 'a') || (c > 'z')) return false;  // true, false, null
+      while (((c = geoPeek (s)) >= 'a') && (c <= 'z')) geoGet (s);
+      return true;
+   }
+   geoGet (s);                                     // closing bracket
+   return true;
+}
+
+/*! read GeoJSON file of forbidden zones, replacing current zones. Polygon and MultiPolygon geometries,
+   with holes, are kept wherever they are (FeatureCollection, Feature, GeometryCollection). Other geometries ignored.
+   One pass, linear time. GeoJSON coordinates are [lon, lat]. return false on error (no zone then) */
+bool readGeoJson (const char *fileName) {
+   forbidZonesFree ();
+   GeoStream *s = malloc (sizeof (GeoStream));
+   if (s == NULL) {
+      fprintf (stderr, "In readGeoJson, Error Memory allocation\n");
+      return false;
+   }
+   if ((s->f = fopen (fileName, "r")) == NULL) {
+      fprintf (stderr, "In readGeoJson, Error Cannot open: %s\n", fileName);
+      free (s);
+      return false;
+   }
+   s->pos = s->len = 0;
+   s->line = 1;
+   if (geoPeek (s) == 0xEF) for (int k = 0; k < 3; k++) geoGet (s);   // UTF-8 BOM
+   const bool ok = geoValue (s, 0) && (geoSkip (s) == EOF);
+   if (! ok) {
+      fprintf (stderr, "In readGeoJson, Error syntax line %d: %s\n", s->line, fileName);
+      forbidZonesFree ();
+   }
+   fclose (s->f);
+   free (s);
+   return ok;
+}
+
+/*! edge of a forbidden zone */
+typedef struct {
+   double lat0, lon0, lat1, lon1;
+   int zone;
+} ForbidEdge;
+
+/*! bucket grid. CSR lists: cell k owns items [start [k], start [k + 1]) */
+static struct {
+   int nRow, nCol;
+   double latMin, lonMin, latMax, lonMax, dLat, dLon;
+   ForbidEdge *edges;
+   int nEdges;
+   int *edgeStart, *cellEdges;         // edges crossing each cell
+   int *insideStart, *insideZones;     // zones containing center of each cell
+} fIndex;
+
+/*! free index */
+void forbidIndexFree (void) {
+   free (fIndex.edges);
+   free (fIndex.edgeStart);
+   free (fIndex.cellEdges);
+   free (fIndex.insideStart);
+   free (fIndex.insideZones);
+   memset (&fIndex, 0, sizeof fIndex);
+}
+
+/*! sign of cross product (b - a) x (c - a) in lon lat plane */
+static inline double orient (double aLat, double aLon, double bLat, double bLon, double cLat, double cLon) {
+   return (bLon - aLon) * (cLat - aLat) - (bLat - aLat) * (cLon - aLon);
+}
+
+/*! true if segments p0 p1 and edge e intersect (touching counts) */
+static inline bool edgeHit (const ForbidEdge *e, double lat0, double lon0, double lat1, double lon1) {
+   const double d1 = orient (e->lat0, e->lon0, e->lat1, e->lon1, lat0, lon0);
+   const double d2 = orient (e->lat0, e->lon0, e->lat1, e->lon1, lat1, lon1);
+   const double d3 = orient (lat0, lon0, lat1, lon1, e->lat0, e->lon0);
+   const double d4 = orient (lat0, lon0, lat1, lon1, e->lat1, e->lon1);
+   return ((d1 <= 0 && d2 >= 0) || (d1 >= 0 && d2 <= 0)) && ((d3 <= 0 && d4 >= 0) || (d3 >= 0 && d4 <= 0))
+      && ! (d1 == 0 && d2 == 0);        // collinear segments ignored
+}
+
+/*! cells of grid crossed by segment, clipped to grid (Amanatides-Woo traversal).
+   return number of cells written in cells (at most maxCells) */
+static int gridCells (double lat0, double lon0, double lat1, double lon1, int *cells, int maxCells) {
+   const double x0 = (lon0 - fIndex.lonMin) / fIndex.dLon, y0 = (lat0 - fIndex.latMin) / fIndex.dLat;
+   const double dx = (lon1 - lon0) / fIndex.dLon, dy = (lat1 - lat0) / fIndex.dLat;
+   double ta = 0.0, tb = 1.0;
+   // clip to grid (Liang-Barsky)
+   const double p [4] = {-dx, dx, -dy, dy};
+   const double q [4] = {x0, fIndex.nCol - x0, y0, fIndex.nRow - y0};
+   for (int k = 0; k < 4; k++) {
+      if (p [k] == 0) {
+         if (q [k] < 0) return 0;
+      }
+      else {
+         const double r = q [k] / p [k];
+         if (p [k] < 0) ta = fmax (ta, r);
+         else tb = fmin (tb, r);
+      }
+   }
+   if (ta > tb) return 0;
+   int cx = CLAMP ((int) floor (x0 + ta * dx), 0, fIndex.nCol - 1);
+   int cy = CLAMP ((int) floor (y0 + ta * dy), 0, fIndex.nRow - 1);
+   const int stepX = (dx > 0) ? 1 : -1, stepY = (dy > 0) ? 1 : -1;
+   const double tDeltaX = (dx != 0) ? fabs (1.0 / dx) : INFINITY;
+   const double tDeltaY = (dy != 0) ? fabs (1.0 / dy) : INFINITY;
+   double tMaxX = (dx != 0) ? (cx + (stepX > 0) - x0) / dx : INFINITY;
+   double tMaxY = (dy != 0) ? (cy + (stepY > 0) - y0) / dy : INFINITY;
+   int n = 0;
+   while (n < maxCells) {
+      cells [n++] = cy * fIndex.nCol + cx;
+      if (fmin (tMaxX, tMaxY) >= tb) break;
+      if (tMaxX < tMaxY) {
+         cx += stepX;
+         tMaxX += tDeltaX;
+      }
+      else {
+         cy += stepY;
+         tMaxY += tDeltaY;
+      }
+      if ((cx < 0) || (cx >= fIndex.nCol) || (cy < 0) || (cy >= fIndex.nRow)) break;
+   }
+   return n;
+}
+
+/*! append v to dynamic array *a of size *n and capacity *cap. return false on memory error */
+static bool intPush (int **a, int *n, int *cap, int v) {
+   if (*n >= *cap) {
+      const int newCap = *cap ? 2 * *cap : 1024;
+      int *tmp = realloc (*a, newCap * sizeof (int));
+      if (tmp == NULL) return false;
+      *a = tmp;
+      *cap = newCap;
+   }
+   (*a) [(*n)++] = v;
+   return true;
+}
+
+/*! crossing of edge with row of cell centers, for scanline */
+typedef struct {
+   double lon;
+   int zone;
+} ForbidCross;
+
+static int compareCross (const void *a, const void *b) {
+   const double x = ((const ForbidCross *) a)->lon, y = ((const ForbidCross *) b)->lon;
+   return (x > y) - (x < y);
+}
+
+/*! rows of centers that edge e may cross, one row margin */
+static inline void edgeRows (const ForbidEdge *e, int *r0, int *r1) {
+   *r0 = CLAMP ((int) floor ((fmin (e->lat0, e->lat1) - fIndex.latMin) / fIndex.dLat - 0.5), 0, fIndex.nRow - 1);
+   *r1 = CLAMP ((int) ceil ((fmax (e->lat0, e->lat1) - fIndex.latMin) / fIndex.dLat - 0.5), 0, fIndex.nRow - 1);
+}
+
+/*! zones containing center of each cell: scanline on each row of centers, zone parity toggled at each crossing.
+   Edges bucketed by rows first so that each row only tests edges spanning it */
+static bool buildInside (void) {
+   const int nCells = fIndex.nRow * fIndex.nCol;
+   ForbidCross *cross = malloc (MAX (fIndex.nEdges, 1) * sizeof (ForbidCross));
+   int *pos = malloc (MAX (nPolygons, 1) * sizeof (int));      // position of zone in active, -1 if absent
+   int *active = malloc (MAX (nPolygons, 1) * sizeof (int));   // zones with odd parity
+   int *rowStart = calloc (fIndex.nRow + 1, sizeof (int));     // CSR: edges of row r: rowEdges [rowStart [r]..]
+   int *rowEdges = NULL;
+   int n = 0, cap = 0, r0, r1;
+   bool ok = (cross != NULL) && (pos != NULL) && (active != NULL) && (rowStart != NULL)
+      && ((fIndex.insideStart = malloc ((nCells + 1) * sizeof (int))) != NULL);
+   for (int e = 0; ok && (e < fIndex.nEdges); e++) {
+      edgeRows (&fIndex.edges [e], &r0, &r1);
+      for (int r = r0; r <= r1; r++) rowStart [r + 1] += 1;
+   }
+   for (int r = 0; ok && (r < fIndex.nRow); r++) rowStart [r + 1] += rowStart [r];
+   if (ok && ((rowEdges = malloc (MAX (rowStart [fIndex.nRow], 1) * sizeof (int))) != NULL)) {
+      for (int e = 0; e < fIndex.nEdges; e++) {
+         edgeRows (&fIndex.edges [e], &r0, &r1);
+         for (int r = r0; r <= r1; r++) rowEdges [rowStart [r]++] = e;
+      }
+      for (int r = fIndex.nRow; r > 0; r--) rowStart [r] = rowStart [r - 1];   // fill shifted starts
+      rowStart [0] = 0;
+   }
+   else ok = false;
+   for (int r = 0; ok && (r < fIndex.nRow); r++) {
+      const double lat = fIndex.latMin + (r + 0.5) * fIndex.dLat;
+      int nCross = 0, nActive = 0;
+      for (int k = rowStart [r]; k < rowStart [r + 1]; k++) {
+         const ForbidEdge *ed = &fIndex.edges [rowEdges [k]];
+         if ((ed->lat0 > lat) != (ed->lat1 > lat)) {
+            cross [nCross].lon = (ed->lon1 - ed->lon0) * (lat - ed->lat0) / (ed->lat1 - ed->lat0) + ed->lon0;
+            cross [nCross++].zone = ed->zone;
+         }
+      }
+      qsort (cross, nCross, sizeof (ForbidCross), compareCross);
+      for (int z = 0; z < nPolygons; z++) pos [z] = -1;
+      int k = 0;
+      for (int c = 0; ok && (c < fIndex.nCol); c++) {
+         const double lon = fIndex.lonMin + (c + 0.5) * fIndex.dLon;
+         for (; (k < nCross) && (cross [k].lon < lon); k++) {
+            const int z = cross [k].zone;
+            if (pos [z] < 0) {
+               pos [z] = nActive;
+               active [nActive++] = z;
+            }
+            else {
+               const int last = active [--nActive];
+               active [pos [z]] = last;
+               pos [last] = pos [z];
+               pos [z] = -1;
+            }
+         }
+         fIndex.insideStart [r * fIndex.nCol + c] = n;
+         for (int a = 0; ok && (a < nActive); a++) ok = intPush (&fIndex.insideZones, &n, &cap, active [a]);
+      }
+   }
+   if (ok) fIndex.insideStart [nCells] = n;
+   free (rowStart);
+   free (rowEdges);
+   free (cross);
+   free (pos);
+   free (active);
+   return ok;
+}
+
+/*! build index from forbidZones. return false on memory error (index then empty) */
+bool forbidIndexBuild (void) {
+   forbidIndexFree ();
+   int nEdges = 0;
+   for (int z = 0; z < par.nForbidZone; z++) nEdges += MAX (forbidZones [z].n, 0);
+   if (nEdges == 0) return true;
+   if ((fIndex.edges = malloc (nEdges * sizeof (ForbidEdge))) == NULL) goto error;
+   fIndex.latMin = fIndex.lonMin = DBL_MAX;
+   fIndex.latMax = fIndex.lonMax = -DBL_MAX;
+   for (int z = 0; z < par.nForbidZone; z++) {
+      const MyPolygon *po = &forbidZones [z];
+      for (int i = 0, j = po->n - 1; i < po->n; j = i++) {
+         ForbidEdge *e = &fIndex.edges [fIndex.nEdges++];
+         *e = (ForbidEdge) {po->points [j].lat, po->points [j].lon, po->points [i].lat, po->points [i].lon, po->zone};
+         fIndex.latMin = fmin (fIndex.latMin, po->points [i].lat);
+         fIndex.latMax = fmax (fIndex.latMax, po->points [i].lat);
+         fIndex.lonMin = fmin (fIndex.lonMin, po->points [i].lon);
+         fIndex.lonMax = fmax (fIndex.lonMax, po->points [i].lon);
+      }
+   }
+   const int g = CLAMP ((int) ceil (sqrt ((double) nEdges)), 1, FORBID_MAX_GRID);
+   fIndex.nRow = fIndex.nCol = g;
+   fIndex.dLat = fmax (fIndex.latMax - fIndex.latMin, 1e-9) / g;
+   fIndex.dLon = fmax (fIndex.lonMax - fIndex.lonMin, 1e-9) / g;
+   const int nCells = g * g;
+
+   // edges of each cell: counting then filling
+   int *cells = malloc ((2 * g + 2) * sizeof (int));
+   if (((fIndex.edgeStart = calloc (nCells + 1, sizeof (int))) == NULL) || (cells == NULL)) {
+      free (cells);
+      goto error;
+   }
+   int total = 0;
+   for (int e = 0; e < fIndex.nEdges; e++) {
+      const ForbidEdge *ed = &fIndex.edges [e];
+      const int n = gridCells (ed->lat0, ed->lon0, ed->lat1, ed->lon1, cells, 2 * g + 2);
+      for (int k = 0; k < n; k++) fIndex.edgeStart [cells [k] + 1] += 1;
+      total += n;
+   }
+   for (int k = 0; k < nCells; k++) fIndex.edgeStart [k + 1] += fIndex.edgeStart [k];
+   int *fill = calloc (nCells, sizeof (int));
+   if ((fill == NULL) || ((fIndex.cellEdges = malloc (MAX (total, 1) * sizeof (int))) == NULL)) {
+      free (cells);
+      free (fill);
+      goto error;
+   }
+   for (int e = 0; e < fIndex.nEdges; e++) {
+      const ForbidEdge *ed = &fIndex.edges [e];
+      const int n = gridCells (ed->lat0, ed->lon0, ed->lat1, ed->lon1, cells, 2 * g + 2);
+      for (int k = 0; k < n; k++) fIndex.cellEdges [fIndex.edgeStart [cells [k]] + fill [cells [k]]++] = e;
+   }
+   free (cells);
+   free (fill);
+   if (! buildInside ()) goto error;
+   return true;
+error:
+   fprintf (stderr, "In forbidIndexBuild, Error Malloc\n");
+   forbidIndexFree ();
+   return false;
+}
+
+/*! true if point is in a forbidden zone */
+bool forbidPointIn (double lat, double lon) {
+   if ((fIndex.nEdges == 0) || (lat < fIndex.latMin) || (lat > fIndex.latMax) || (lon < fIndex.lonMin) || (lon > fIndex.lonMax))
+      return false;
+   const int r = MIN ((int) ((lat - fIndex.latMin) / fIndex.dLat), fIndex.nRow - 1);
+   const int c = MIN ((int) ((lon - fIndex.lonMin) / fIndex.dLon), fIndex.nCol - 1);
+   const int cell = r * fIndex.nCol + c;
+   const double cLat = fIndex.latMin + (r + 0.5) * fIndex.dLat, cLon = fIndex.lonMin + (c + 0.5) * fIndex.dLon;
+   int zone [FORBID_MAX_TOGGLE];
+   bool in [FORBID_MAX_TOGGLE];
+   int n = 0;
+   for (int k = fIndex.insideStart [cell]; (k < fIndex.insideStart [cell + 1]) && (n < FORBID_MAX_TOGGLE); k++) {
+      zone [n] = fIndex.insideZones [k];
+      in [n++] = true;
+   }
+   // parity of each zone changes at each edge crossed from center to point
+   for (int k = fIndex.edgeStart [cell]; k < fIndex.edgeStart [cell + 1]; k++) {
+      const ForbidEdge *e = &fIndex.edges [fIndex.cellEdges [k]];
+      if (! edgeHit (e, cLat, cLon, lat, lon)) continue;
+      int j = 0;
+      while ((j < n) && (zone [j] != e->zone)) j++;
+      if (j == n) {
+         if (n == FORBID_MAX_TOGGLE) continue;
+         zone [n] = e->zone;
+         in [n++] = false;
+      }
+      in [j] = ! in [j];
+   }
+   for (int j = 0; j < n; j++) if (in [j]) return true;
+   return false;
+}
+
+/*! true if segment from (lat0, lon0) to (lat1, lon1), straight in lat lon, enters or crosses a forbidden zone */
+bool forbidSegmentCrosses (double lat0, double lon0, double lat1, double lon1) {
+   if ((fIndex.nEdges == 0)
+      || (fmax (lat0, lat1) < fIndex.latMin) || (fmin (lat0, lat1) > fIndex.latMax)
+      || (fmax (lon0, lon1) < fIndex.lonMin) || (fmin (lon0, lon1) > fIndex.lonMax))
+      return false;
+   if (forbidPointIn (lat0, lon0)) return true;
+   int cells [2 * FORBID_MAX_GRID + 2];
+   const int n = gridCells (lat0, lon0, lat1, lon1, cells, 2 * FORBID_MAX_GRID + 2);
+   for (int k = 0; k < n; k++) {
+      for (int j = fIndex.edgeStart [cells [k]]; j < fIndex.edgeStart [cells [k] + 1]; j++)
+         if (edgeHit (&fIndex.edges [fIndex.cellEdges [j]], lat0, lon0, lat1, lon1)) return true;
+   }
+   return false;
+}
@@ -0,0 +1,12 @@
+/*! forbid zones: par.nForbidZone rings, points of all rings contiguous */
+extern MyPolygon *forbidZones;
+
+extern bool   forbidPointAdd (double lat, double lon);
+extern bool   forbidRingClose (bool hole);
+extern int    forbidNPolygons (void);
+extern void   forbidZonesFree (void);
+extern bool   readGeoJson (const char *fileName);
+extern bool   forbidIndexBuild (void);
+extern void   forbidIndexFree (void);
+extern bool   forbidPointIn (double lat, double lon);
+extern bool   forbidSegmentCrosses (double lat0, double lon0, double lat1, double lon1);
@@ -1,14 +1,21 @@
+extern Zone    layerZone [];
+extern void    *tLayerData [];
+extern int     nGribLayers;
+
 extern double  zoneTimeDiff (const Zone *zone1, const Zone *zone0);
 extern void    findWindGrib (double lat, double lon, double t, double *u, double *v, double *gust, double *w, double *twd, double *tws );
+extern bool    findWindGribBatch (double t, int n, const double lat [], const double lon [], WindVal out []);
+extern bool    resampleCurrentOnWind (void);
+extern bool    compositeBuild (void);
 extern double  findRainGrib (double lat, double lon, double t);
 extern double  findPressureGrib (double lat, double lon, double t);
 extern void    findCurrentGrib (double lat, double lon, double t, double *uCurr, double *vCurr, double *tcd, double *tcs);
 extern char    *gribToStr (const Zone *zone, char *str, size_t maxLen);
-extern void    printGrib (const Zone *zone, const FlowP *gribData);
+extern void    printGrib (const Zone *zone, const void *gribData);
 extern bool    checkGribInfoToStr (int type, Zone *zone, char *buffer, size_t maxLen);
 extern bool    checkGribToStr (bool hasCurrentGrib, char *buffer, size_t maxLen);
 extern char    *gribToStrJson (const char *fileName, char *out, size_t maxLen);
-extern float   *buildUVGWarray(const Zone *zone, const char *initialOfNames, const FlowP *gribData, size_t *outNValues);
+extern float   *buildUVGWarray(const Zone *zone, const char *initialOfNames, const void *gribData, size_t *outNValues);
 extern bool    uvPresentGrib (const Zone *zone);
 extern bool    isPresentGrib (const Zone *zone, const char *name);
 
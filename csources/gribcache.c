@@ -0,0 +1,496 @@
+/*! Cache of decoded grib files.
+   Key is file name + file version (GribFileKey) + load box and max step of par.
+   Value is Zone + wind or current data (N_FLOW_PLANES float planes, or int16 planes
+   with scale and offset per plane if par.gribQuantize).
+   tGribData [WIND], tGribData [CURRENT] and layers of composite wind (tLayerData) point to
+   cache entries: switching between already decoded models is a pointer swap. Least recently used entries not in use
+   are evicted when memory exceeds par.gribCacheMb.
+   If par.gribSidecar, decoded data is also written next to grib file in a sidecar file
+   (header, Zone, planes) that later loads with mmap without any decoding.
+   compilation: gcc -c gribcache.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "glibwrapper.h"
+#include "r3types.h"
+#include "r3util.h"
+#include "readgriball.h"
+#include "grib.h"
+#include "gribcache.h"
+#include "inline.h"
+
+#define SIDECAR_MAGIC    "R3CGRIB"     // 8 bytes with '\0'
+#define SIDECAR_VERSION  5
+#define SIDECAR_ALIGN    4096          // data offset alignment in sidecar file
+
+/*! version of a grib file. Whole second mtime and size are not enough: a file replaced in the same second,
+   or with its mtime kept (wget -N, rsync -t), often has the same size. It still gets another inode
+   if replaced by rename, another ctime if rewritten in place */
+typedef struct {
+   int64_t  mtimeSec, mtimeNsec;
+   int64_t  ctimeSec, ctimeNsec;
+   int64_t  size;
+   uint64_t ino;
+} GribFileKey;
+
+/*! sidecar file header. Followed by Zone, then planes at dataOffset */
+typedef struct {
+   char     magic [8];
+   uint32_t version;
+   uint32_t sizeofZone;
+   uint32_t nPlanes;                      // N_FLOW_PLANES
+   uint32_t valueSize;                    // size of one value in data: float or int16
+   GribFileKey src;                       // version of grib file decoded
+   uint64_t nValues;                      // number of values in data
+   uint64_t dataOffset;
+   GribLoadKey load;                      // data is restricted to this load key
+} SidecarHeader;
+
+/*! one decoded grib file */
+typedef struct {
+   char fileName [MAX_SIZE_FILE_NAME];
+   GribFileKey src;
+   GribLoadKey load;
+   Zone zone;
+   void *data;
+   size_t nBytes;
+   void *mapBase;                         // not NULL if data is mapped from sidecar file
+   size_t mapLen;
+   unsigned long lastUse;                 // value of gribCacheTick at last use. 0 if stale
+} GribCacheEntry;
+
+static GribCacheEntry gribCache [MAX_N_GRIB_CACHE];
+static int nGribCache = 0;
+static unsigned long gribCacheTick = 0;
+static const void *gribPinned = NULL;     // wind data protected from eviction while a layer is loaded
+
+/*! version of file described by st */
+static GribFileKey gribFileKey (const struct stat *st) {
+   const GribFileKey k = {
+      .mtimeSec = st->st_mtim.tv_sec, .mtimeNsec = st->st_mtim.tv_nsec,
+      .ctimeSec = st->st_ctim.tv_sec, .ctimeNsec = st->st_ctim.tv_nsec,
+      .size = st->st_size, .ino = st->st_ino
+   };
+   return k;
+}
+
+/*! true if same file version */
+static inline bool sameFileKey (const GribFileKey *a, const GribFileKey *b) {
+   return memcmp (a, b, sizeof *a) == 0;
+}
+
+/*! number of values filled by readGribAll */
+static size_t gribNValues (const Zone *zone) {
+   return N_FLOW_PLANES * zone->nTimeStamp * zone->nbLat * zone->nbLon;
+}
+
+/*! memory used by data of zone, consistent with readGribAll allocation */
+static size_t gribDataBytes (const Zone *zone) {
+   return flowValueSize (zone) * gribNValues (zone);
+}
+
+/*! replace float planes of *data by int16 planes. Per plane, offset is middle of range
+   and scale maps range on [-32767, 32767]. zone gets quantized, qScale and qOffset.
+   return false if no memory, data unchanged */
+static bool quantizeData (Zone *zone, void **data) {
+   const size_t len = flowPlaneLen (zone);
+   int16_t *q = malloc (N_FLOW_PLANES * len * sizeof (int16_t));
+   if (q == NULL) {
+      fprintf (stderr, "In quantizeData, Error Memory allocation\n");
+      return false;
+   }
+   for (int iVar = 0; iVar < N_FLOW_PLANES; iVar++) {
+      const float *src = flowPlane (*data, zone, iVar);
+      int16_t *dst = q + iVar * len;
+      float vMin = INFINITY, vMax = -INFINITY;
+      for (size_t i = 0; i < len; i++) {
+         if (! isfinite (src [i])) continue;
+         vMin = fminf (vMin, src [i]);
+         vMax = fmaxf (vMax, src [i]);
+      }
+      if (vMin > vMax) vMin = vMax = 0;      // no finite value
+      const float offset = (vMin + vMax) / 2;
+      const float scale = (vMax > vMin) ? (vMax - vMin) / (2 * INT16_MAX) : 1.0f;
+      for (size_t i = 0; i < len; i++) {
+         const float r = isfinite (src [i]) ? roundf ((src [i] - offset) / scale) : 0;
+         dst [i] = (int16_t) CLAMP (r, -INT16_MAX, INT16_MAX);
+      }
+      zone->qScale [iVar] = scale;
+      zone->qOffset [iVar] = offset;
+   }
+   free (*data);
+   *data = q;
+   zone->quantized = true;
+   return true;
+}
+
+/*! true if data is currently used as wind, current or layer of composite wind */
+static bool inUse (const void *data) {
+   if (data == NULL) return false;
+   if ((data == tGribData [WIND]) || (data == tGribData [CURRENT]) || (data == gribPinned)) return true;
+   for (int i = 0; i < nGribLayers; i++)
+      if (data == tLayerData [i]) return true;
+   return false;
+}
+
+/*! true if data belongs to a cache entry */
+static bool inCache (const void *data) {
+   for (int i = 0; i < nGribCache; i++)
+      if (gribCache [i].data == data) return true;
+   return false;
+}
+
+/*! total memory of cache */
+static size_t gribCacheBytes (void) {
+   size_t total = 0;
+   for (int i = 0; i < nGribCache; i++) total += gribCache [i].nBytes;
+   return total;
+}
+
+/*! release data of entry e */
+static void gribCacheRelease (GribCacheEntry *e) {
+   if (e->mapBase != NULL) munmap (e->mapBase, e->mapLen);
+   else free (e->data);
+   e->data = NULL;
+   e->mapBase = NULL;
+}
+
+/*! remove entry i and free its data */
+static void gribCacheRemove (int i) {
+   printf ("Grib evicted  : %s\n", gribCache [i].fileName);
+   gribCacheRelease (&gribCache [i]);
+   gribCache [i] = gribCache [nGribCache - 1];
+   nGribCache -= 1;
+}
+
+/*! evict stale entries, then least recently used entries not in use until memory
+   fits in budget and nFree slots are available */
+static void gribCacheEvict (int nFree) {
+   const size_t budget = (size_t) MAX (par.gribCacheMb, 0) * MILLION;
+   for (int i = nGribCache - 1; i >= 0; i--)
+      if ((gribCache [i].lastUse == 0) && ! inUse (gribCache [i].data)) gribCacheRemove (i);
+
+   while ((gribCacheBytes () > budget) || (nGribCache + nFree > MAX_N_GRIB_CACHE)) {
+      int lru = -1;
+      for (int i = 0; i < nGribCache; i++) {
+         if (inUse (gribCache [i].data)) continue;
+         if ((lru < 0) || (gribCache [i].lastUse < gribCache [lru].lastUse)) lru = i;
+      }
+      if (lru < 0) return;                // all entries in use
+      gribCacheRemove (lru);
+   }
+}
+
+/*! write all bytes, return false on error */
+static bool writeAll (int fd, const void *buf, size_t len) {
+   const char *p = buf;
+   while (len > 0) {
+      const ssize_t n = write (fd, p, len);
+      if (n <= 0) return false;
+      p += n;
+      len -= (size_t) n;
+   }
+   return true;
+}
+
+/*! write sidecar file of grib fileName of version src with zone and data decoded with load.
+   Written in temporary file of unique name (mkstemp) then renamed, so readers never see a partial file
+   and threads writing the same sidecar do not share a temporary file */
+static bool sidecarWrite (const char *fileName, const GribFileKey *src, const GribLoadKey *load, const Zone *zone, const void *data) {
+   char sideName [MAX_SIZE_FILE_NAME + 8], tmpName [MAX_SIZE_FILE_NAME + 32];
+   static const char zero [SIDECAR_ALIGN];
+   SidecarHeader h;
+   memset (&h, 0, sizeof h);
+   memcpy (h.magic, SIDECAR_MAGIC, sizeof h.magic);
+   h.version = SIDECAR_VERSION;
+   h.sizeofZone = sizeof (Zone);
+   h.nPlanes = N_FLOW_PLANES;
+   h.valueSize = flowValueSize (zone);
+   h.src = *src;
+   h.nValues = gribNValues (zone);
+   h.dataOffset = ((sizeof h + sizeof (Zone) + SIDECAR_ALIGN - 1) / SIDECAR_ALIGN) * SIDECAR_ALIGN;
+   h.load = *load;
+
+   snprintf (sideName, sizeof sideName, "%s%s", fileName, SIDECAR_SUFFIX);
+   snprintf (tmpName, sizeof tmpName, "%s.XXXXXX", sideName);
+   const int fd = mkstemp (tmpName);
+   if ((fd < 0) || (fchmod (fd, 0644) != 0)) {
+      if (fd >= 0) {
+         close (fd);
+         unlink (tmpName);
+      }
+      fprintf (stderr, "In sidecarWrite, Error cannot create: %s\n", tmpName);
+      return false;
+   }
+   const bool ok = writeAll (fd, &h, sizeof h) 
+      && writeAll (fd, zone, sizeof (Zone))
+      && writeAll (fd, zero, h.dataOffset - sizeof h - sizeof (Zone))
+      && writeAll (fd, data, h.nValues * h.valueSize);
+   if ((close (fd) != 0) || ! ok || (rename (tmpName, sideName) != 0)) {
+      fprintf (stderr, "In sidecarWrite, Error writing: %s\n", sideName);
+      unlink (tmpName);
+      return false;
+   }
+   printf ("Grib sidecar  : %s written\n", sideName);
+   return true;
+}
+
+/*! map sidecar file of grib fileName of version src into entry e.
+   return false if no sidecar or sidecar does not match grib file version, load key or binary layout */
+static bool sidecarMap (const char *fileName, const GribFileKey *src, GribCacheEntry *e) {
+   char sideName [MAX_SIZE_FILE_NAME + 8];
+   SidecarHeader h;
+   struct stat sideSt;
+   snprintf (sideName, sizeof sideName, "%s%s", fileName, SIDECAR_SUFFIX);
+   const int fd = open (sideName, O_RDONLY);
+   if (fd < 0) return false;
+   if ((fstat (fd, &sideSt) != 0) || (pread (fd, &h, sizeof h, 0) != (ssize_t) sizeof h)
+      || (memcmp (h.magic, SIDECAR_MAGIC, sizeof h.magic) != 0)
+      || (h.version != SIDECAR_VERSION) || (h.sizeofZone != sizeof (Zone)) || (h.nPlanes != N_FLOW_PLANES)
+      || ! sameFileKey (&h.src, src)
+      || (memcmp (&h.load, &e->load, sizeof h.load) != 0)
+      || ((uint64_t) sideSt.st_size != h.dataOffset + h.nValues * h.valueSize)) {
+      close (fd);
+      return false;
+   }
+   void *base = mmap (NULL, sideSt.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   close (fd);
+   if (base == MAP_FAILED) {
+      fprintf (stderr, "In sidecarMap, Error mmap: %s\n", sideName);
+      return false;
+   }
+   memcpy (&e->zone, (char *) base + sizeof h, sizeof (Zone));
+   if ((gribNValues (&e->zone) != h.nValues) || (flowValueSize (&e->zone) != h.valueSize)) {
+      munmap (base, sideSt.st_size);
+      return false;
+   }
+   e->data = (char *) base + h.dataOffset;
+   e->mapBase = base;
+   e->mapLen = sideSt.st_size;
+   e->nBytes = sideSt.st_size;
+   printf ("Grib sidecar  : %s mapped\n", sideName);
+   return true;
+}
+
+/*! add decoded data of grib fileName of version src to cache. return false if cache full */
+static bool gribCacheInsert (const char *fileName, const GribFileKey *src, const GribLoadKey *load, const Zone *zone, void *data) {
+   if (nGribCache >= MAX_N_GRIB_CACHE) {
+      fprintf (stderr, "In gribCacheInsert, Error cache full, %s not cached\n", fileName);
+      return false;
+   }
+   GribCacheEntry *e = &gribCache [nGribCache];
+   memset (e, 0, sizeof *e);
+   strlcpy (e->fileName, fileName, sizeof e->fileName);
+   e->src = *src;
+   e->load = *load;
+   e->zone = *zone;
+   e->data = data;
+   e->nBytes = gribDataBytes (zone);
+   e->lastUse = gribCacheTick;
+   nGribCache += 1;
+   return true;
+}
+
+/*! Make fileName the current grib for iFlow (WIND or CURRENT).
+   Decode it with readGribAll only if not already in cache with same file version and load key.
+   On failure, previous zone and tGribData [iFlow] are kept.
+   return false if file cannot be read */
+bool gribCacheLoad (const char *fileName, Zone *zone, int iFlow) {
+   struct stat st;
+   if ((iFlow == WIND && par.constWindTws > 0) || (iFlow == CURRENT && par.constCurrentS > 0)) // constant wind or current
+      return readGribAll (fileName, zone, iFlow);
+
+   if (stat (fileName, &st) != 0) {
+      fprintf (stderr, "In gribCacheLoad, Error cannot stat: %s\n", fileName);
+      return false;
+   }
+   const GribFileKey src = gribFileKey (&st);
+   const GribDecode dec = gribDecodeOfPar ();
+   const GribLoadKey load = dec.load;
+   gribCacheTick += 1;
+   for (int i = 0; i < nGribCache; i++) {
+      if (strcmp (gribCache [i].fileName, fileName) != 0) continue;
+      if (sameFileKey (&gribCache [i].src, &src)
+         && (memcmp (&gribCache [i].load, &load, sizeof load) == 0)) {
+         gribCache [i].lastUse = gribCacheTick;
+         *zone = gribCache [i].zone;
+         tGribData [iFlow] = gribCache [i].data;
+         return true;
+      }
+      gribCache [i].lastUse = 0;          // file rewritten or load key changed: first candidate for eviction
+   }
+
+   Zone newZone;
+   void *old = tGribData [iFlow];
+   gribCacheEvict (1);
+   if (dec.sidecar && (nGribCache < MAX_N_GRIB_CACHE)) {
+      GribCacheEntry *e = &gribCache [nGribCache];
+      memset (e, 0, sizeof *e);
+      e->load = load;
+      if (sidecarMap (fileName, &src, e)) {
+         strlcpy (e->fileName, fileName, sizeof e->fileName);
+         e->src = src;
+         e->lastUse = gribCacheTick;
+         nGribCache += 1;
+         *zone = e->zone;
+         tGribData [iFlow] = e->data;
+         if ((old != NULL) && ! inCache (old) && ! inUse (old)) free (old);
+         gribCacheEvict (0);
+         return true;
+      }
+   }
+   tGribData [iFlow] = NULL;              // readGribAllTo must not free old data
+   if (! readGribAllTo (fileName, &newZone, iFlow, &tGribData [iFlow], &dec)) {
+      free (tGribData [iFlow]);
+      tGribData [iFlow] = old;
+      return false;
+   }
+   if (load.quantize) quantizeData (&newZone, &tGribData [iFlow]);
+   gribCacheInsert (fileName, &src, &load, &newZone, tGribData [iFlow]);
+   if (dec.sidecar) sidecarWrite (fileName, &src, &load, &newZone, tGribData [iFlow]);
+
+   *zone = newZone;
+   if ((old != NULL) && ! inCache (old) && ! inUse (old)) free (old);
+   gribCacheEvict (0);
+   return true;
+}
+
+/*! Make fileName the layer of composite wind described by *layerZone and *layerData,
+   like gribCacheLoad does for wind, without changing wind. return false if file cannot be read */
+static bool gribCacheLoadLayer (const char *fileName, Zone *layerZone, void **layerData) {
+   void *wind = tGribData [WIND];
+   gribPinned = wind;
+   tGribData [WIND] = *layerData;        // previous layer is replaced as wind would be
+   const bool ok = gribCacheLoad (fileName, layerZone, WIND);
+   *layerData = tGribData [WIND];
+   tGribData [WIND] = wind;
+   gribPinned = NULL;
+   return ok;
+}
+
+/*! load layers of composite wind listed in par (GRIB_LAYER) then build composite index.
+   To call after wind load. return true if composite wind active */
+bool gribLayersLoad (void) {
+   int n = 0;
+   for (int i = 0; i < par.nGribLayers; i++) {
+      if (gribCacheLoadLayer (par.gribLayerFileName [i], &layerZone [n], &tLayerData [n])) {
+         printf ("Grib layer    : %s\n", par.gribLayerFileName [i]);
+         n += 1;
+      }
+      else fprintf (stderr, "In gribLayersLoad, Error Unable to read grib layer: %s\n", par.gribLayerFileName [i]);
+   }
+   for (int i = n; i < nGribLayers; i++) {   // layers no longer used
+      if (! inCache (tLayerData [i])) free (tLayerData [i]);
+      tLayerData [i] = NULL;
+   }
+   nGribLayers = n;
+   return compositeBuild ();
+}
+
+/*! grib file decoded out of cache, ready to be adopted by gribCacheAdopt */
+struct GribPrepared {
+   char fileName [MAX_SIZE_FILE_NAME];
+   GribFileKey src;
+   GribLoadKey load;
+   Zone zone;
+   void *data;
+};
+
+/*! decode grib fileName for iFlow (WIND or CURRENT) with settings dec, without using cache,
+   tGribData, zone or par. Quantized and written to sidecar as gribCacheLoad does.
+   Meant for a background thread. return NULL on failure */
+GribPrepared *gribCachePrepare (const char *fileName, int iFlow, const GribDecode *dec) {
+   GribPrepared *p = calloc (1, sizeof *p);
+   if (p == NULL) {
+      fprintf (stderr, "In gribCachePrepare, Error Memory allocation\n");
+      return NULL;
+   }
+   struct stat st;
+   strlcpy (p->fileName, fileName, sizeof p->fileName);
+   p->load = dec->load;
+   if ((stat (fileName, &st) != 0) || ! readGribAllTo (fileName, &p->zone, iFlow, &p->data, dec)
+      || (p->data == NULL)) {                 // no data for constant wind or current
+      fprintf (stderr, "In gribCachePrepare, Error cannot decode: %s\n", fileName);
+      gribPreparedFree (p);
+      return NULL;
+   }
+   p->src = gribFileKey (&st);
+   if (p->load.quantize) quantizeData (&p->zone, &p->data);
+   if (dec->sidecar) sidecarWrite (fileName, &p->src, &p->load, &p->zone, p->data);
+   return p;
+}
+
+/*! free grib prepared and not adopted */
+void gribPreparedFree (GribPrepared *p) {
+   if (p == NULL) return;
+   free (p->data);
+   free (p);
+}
+
+/*! take grib prepared by gribCachePrepare into cache. Older entries of same file become first
+   candidates for eviction. Data in use (wind, current) is not changed: next gribCacheLoad
+   of this file is a pointer swap. p is freed */
+void gribCacheAdopt (GribPrepared *p) {
+   struct stat st;
+   if (p == NULL) return;
+   if (stat (p->fileName, &st) != 0) {
+      gribPreparedFree (p);
+      return;
+   }
+   const GribFileKey src = gribFileKey (&st);
+   if (! sameFileKey (&src, &p->src)) {
+      gribPreparedFree (p);                  // file changed again since decoding
+      return;
+   }
+   const GribLoadKey load = gribDecodeOfPar ().load;
+   if (memcmp (&load, &p->load, sizeof load) != 0) {
+      gribPreparedFree (p);                  // parameters changed since decoding
+      return;
+   }
+   gribCacheTick += 1;
+   for (int i = 0; i < nGribCache; i++) {
+      if (strcmp (gribCache [i].fileName, p->fileName) != 0) continue;
+      if (sameFileKey (&gribCache [i].src, &src) && (memcmp (&gribCache [i].load, &load, sizeof load) == 0)) {
+         gribPreparedFree (p);               // already there
+         return;
+      }
+      gribCache [i].lastUse = 0;
+   }
+   gribCacheEvict (1);
+   if (gribCacheInsert (p->fileName, &src, &load, &p->zone, p->data)) {
+      printf ("Grib adopted  : %s\n", p->fileName);
+      free (p);
+   }
+   else gribPreparedFree (p);
+   gribCacheEvict (0);
+}
+
+/*! number of entries and memory used by cache */
+void gribCacheInfo (int *nEntries, size_t *nBytes) {
+   *nEntries = nGribCache;
+   *nBytes = gribCacheBytes ();
+}
+
+/*! free all cached grib data and current grib data */
+void gribCacheFree (void) {
+   for (int iFlow = WIND; iFlow <= CURRENT; iFlow++) {
+      if (! inCache (tGribData [iFlow])) free (tGribData [iFlow]);
+      tGribData [iFlow] = NULL;
+   }
+   for (int i = 0; i < nGribLayers; i++) {
+      if (! inCache (tLayerData [i])) free (tLayerData [i]);
+      tLayerData [i] = NULL;
+   }
+   nGribLayers = 0;
+   compositeBuild ();
+   for (int i = 0; i < nGribCache; i++) gribCacheRelease (&gribCache [i]);
+   nGribCache = 0;
+}
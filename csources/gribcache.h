@@ -0,0 +1,9 @@
+extern bool   gribCacheLoad (const char *fileName, Zone *zone, int iFlow);
+typedef struct GribPrepared GribPrepared;
+
+extern bool   gribLayersLoad (void);
+extern GribPrepared *gribCachePrepare (const char *fileName, int iFlow, const GribDecode *dec);
+extern void   gribPreparedFree (GribPrepared *p);
+extern void   gribCacheAdopt (GribPrepared *p);
+extern void   gribCacheInfo (int *nEntries, size_t *nBytes);
+extern void   gribCacheFree (void);
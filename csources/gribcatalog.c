@@ -0,0 +1,245 @@
+/*! In memory catalog of directories (grib, currentgrib, ...) and of grib metadata.
+   A directory is scanned (readdir, stat) once. Then on Linux each query reads pending inotify
+   events of the directory (non blocking) and only files named in events are stated again.
+   Elsewhere the directory is scanned again only when its modification time changes.
+   Zone metadata of grib files (readGribLists, readGribParameters) is parsed on first request
+   and kept while file size and modification time are unchanged.
+   Used by mostRecentFile, listDirToStrJson and gribToStrJson.
+   compilation: gcc -c gribcatalog.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "glibwrapper.h"
+#include "r3types.h"
+#include "r3util.h"
+#include "readgriball.h"
+#include "gribcatalog.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#define CATALOG_EVENTS  (IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB \
+                        | IN_DELETE_SELF | IN_MOVE_SELF)
+#endif
+
+/*! one directory of catalog */
+typedef struct {
+   char path [MAX_SIZE_FILE_NAME];
+   CatalogFile *files;
+   size_t n;
+   size_t cap;
+   time_t dirMtime;                     // modification time of directory at last scan
+   time_t scanTime;                     // time of last scan
+   int inotifyFd;                       // -1 if no inotify
+   unsigned long lastUse;
+} CatalogDir;
+
+static CatalogDir catalog [MAX_N_CATALOG_DIR];
+static int nCatalog = 0;
+static unsigned long catalogTick = 0;
+
+/*! index of file name in d, -1 if absent */
+static long catalogFind (const CatalogDir *d, const char *name) {
+   for (size_t i = 0; i < d->n; i++)
+      if (strcmp (d->files [i].name, name) == 0) return (long) i;
+   return -1;
+}
+
+/*! remove file i of d */
+static void catalogRemove (CatalogDir *d, size_t i) {
+   free (d->files [i].zone);
+   d->files [i] = d->files [d->n - 1];
+   d->n -= 1;
+}
+
+/*! add or update file name of d according to st. Zone metadata dropped if file changed */
+static bool catalogUpsert (CatalogDir *d, const char *name, const struct stat *st) {
+   long i = catalogFind (d, name);
+   if (i < 0) {
+      if (d->n >= d->cap) {
+         const size_t newCap = d->cap ? 2 * d->cap : 64;
+         CatalogFile *tmp = realloc (d->files, newCap * sizeof (CatalogFile));
+         if (tmp == NULL) {
+            fprintf (stderr, "In catalogUpsert, Error Memory allocation: %s\n", d->path);
+            return false;
+         }
+         d->files = tmp;
+         d->cap = newCap;
+      }
+      i = (long) d->n;
+      d->n += 1;
+      memset (&d->files [i], 0, sizeof (CatalogFile));
+      strlcpy (d->files [i].name, name, sizeof d->files [i].name);
+   }
+   CatalogFile *f = &d->files [i];
+   if ((f->mtime != st->st_mtime) || (f->size != st->st_size)) {
+      free (f->zone);
+      f->zone = NULL;
+   }
+   f->mtime = st->st_mtime;
+   f->size = st->st_size;
+   return true;
+}
+
+/*! stat file name of d and update catalog accordingly: only regular files are kept */
+static void catalogUpdateFile (CatalogDir *d, const char *name) {
+   char filePath [MAX_SIZE_FILE_NAME * 2];
+   struct stat st;
+   snprintf (filePath, sizeof filePath, "%s/%s", d->path, name);
+   if ((stat (filePath, &st) == 0) && S_ISREG (st.st_mode)) catalogUpsert (d, name, &st);
+   else {
+      const long i = catalogFind (d, name);
+      if (i >= 0) catalogRemove (d, (size_t) i);
+   }
+}
+
+/*! full scan of directory d. Zone metadata of unchanged files is kept. return false if directory cannot be read */
+static bool catalogScan (CatalogDir *d) {
+   struct stat dirSt;
+   DIR *dir = opendir (d->path);
+   if (dir == NULL) return false;
+   if (fstat (dirfd (dir), &dirSt) == 0) d->dirMtime = dirSt.st_mtime;
+   d->scanTime = time (NULL);
+   for (size_t i = 0; i < d->n; i++) d->files [i].seen = false;
+   struct dirent *ent;
+   while ((ent = readdir (dir)) != NULL) {
+      if ((strcmp (ent->d_name, ".") == 0) || (strcmp (ent->d_name, "..") == 0)) continue;
+      catalogUpdateFile (d, ent->d_name);
+      const long i = catalogFind (d, ent->d_name);
+      if (i >= 0) d->files [i].seen = true;
+   }
+   closedir (dir);
+   for (size_t i = d->n; i-- > 0; )                // files gone
+      if (! d->files [i].seen) catalogRemove (d, i);
+   return true;
+}
+
+/*! release directory d */
+static void catalogRelease (CatalogDir *d) {
+   for (size_t i = 0; i < d->n; i++) free (d->files [i].zone);
+   free (d->files);
+   if (d->inotifyFd >= 0) close (d->inotifyFd);
+   memset (d, 0, sizeof *d);
+   d->inotifyFd = -1;
+}
+
+/*! bring d up to date with pending changes. return false if directory cannot be read */
+static bool catalogRefresh (CatalogDir *d) {
+#ifdef __linux__
+   if (d->inotifyFd >= 0) {
+      char buf [8192] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+      ssize_t len;
+      bool rescan = false;
+      while ((len = read (d->inotifyFd, buf, sizeof buf)) > 0) {
+         const struct inotify_event *ev;
+         for (const char *ptr = buf; ptr < buf + len; ptr += sizeof (struct inotify_event) + ev->len) {
+            ev = (const struct inotify_event *) ptr;
+            if (ev->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) rescan = true;
+            else if (ev->len > 0) catalogUpdateFile (d, ev->name);
+         }
+      }
+      return rescan ? catalogScan (d) : true;
+   }
+#endif
+   struct stat dirSt;
+   if (stat (d->path, &dirSt) != 0) return false;
+   // directory changed, or changed in same second as scan: time resolution does not allow to tell
+   if ((dirSt.st_mtime == d->dirMtime) && (d->dirMtime < d->scanTime)) return true;
+   return catalogScan (d);
+}
+
+/*! catalog of directory path0, up to date. NULL if directory cannot be read */
+static CatalogDir *catalogDir (const char *path0) {
+   char path [MAX_SIZE_FILE_NAME];
+   strlcpy (path, path0, sizeof path);
+   size_t len = strlen (path);
+   while ((len > 1) && (path [len - 1] == '/')) path [--len] = '\0';   // same entry with or without final slash
+   catalogTick += 1;
+   for (int i = 0; i < nCatalog; i++) {
+      if (strcmp (catalog [i].path, path) != 0) continue;
+      catalog [i].lastUse = catalogTick;
+      if (catalogRefresh (&catalog [i])) return &catalog [i];
+      catalogRelease (&catalog [i]);       // directory removed
+      catalog [i] = catalog [nCatalog - 1];
+      nCatalog -= 1;
+      return NULL;
+   }
+   int k = nCatalog;
+   if (nCatalog >= MAX_N_CATALOG_DIR) {     // least recently used directory replaced
+      k = 0;
+      for (int i = 1; i < nCatalog; i++)
+         if (catalog [i].lastUse < catalog [k].lastUse) k = i;
+      catalogRelease (&catalog [k]);
+   }
+   else nCatalog += 1;
+   CatalogDir *d = &catalog [k];
+   memset (d, 0, sizeof *d);
+   strlcpy (d->path, path, sizeof d->path);
+   d->lastUse = catalogTick;
+   d->inotifyFd = -1;
+#ifdef __linux__
+   // watch installed before scan so that no change is lost
+   if ((d->inotifyFd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC)) >= 0
+      && inotify_add_watch (d->inotifyFd, path, CATALOG_EVENTS) < 0) {
+      close (d->inotifyFd);
+      d->inotifyFd = -1;
+   }
+#endif
+   if (! catalogScan (d)) {
+      catalogRelease (d);
+      catalog [k] = catalog [nCatalog - 1];
+      nCatalog -= 1;
+      return NULL;
+   }
+   return d;
+}
+
+/*! regular files of directory path, up to date. *files valid until next catalog call.
+   return false if directory cannot be read */
+bool catalogFiles (const char *path, const CatalogFile **files, size_t *n) {
+   CatalogDir *d = catalogDir (path);
+   *files = NULL;
+   *n = 0;
+   if (d == NULL) return false;
+   *files = d->files;
+   *n = d->n;
+   return true;
+}
+
+/*! Zone metadata of grib fileName (full path) from catalog, parsed if needed.
+   *file receives catalog entry. return NULL if file absent or unreadable */
+const Zone *catalogGribZone (const char *fileName, const CatalogFile **file) {
+   char path [MAX_SIZE_FILE_NAME];
+   const char *slash = strrchr (fileName, '/');
+   *file = NULL;
+   if ((slash == NULL) || (slash == fileName)) return NULL;
+   snprintf (path, sizeof path, "%.*s", (int) (slash - fileName), fileName);
+   CatalogDir *d = catalogDir (path);
+   if (d == NULL) return NULL;
+   const long i = catalogFind (d, slash + 1);
+   if (i < 0) return NULL;
+   CatalogFile *f = &d->files [i];
+   *file = f;
+   if (f->zone != NULL) return f->zone;
+   if ((f->zone = malloc (sizeof (Zone))) == NULL) {
+      fprintf (stderr, "In catalogGribZone, Error Memory allocation\n");
+      return NULL;
+   }
+   if (! readGribLists (fileName, f->zone) || ! readGribParameters (fileName, f->zone)) {
+      free (f->zone);
+      f->zone = NULL;
+      return NULL;
+   }
+   return f->zone;
+}
+
+/*! free catalog */
+void catalogFree (void) {
+   for (int i = 0; i < nCatalog; i++) catalogRelease (&catalog [i]);
+   nCatalog = 0;
+}
@@ -0,0 +1,12 @@
+/*! file of catalog */
+typedef struct {
+   char   name [MAX_SIZE_FILE_NAME];
+   long long size;
+   time_t mtime;
+   bool   seen;                          // found during last scan
+   Zone   *zone;                         // grib metadata, NULL if not parsed yet
+} CatalogFile;
+
+extern bool   catalogFiles (const char *path, const CatalogFile **files, size_t *n);
+extern const  Zone *catalogGribZone (const char *fileName, const CatalogFile **file);
+extern void   catalogFree (void);
@@ -0,0 +1,183 @@
+/*! Background reload of grib files for server.
+   A thread watches grib and currentgrib directories of par.workingDir with inotify.
+   Each new or rewritten grib file is decoded by this thread (gribCachePrepare) then published
+   in a slot with an atomic pointer exchange. Server main thread takes published gribs between
+   requests (gribWatchAdopt): a routing in progress keeps the data it started with, and the next
+   request naming the new file gets it from cache without decoding.
+   Directories and decoding settings are copied from par by gribWatchStart: the thread never reads par,
+   that main thread may read again (REQ_INIT). Restart the watcher to take new parameters.
+   gribWatchStop does not wait: it makes the watcher stale (generation counter). A stale watcher ends
+   after the decode in progress, its result dropped, and frees its own state.
+   Linux only (inotify). Elsewhere gribWatchStart does nothing.
+   compilation: gcc -c gribwatch.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "glibwrapper.h"
+#include "r3types.h"
+#include "r3util.h"
+#include "gribcache.h"
+#include "gribwatch.h"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+
+#define GRIB_WATCH_SLOTS     8                // max decoded gribs waiting for adoption
+#define GRIB_WATCH_POLL_MS   1000             // period of stop flag check
+
+/*! state of one watcher, owned by its thread */
+typedef struct {
+   unsigned gen;                              // generation of watcher, stale when no longer watchGen
+   int inotifyFd;
+   int wdWind, wdCurrent;
+   char windDir [MAX_SIZE_FILE_NAME], currentDir [MAX_SIZE_FILE_NAME];
+   GribDecode dec;                            // snapshot of par when watcher started
+} Watch;
+
+static _Atomic (GribPrepared *) ready [GRIB_WATCH_SLOTS];
+static atomic_uint watchGen;                  // generation of running watcher
+static bool watchRunning = false;
+
+/*! true if watcher w has been stopped */
+static inline bool watchStale (const Watch *w) {
+   return atomic_load (&watchGen) != w->gen;
+}
+
+/*! publish p in a free slot. Wait while all slots are busy. p dropped if watcher w is stale,
+   also when it became stale just after publishing (gribWatchStop may have drained slots before) */
+static void watchPublish (const Watch *w, GribPrepared *p) {
+   while (! watchStale (w)) {
+      for (int i = 0; i < GRIB_WATCH_SLOTS; i++) {
+         GribPrepared *expected = NULL;
+         if (! atomic_compare_exchange_strong (&ready [i], &expected, p)) continue;
+         expected = p;
+         if (watchStale (w) && atomic_compare_exchange_strong (&ready [i], &expected, NULL))
+            gribPreparedFree (p);
+         return;
+      }
+      usleep (100000);
+   }
+   gribPreparedFree (p);
+}
+
+/*! decode grib file name of directory watched by wd, then publish it */
+static void watchDecode (const Watch *w, int wd, const char *name) {
+   char fileName [MAX_SIZE_FILE_NAME];
+   const bool isWind = (wd == w->wdWind);
+   // same name as the one built from client request by buildRootName, so that cache finds it
+   const int n = snprintf (fileName, sizeof fileName, "%s/%s", isWind ? w->windDir : w->currentDir, name);
+   if ((n < 0) || ((size_t) n >= sizeof fileName)) return;
+   printf ("Grib watch    : %s decoding\n", fileName);
+   const double start = monotonic ();
+   GribPrepared *p = gribCachePrepare (fileName, isWind ? WIND : CURRENT, &w->dec);
+   if (p == NULL) return;
+   printf ("Grib watch    : %s decoded in %.2lf seconds\n", fileName, monotonic () - start);
+   watchPublish (w, p);
+}
+
+/*! thread: wait for files closed after writing or moved into watched directories.
+   Ends when stale, then frees watcher arg */
+static void *watchLoop (void *arg) {
+   Watch *w = arg;
+   char buf [8192] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+   struct pollfd pfd = {.fd = w->inotifyFd, .events = POLLIN};
+   while (! watchStale (w)) {
+      if (poll (&pfd, 1, GRIB_WATCH_POLL_MS) <= 0) continue;
+      const ssize_t len = read (w->inotifyFd, buf, sizeof buf);
+      if (len <= 0) continue;
+      const struct inotify_event *ev;
+      for (const char *ptr = buf; (ptr < buf + len) && ! watchStale (w); ptr += sizeof (struct inotify_event) + ev->len) {
+         ev = (const struct inotify_event *) ptr;
+         if ((ev->len == 0) || (ev->mask & IN_ISDIR)) continue;
+         if ((strstr (ev->name, ".gr") == NULL) || (strstr (ev->name, SIDECAR_SUFFIX) != NULL)) continue;
+         watchDecode (w, ev->wd, ev->name);
+      }
+   }
+   close (w->inotifyFd);
+   free (w);
+   return NULL;
+}
+
+/*! start watching grib and currentgrib directories of par.workingDir, decoding with settings of par.
+   return false on error */
+bool gribWatchStart (void) {
+   pthread_t thread;
+   if (watchRunning) return true;
+   Watch *w = calloc (1, sizeof *w);
+   if (w == NULL) {
+      fprintf (stderr, "In gribWatchStart, Error Memory allocation\n");
+      return false;
+   }
+   if ((w->inotifyFd = inotify_init1 (IN_CLOEXEC)) < 0) {
+      fprintf (stderr, "In gribWatchStart, Error inotify_init1\n");
+      free (w);
+      return false;
+   }
+   w->gen = atomic_load (&watchGen);
+   w->dec = gribDecodeOfPar ();
+   w->wdWind = w->wdCurrent = -1;
+   if (buildRootName ("grib", w->windDir, sizeof w->windDir) != NULL)
+      w->wdWind = inotify_add_watch (w->inotifyFd, w->windDir, IN_CLOSE_WRITE | IN_MOVED_TO);
+   if (buildRootName ("currentgrib", w->currentDir, sizeof w->currentDir) != NULL)
+      w->wdCurrent = inotify_add_watch (w->inotifyFd, w->currentDir, IN_CLOSE_WRITE | IN_MOVED_TO);
+   if ((w->wdWind < 0) && (w->wdCurrent < 0)) {
+      fprintf (stderr, "In gribWatchStart, Error no grib directory to watch in: %s\n", par.workingDir);
+      close (w->inotifyFd);
+      free (w);
+      return false;
+   }
+   if (pthread_create (&thread, NULL, watchLoop, w) != 0) {
+      fprintf (stderr, "In gribWatchStart, Error pthread_create\n");
+      close (w->inotifyFd);
+      free (w);
+      return false;
+   }
+   pthread_detach (thread);
+   watchRunning = true;
+   printf ("Grib watch    : started\n");
+   return true;
+}
+
+/*! take into grib cache all gribs decoded by watcher. To call by main thread, between requests.
+   return number of gribs adopted */
+int gribWatchAdopt (void) {
+   int n = 0;
+   for (int i = 0; i < GRIB_WATCH_SLOTS; i++) {
+      GribPrepared *p = atomic_exchange (&ready [i], NULL);
+      if (p != NULL) {
+         gribCacheAdopt (p);
+         n += 1;
+      }
+   }
+   return n;
+}
+
+/*! stop watcher without waiting for decode in progress, and free gribs not adopted */
+void gribWatchStop (void) {
+   if (! watchRunning) return;
+   atomic_fetch_add (&watchGen, 1);
+   for (int i = 0; i < GRIB_WATCH_SLOTS; i++)
+      gribPreparedFree (atomic_exchange (&ready [i], NULL));
+   watchRunning = false;
+}
+
+#else
+
+bool gribWatchStart (void) {
+   fprintf (stderr, "In gribWatchStart, Error grib watch requires Linux inotify\n");
+   return false;
+}
+
+int gribWatchAdopt (void) {
+   return 0;
+}
+
+void gribWatchStop (void) {
+}
+
+#endif
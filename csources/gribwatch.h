@@ -0,0 +1,3 @@
+extern bool   gribWatchStart (void);
+extern int    gribWatchAdopt (void);
+extern void   gribWatchStop (void);
@@ -3,26 +3,136 @@
 
 #include <math.h>
 #include <time.h>
+#include <stdint.h>
+#include <string.h>
+
+extern CoastTiles coastTiles;         // defined in coast.c
+extern uint8_t *tCoastDist;           // defined in coast.c
+
+/*! value of cell i of bit packed isSea table: 1 if sea */
+static inline bool isSeaBit (const uint8_t *isSeaArray, int i) {
+   return (isSeaArray [i >> 3] >> (i & 7)) & 1;
+}
+
+/*! true if isSea cell i is coastal, i.e. has a high resolution tile */
+static inline bool isCoastal (int i) {
+   return (coastTiles.mixed != NULL) && isSeaBit (coastTiles.mixed, i);
+}
+
+/*! high resolution tile of coastal isSea cell i. Rank of i in coastal bitset (little endian words) */
+static inline const uint8_t *coastTile (int i) {
+   uint64_t word;
+   memcpy (&word, coastTiles.mixed + ((i >> 6) << 3), sizeof word);
+   const uint32_t k = coastTiles.rank [i >> 6] + __builtin_popcountll (word & ((UINT64_C (1) << (i & 63)) - 1));
+   return coastTiles.tiles + (size_t) k * COAST_TILE_BYTES;
+}
+
+/*! value of high resolution cell (fRow, fCol) of isSea grid: COAST_SUB cells per isSea cell, fRow 0 at North pole.
+   tile bit if isSea cell is coastal, isSea bit otherwise */
+static inline bool isSeaFine (const uint8_t *isSeaArray, int fRow, int fCol) {
+   const int i = (fRow / COAST_SUB) * IS_SEA_N_LON + fCol / COAST_SUB;
+   if (! isCoastal (i)) return isSeaBit (isSeaArray, i);
+   return isSeaBit (coastTile (i), (fRow % COAST_SUB) * COAST_SUB + fCol % COAST_SUB);
+}
 
 /*! say if point is in sea */
-static inline bool isSea (char * isSeaArray, double lat, double lon) {
+static inline bool isSea (const uint8_t *isSeaArray, double lat, double lon) {
    if (isSeaArray == NULL) return true;
    int iLon = round (lon * 10  + 1800);
    int iLat = round (-lat * 10  + 900);
-   return isSeaArray [(iLat * 3601) + iLon];
+   const int i = (iLat * IS_SEA_N_LON) + iLon;
+   if (isCoastal (i))
+      return isSeaFine (isSeaArray, floor ((-lat * 10 + 900.5) * COAST_SUB), floor ((lon * 10 + 1800.5) * COAST_SUB));
+   return isSeaBit (isSeaArray, i);
 }
 
 /*! say if point is in sea */
-static inline bool isSeaTolerant (char * isSeaArray, double lat, double lon) {
+static inline bool isSeaTolerant (const uint8_t *isSeaArray, double lat, double lon) {
    if (isSeaArray == NULL) return true;
    int iLonInf = floor (lon * 10  + 1800);
    int iLonSup = ceil (lon * 10  + 1800);
    int iLatInf = floor (-lat * 10  + 900);
    int iLatSup = ceil (-lat * 10  + 900);
-   return isSeaArray [(iLatInf * 3601) + iLonInf]
-       || isSeaArray [(iLatInf * 3601) + iLonSup]
-       || isSeaArray [(iLatSup * 3601) + iLonInf]
-       || isSeaArray [(iLatSup * 3601) + iLonSup];
+   if (isCoastal ((iLatInf * IS_SEA_N_LON) + iLonInf) || isCoastal ((iLatInf * IS_SEA_N_LON) + iLonSup)
+      || isCoastal ((iLatSup * IS_SEA_N_LON) + iLonInf) || isCoastal ((iLatSup * IS_SEA_N_LON) + iLonSup)) {
+      // same tolerance at high resolution: four cells around point
+      const int fRow = floor ((-lat * 10 + 900.5) * COAST_SUB - 0.5);
+      const int fCol = floor ((lon * 10 + 1800.5) * COAST_SUB - 0.5);
+      return isSeaFine (isSeaArray, fRow, fCol) || isSeaFine (isSeaArray, fRow, fCol + 1)
+          || isSeaFine (isSeaArray, fRow + 1, fCol) || isSeaFine (isSeaArray, fRow + 1, fCol + 1);
+   }
+   return isSeaBit (isSeaArray, (iLatInf * IS_SEA_N_LON) + iLonInf)
+       || isSeaBit (isSeaArray, (iLatInf * IS_SEA_N_LON) + iLonSup)
+       || isSeaBit (isSeaArray, (iLatSup * IS_SEA_N_LON) + iLonInf)
+       || isSeaBit (isSeaArray, (iLatSup * IS_SEA_N_LON) + iLonSup);
+}
+
+/*! Amanatides-Woo traversal of cells crossed by segment P(t) = (x + t dx, y + t dy), t in [ta, tb].
+   x: isSea column, y: isSea row, in isSea cell units. scale 1: isSea grid, each coastal cell is walked again
+   at high resolution; scale COAST_SUB: high resolution grid. Cells of end (high resolution col, row of both
+   extremities) are not tested if end not NULL. return false at first land cell (early exit) */
+static inline bool gridSegmentSea (const uint8_t *isSeaArray, double x, double y, double dx, double dy,
+                            double ta, double tb, int scale, const int *end) {
+   const double sx = x * scale, sy = y * scale, sdx = dx * scale, sdy = dy * scale;
+   const int nCol = IS_SEA_N_LON * scale, nRow = IS_SEA_N_LAT * scale;
+   int cx = floor (sx + ta * sdx), cy = floor (sy + ta * sdy);
+   const int stepX = (sdx > 0) ? 1 : -1, stepY = (sdy > 0) ? 1 : -1;
+   const double tDeltaX = (sdx != 0) ? fabs (1.0 / sdx) : INFINITY;
+   const double tDeltaY = (sdy != 0) ? fabs (1.0 / sdy) : INFINITY;
+   double tMaxX = (sdx != 0) ? (cx + (stepX > 0) - sx) / sdx : INFINITY;
+   double tMaxY = (sdy != 0) ? (cy + (stepY > 0) - sy) / sdy : INFINITY;
+   double t = ta;
+   while (true) {
+      const double tNext = fmin (fmin (tMaxX, tMaxY), tb);
+      const int col = CLAMP (cx, 0, nCol - 1), row = CLAMP (cy, 0, nRow - 1);
+      if (scale == 1) {
+         const int i = row * IS_SEA_N_LON + col;
+         if (isCoastal (i)) {
+            if (! gridSegmentSea (isSeaArray, x, y, dx, dy, t, tNext, COAST_SUB, end)) return false;
+         }
+         else if (! isSeaBit (isSeaArray, i)
+            && ! (end && (((end [0] / COAST_SUB == col) && (end [1] / COAST_SUB == row))
+                       || ((end [2] / COAST_SUB == col) && (end [3] / COAST_SUB == row)))))
+            return false;
+      }
+      else if (! isSeaFine (isSeaArray, row, col)
+         && ! (end && (((end [0] == col) && (end [1] == row)) || ((end [2] == col) && (end [3] == row)))))
+         return false;
+      if (tNext >= tb) return true;
+      t = tNext;
+      if (tMaxX < tMaxY) {
+         cx += stepX;
+         tMaxX += tDeltaX;
+      }
+      else {
+         cy += stepY;
+         tMaxY += tDeltaY;
+      }
+   }
+}
+
+/*! true if segment from (lat0, lon0) to (lat1, lon1), straight in lat lon, crosses only sea cells,
+   at high resolution near coast. If tolerantEnds, cells of both extremities are not tested:
+   they are accepted or not by isSeaTolerant */
+static inline bool segmentSea (const uint8_t *isSeaArray, double lat0, double lon0, double lat1, double lon1, bool tolerantEnds) {
+   if (isSeaArray == NULL) return true;
+   const double x0 = lon0 * 10 + 1800.5, y0 = -lat0 * 10 + 900.5;
+   const double x1 = lon1 * 10 + 1800.5, y1 = -lat1 * 10 + 900.5;
+   const int end [4] = {floor (x0 * COAST_SUB), floor (y0 * COAST_SUB), floor (x1 * COAST_SUB), floor (y1 * COAST_SUB)};
+   return gridSegmentSea (isSeaArray, x0, y0, x1 - x0, y1 - y0, 0.0, 1.0, 1, tolerantEnds ? end : NULL);
+}
+
+/*! distance to coast of point in isSea cells (0.1 degree): 0 if land, coastal or unknown, capped to COAST_DIST_MAX */
+static inline int coastDist (double lat, double lon) {
+   const int col = floor (lon * 10 + 1800.5), row = floor (-lat * 10 + 900.5);
+   if ((tCoastDist == NULL) || (col < 0) || (col >= IS_SEA_N_LON) || (row < 0) || (row >= IS_SEA_N_LAT)) return 0;
+   return tCoastDist [row * IS_SEA_N_LON + col];
+}
+
+/*! true if segment from (lat0, lon0) to (lat1, lon1), straight in lat lon, is shorter than distance to coast of its start:
+   all cells crossed are open sea and no land test is needed. sqrt 2 margin for position of points in their cells */
+static inline bool segmentClear (double lat0, double lon0, double lat1, double lon1) {
+   return hypot ((lat1 - lat0) * 10, (lon1 - lon0) * 10) + M_SQRT2 < coastDist (lat0, lon0);
 }
 
 /*! return angle on [0, 360 ] interval */
@@ -45,6 +155,33 @@ static inline double lonNormalize (double lon, bool anteMeridian) {
    return lon;
 }
 
+/*! number of values in one plane of wind or current data */
+static inline size_t flowPlaneLen (const Zone *zone) {
+   return zone->nTimeStamp * zone->nbLat * zone->nbLon;
+}
+
+/*! size in bytes of one value of wind or current data */
+static inline size_t flowValueSize (const Zone *zone) {
+   return zone->quantized ? sizeof (int16_t) : sizeof (float);
+}
+
+/*! plane iVar (FLOW_U, FLOW_V, FLOW_G, FLOW_W) of float wind or current data (zone not quantized) */
+static inline float *flowPlane (const void *gribData, const Zone *zone, int iVar) {
+   return (float *) gribData + iVar * flowPlaneLen (zone);
+}
+
+/*! plane iVar of quantized wind or current data */
+static inline int16_t *flowPlaneQ (const void *gribData, const Zone *zone, int iVar) {
+   return (int16_t *) gribData + iVar * flowPlaneLen (zone);
+}
+
+/*! value iGrib of plane iVar of wind or current data, float or quantized */
+static inline float flowValue (const void *gribData, const Zone *zone, int iVar, size_t iGrib) {
+   if (zone->quantized)
+      return zone->qOffset [iVar] + zone->qScale [iVar] * flowPlaneQ (gribData, zone, iVar) [iGrib];
+   return flowPlane (gribData, zone, iVar) [iGrib];
+}
+
 /*! true if P (lat, lon) is within the zone */
 static inline bool isInZone (double lat, double lon, Zone *zone) {
    return (lat >= zone->latMin) && (lat <= zone->latMax) && (lon >= zone->lonLeft) && (lon <= zone->lonRight);
@@ -5,17 +5,121 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>  // uint64_t
+#include <sys/stat.h>
 #include "r3types.h"
 #include "grib.h"
 #include "readgriball.h"
+#include "gribcache.h"
 #include "r3util.h"
 #include "engine.h"
 #include "polar.h"
 #include "glibwrapper.h"
 #include "inline.h"
+#include "coast.h"
 
-/*! Manage command line option reduced to one character */
-void optionManage (char option) {
+/*! load wind grib, layers and current grib of par with GRIB_QUANTIZE quantize. return false on error */
+static bool optionGribLoad (int quantize) {
+   par.gribQuantize = quantize;
+   if (! gribCacheLoad (par.gribFileName, &zone, WIND)) return false;
+   if (par.nGribLayers > 0) gribLayersLoad ();
+   return (par.currentGribFileName [0] == '\0') || gribCacheLoad (par.currentGribFileName, &currentZone, CURRENT);
+}
+
+/*! routing of par request. return duration in hours, -1 if destination not reached. Compute time in *calcTime */
+static double optionRouteDuration (double *calcTime) {
+   routingLaunch ();
+   *calcTime = route.calculationTime;
+   return route.destinationReached ? route.duration : -1.0;
+}
+
+/*! constant wind zone z of 1 degree step from (latMin, lonLeft), lonRight as given (-180..180 or 0..360 convention),
+   2 time stamps, u east component in m/s. return float planes of z, NULL if error */
+static float *optionConstZone (Zone *z, double latMin, double lonLeft, double lonRight, long nbLat, long nbLon, float u) {
+   memset (z, 0, sizeof *z);
+   z->wellDefined = true;
+   z->latMin = latMin;
+   z->latMax = latMin + nbLat - 1;
+   z->lonLeft = lonLeft;
+   z->lonRight = lonRight;
+   z->anteMeridian = (lonLeft > 0.0) && (lonRight < 0.0);
+   z->latStep = z->lonStep = 1.0;
+   z->nbLat = nbLat;
+   z->nbLon = nbLon;
+   z->nTimeStamp = 2;
+   z->timeStamp [1] = 24;
+   z->nDataDate = z->nDataTime = 1;
+   z->dataDate [0] = 20250101;
+   float *data = calloc (N_FLOW_PLANES * flowPlaneLen (z), sizeof (float));
+   if (data != NULL)
+      for (size_t i = 0; i < flowPlaneLen (z); i++) data [i] = u;   // FLOW_U plane, others 0
+   return data;
+}
+
+/*! composite wind check with synthetic layer 170E..170W over global wind, layer stored with lonRight -170 then 190.
+   Wind u is 1 m/s, layer u is 5 m/s, blending band 2 degrees. return true if all points get expected u */
+static bool optionLayerCheck (void) {
+   const struct {double lat, lon, u;} pt [] = {
+      {0, 175, 5}, {0, -175, 5}, {0, 180, 5}, {0, 185, 5}, {0, 171, 3}, {0, -171, 3}, {4, -175, 3},
+      {0, 165, 1}, {0, -165, 1}, {-8, 175, 1}
+   };
+   const int nPt = sizeof pt / sizeof pt [0];
+   Zone *saved = malloc (2 * sizeof (Zone));
+   Zone *wind = calloc (1, sizeof (Zone));
+   float *windData = NULL;
+   bool ok = (saved != NULL) && (wind != NULL) && ((windData = optionConstZone (wind, -10, -180, 179, 21, 360, 1)) != NULL);
+   if (! ok) {
+      fprintf (stderr, "In optionLayerCheck, Error Memory allocation\n");
+      free (saved); free (wind); free (windData);
+      return false;
+   }
+   saved [0] = zone;
+   saved [1] = layerZone [0];
+   void *savedData [2] = {tGribData [WIND], tLayerData [0]};
+   const int savedN = nGribLayers;
+   const double savedBlend = par.gribLayerBlend, savedTws = par.constWindTws;
+   zone = *wind;
+   tGribData [WIND] = windData;
+   nGribLayers = 1;
+   par.gribLayerBlend = 2.0;
+   par.constWindTws = 0;
+
+   const double right [2] = {-170, 190};
+   for (int k = 0; k < 2; k += 1) {
+      float *layerData = optionConstZone (&layerZone [0], -5, 170, right [k], 11, 21, 5);
+      tLayerData [0] = layerData;
+      const bool built = (layerData != NULL) && compositeBuild ();
+      if (! built) {
+         fprintf (stderr, "In optionLayerCheck, Error composite build\n");
+         ok = false;
+      }
+      for (int i = 0; built && (i < nPt); i += 1) {
+         double u, v, g, w, twd, tws;
+         findWindGrib (pt [i].lat, pt [i].lon, 6.0, &u, &v, &g, &w, &twd, &tws);
+         const bool okPt = fabs (u - pt [i].u) < 1e-6;
+         if (! okPt) printf ("❌ lonRight %.0lf, lat %.1lf lon %.1lf: u %.4lf, expected %.4lf\n",
+            right [k], pt [i].lat, pt [i].lon, u, pt [i].u);
+         ok &= okPt;
+      }
+      free (layerData);
+   }
+
+   zone = saved [0];
+   layerZone [0] = saved [1];
+   tGribData [WIND] = savedData [0];
+   tLayerData [0] = savedData [1];
+   nGribLayers = savedN;
+   par.gribLayerBlend = savedBlend;
+   par.constWindTws = savedTws;
+   compositeBuild ();
+   free (windData);
+   free (wind);
+   free (saved);
+   printf ("%s layer: %d points, layer across antimeridian stored with lonRight -170 and 190\n", ok ? "✅" : "❌", nPt);
+   return ok;
+}
+
+/*! Manage command line option reduced to one character. return false if option is a check that failed */
+bool optionManage (char option) {
 	 FILE *f = NULL;
    char *buffer = NULL;
    char footer [MAX_SIZE_LINE] = "";
@@ -24,15 +128,31 @@ void optionManage (char option) {
    int sail, intRes, nTries;
    long dataDate;
    const long nIter = 1e9;
+   double duration [2], calcTime [2];
+   bool ok = true;
 
    if ((buffer = (char *) malloc (MAX_SIZE_BUFFER)) == NULL) {
       fprintf (stderr, "In optionManage, Error Malloc %d\n", MAX_SIZE_BUFFER); 
-      return;
+      return false;
    }
    buffer [0] = '\0'; 
    printf ("\n");
    
    switch (option) {
+   case 'b': // convert text isSea file to binary bit packed file
+      printf ("Text isSea file = ");
+      if (scanf ("%255s", str) < 1) break;
+      printf ("Binary isSea file = ");
+      if (scanf ("%255s", footer) < 1) break;
+      if (isSeaToBin (str, footer)) printf ("✅ %s written, set ISSEA:%s in parameter file\n", footer, footer);
+      break;
+   case 'C': // build high resolution coastal tiles from coast line polygons
+      printf ("Coast line file (lon lat, polygons separated by '>') = ");
+      if (scanf ("%255s", str) < 1) break;
+      printf ("Coastal tiles file = ");
+      if (scanf ("%255s", footer) < 1) break;
+      if (coastTilesBuild (str, footer)) printf ("✅ %s written, set COAST_TILES:%s in parameter file\n", footer, footer);
+      break;
    case 'c': // cap
       printf ("Lon1 = ");
       if (scanf ("%lf", &lon) < 1) break;
@@ -48,6 +168,41 @@ void optionManage (char option) {
       printf ("Orthodist1 : %.2lf,   Orthodist2: %.2lf\n", orthoDist2 (lat, lon, lat2, lon2), orthoDist (lat2, lon2, lat, lon));
       printf ("Loxodist1  : %.2lf,   Loxodist2 : %.2lf\n", loxoDist(lat, lon, lat2, lon2), loxoDist (lat2, lon2, lat, lon));
       break;
+   case 'd': { // grib decode benchmark (native reader with ccs0, ecCodes with ccs)
+      // decoded in local zone and buffer: zone and tGribData belong to grib cache (may be mmap of sidecar)
+      printf ("Grib file = ");
+      if (scanf ("%255s", str) < 1) break;
+      printf ("Iterations = ");
+      if (scanf ("%d", &nTries) < 1 || nTries < 1) break;
+      struct stat st;
+      if (stat (str, &st) != 0) {
+         fprintf (stderr, "In optionManage, Error decode: Impossible to stat: %s\n", str);
+         ok = false;
+         break;
+      }
+      Zone *dZone = calloc (1, sizeof (Zone));
+      void *dData = NULL;
+      const GribDecode dec = gribDecodeOfPar ();
+      if (dZone == NULL) {
+         fprintf (stderr, "In optionManage, Error decode: Memory allocation\n");
+         ok = false;
+         break;
+      }
+      const double t0 = monotonic ();
+      for (int i = 0; ok && (i < nTries); i += 1) {
+         if (! (ok = readGribAllTo (str, dZone, WIND, &dData, &dec)))
+            fprintf (stderr, "In optionManage, Error decode: readGribAllTo failed: %s\n", str);
+      }
+      if (ok) {
+         const double elapsed = (monotonic () - t0) / nTries;
+         printf ("Messages: %d, Size: %.2lf MB\n", dZone->nMessage, st.st_size / (double) MILLION);
+         printf ("✅ decode: %.3lf seconds, %.1lf MB/s, %.3lf ms/message\n",
+            elapsed, st.st_size / (double) MILLION / elapsed, 1000.0 * elapsed / MAX (dZone->nMessage, 1));
+      }
+      free (dData);
+      free (dZone);
+      break;
+   }
    case 'g': // grib
       gribToStr (&zone, buffer, MAX_SIZE_BUFFER);
       printf ("%s\n", buffer);
@@ -75,6 +230,9 @@ void optionManage (char option) {
       while ((fgets (str, MAX_SIZE_LINE, f) != NULL )) printf ("%s", str);
       fclose (f);
       break;
+   case 'L': // composite wind with synthetic layer across antimeridian: expected wind and blending at sample points
+      ok = optionLayerCheck ();
+      break;
    case 'p': // polar
       polToStr (&polMat, buffer, MAX_SIZE_BUFFER);
       printf ("%s\n", buffer);
@@ -127,6 +285,47 @@ void optionManage (char option) {
          printf ("newMaxSpeedInPolarAt: %.4lf\n", maxSpeedInPolarAt (tws, &polMat));
       }
       break;
+   case 'K': // routing full search then coarse to fine corridor (COARSE_FACTOR), duration and compute time compared
+      printf ("Coarse factor = ");
+      if ((scanf ("%d", &intRes) < 1) || (intRes < 2)) break;
+      const int coarseFactor = par.coarseFactor;
+      for (int k = 0; k < 2; k += 1) {
+         par.coarseFactor = k ? intRes : 0;
+         duration [k] = optionRouteDuration (&calcTime [k]);
+      }
+      par.coarseFactor = coarseFactor;
+      printf ("full search     : %.4lf hours, %.2lf seconds\n", duration [0], calcTime [0]);
+      printf ("corridor (x%d)   : %.4lf hours, %.2lf seconds\n", intRes, duration [1], calcTime [1]);
+      if ((duration [0] > 0) && (duration [1] > 0))
+         printf ("corridor: duration difference %+.3lf%%, speedup %.2lf\n",
+            100.0 * (duration [1] - duration [0]) / duration [0], calcTime [0] / MAX (calcTime [1], 1e-6));
+      else printf ("corridor: destination %s\n", (duration [0] > 0) ? "reached by full search only" :
+         (duration [1] > 0) ? "reached by corridor only" : "unreached");
+      break;
+   case 'Q': // routing with float then int16 (GRIB_QUANTIZE) grib storage. Duration difference must stay within bound
+      if (par.gribFileName [0] == '\0') {
+         fprintf (stderr, "In optionManage, Error quantize: no grib file\n");
+         ok = false;
+         break;
+      }
+      const int quantize = par.gribQuantize;
+      for (int q = 0; ok && (q < 2); q += 1) {
+         if (! (ok = optionGribLoad (q))) fprintf (stderr, "In optionManage, Error quantize: Unable to read grib\n");
+         else duration [q] = optionRouteDuration (&calcTime [q]);
+      }
+      optionGribLoad (quantize);
+      if (! ok) break;
+      printf ("float : %.4lf hours, %.2lf seconds\n", duration [0], calcTime [0]);
+      printf ("int16 : %.4lf hours, %.2lf seconds\n", duration [1], calcTime [1]);
+      if ((duration [0] <= 0) || (duration [1] <= 0)) {
+         ok = (duration [0] <= 0) && (duration [1] <= 0);
+         printf ("%s destination %s\n", ok ? "✅" : "❌", ok ? "unreached in both modes" : "reached in one mode only");
+         break;
+      }
+      const double diff = (duration [1] - duration [0]) / duration [0];
+      ok = fabs (diff) <= QUANTIZE_ROUTE_TOL;
+      printf ("%s quantize: duration difference %+.3lf%%, bound %.1lf%%\n", ok ? "✅" : "❌", 100.0 * diff, 100.0 * QUANTIZE_ROUTE_TOL);
+      break;
    case 'r': // routing
       routingLaunch ();
       routeToStr (&route, buffer, MAX_SIZE_BUFFER, footer, sizeof (footer));
@@ -155,7 +354,7 @@ void optionManage (char option) {
       }
       break;
    case 't': // test
-      readGribAll ("/home/rr/routing/grib/GFS_20251121_12Z_144.grb", &zone, WIND);
+      gribCacheLoad ("/home/rr/routing/grib/GFS_20251121_12Z_144.grb", &zone, WIND);
       printf ("GribTime: %s\n", gribDateTimeToStr (zone.dataDate[0], zone.dataTime[0], str, sizeof str));
       while (true) {
          printf ("Lat = ");
@@ -205,4 +404,5 @@ void optionManage (char option) {
       break;
    }
    free (buffer);
+   return ok;
 }
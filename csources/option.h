@@ -1 +1 @@
-extern void optionManage (char option);
+extern bool optionManage (char option);
@@ -0,0 +1,202 @@
+/*! Points of interest (ports of tides file, marks of marks file) loaded once in memory.
+   A file is read again only when its modification time or size changes: one stat per query.
+   Index: balanced implicit k-d tree on unit vectors of positions. Chord distance grows with orthodromic distance,
+   so that nearest and within radius queries are exact worldwide (antimeridian, poles) in O(log n).
+   Used by nearestPort and readMarkCSVToJson.
+   compilation: gcc -c poi.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <sys/stat.h>
+#include "glibwrapper.h"
+#include "r3types.h"
+#include "r3util.h"
+#include "inline.h"
+#include "poi.h"
+
+static PoiSet poiSets [POI_N_KIND];
+
+/*! release set s */
+static void poiSetRelease (PoiSet *s) {
+   free (s->t);
+   free (s->tree);
+   memset (s, 0, sizeof *s);
+}
+
+/*! unit vector of position of p */
+static void poiVector (Poi *p) {
+   const double lat = p->lat * DEG_TO_RAD, lon = p->lon * DEG_TO_RAD;
+   p->v [0] = cos (lat) * cos (lon);
+   p->v [1] = cos (lat) * sin (lon);
+   p->v [2] = sin (lat);
+}
+
+/*! parse line of tides file: lat, lon, name, id. return false if not a port */
+static bool poiPortParse (char *line, Poi *p) {
+   if (sscanf (line, "%lf,%lf,%63[^,],%d", &p->lat, &p->lon, p->name, &p->id) <= 2) return false;
+   g_strstrip (p->name);
+   p->lat1 = p->lat;
+   p->lon1 = p->lon;
+   return true;
+}
+
+/*! parse line of marks file: what; name; id; lat0-lon0; lat1-lon1; status */
+static bool poiMarkParse (char *line, Poi *p) {
+   char empty [] = "";
+   char *coord [2], *ptLon;
+   double *lat [2] = {&p->lat, &p->lat1}, *lon [2] = {&p->lon, &p->lon1};
+   char **t = g_strsplit (line, ";", -1);
+   if (t == NULL) return false;
+   const int n = (int) g_strv_length (t);
+   strlcpy (p->what, (n > 0) ? g_strstrip (t [0]) : empty, sizeof p->what);
+   strlcpy (p->name, (n > 1) ? g_strstrip (t [1]) : empty, sizeof p->name);
+   strlcpy (p->code, (n > 2) ? g_strstrip (t [2]) : empty, sizeof p->code);
+   coord [0] = (n > 3) ? g_strstrip (t [3]) : empty;
+   coord [1] = (n > 4) ? g_strstrip (t [4]) : empty;
+   strlcpy (p->status, (n > 5) ? g_strstrip (t [5]) : empty, sizeof p->status);
+   for (int k = 0; k < 2; k++) {
+      ptLon = strchr (coord [k], '-');
+      if (ptLon) *ptLon = '\0';                    // cut coord end eliminate '-'
+      *lat [k] = getCoord (coord [k], MIN_LAT, MAX_LAT);
+      *lon [k] = ptLon ? getCoord (ptLon + 1, MIN_LON, MAX_LON) : 0.0;
+   }
+   g_strfreev (t);
+   return true;
+}
+
+/*! arrange tree [lo, hi) as k-d tree: median on axis at (lo + hi) / 2 (quickselect), smaller before, greater after */
+static void poiTreeBuild (const Poi *t, int *tree, int lo, int hi, int axis) {
+   if (hi - lo <= 1) return;
+   const int mid = (lo + hi) / 2;
+   int a = lo, b = hi - 1;
+   while (a < b) {
+      const double pivot = t [tree [(a + b) / 2]].v [axis];
+      int i = a, j = b;
+      while (i <= j) {
+         while (t [tree [i]].v [axis] < pivot) i++;
+         while (t [tree [j]].v [axis] > pivot) j--;
+         if (i <= j) {
+            const int tmp = tree [i];
+            tree [i++] = tree [j];
+            tree [j--] = tmp;
+         }
+      }
+      if (mid <= j) b = j;
+      else if (mid >= i) a = i;
+      else break;
+   }
+   poiTreeBuild (t, tree, lo, mid, (axis + 1) % 3);
+   poiTreeBuild (t, tree, mid + 1, hi, (axis + 1) % 3);
+}
+
+/*! read file of kind in s. return false if file cannot be read or memory error */
+static bool poiLoad (PoiSet *s, int kind, const char *fileName) {
+   char line [MAX_SIZE_TEXT_FILE];
+   FILE *f;
+   int cap = 0;
+   if ((f = fopen (fileName, "r")) == NULL) {
+      fprintf (stderr, "In poiLoad, Error cannot open: %s\n", fileName);
+      return false;
+   }
+   while (fgets (line, sizeof line, f) != NULL) {
+      Poi p = {0};
+      if (! ((kind == POI_PORT) ? poiPortParse (line, &p) : poiMarkParse (line, &p))) continue;
+      poiVector (&p);
+      if (s->n >= cap) {
+         cap = cap ? 2 * cap : 256;
+         Poi *tmp = realloc (s->t, cap * sizeof (Poi));
+         if (tmp == NULL) {
+            fprintf (stderr, "In poiLoad, Error Memory allocation: %s\n", fileName);
+            fclose (f);
+            return false;
+         }
+         s->t = tmp;
+      }
+      s->t [s->n++] = p;
+   }
+   fclose (f);
+   if ((s->tree = malloc (MAX (s->n, 1) * sizeof (int))) == NULL) {
+      fprintf (stderr, "In poiLoad, Error Memory allocation: %s\n", fileName);
+      return false;
+   }
+   for (int i = 0; i < s->n; i++) s->tree [i] = i;
+   poiTreeBuild (s->t, s->tree, 0, s->n, 0);
+   return true;
+}
+
+/*! points of interest of kind (POI_PORT, POI_MARK) in fileName, read again if file changed. NULL if unreadable */
+const PoiSet *poiSet (int kind, const char *fileName) {
+   struct stat st;
+   if ((kind < 0) || (kind >= POI_N_KIND)) return NULL;
+   PoiSet *s = &poiSets [kind];
+   if (stat (fileName, &st) != 0) {
+      fprintf (stderr, "In poiSet, Error cannot stat: %s\n", fileName);
+      poiSetRelease (s);
+      return NULL;
+   }
+   if ((s->tree != NULL) && (strcmp (s->fileName, fileName) == 0) && (s->mtime == st.st_mtime) && (s->size == st.st_size))
+      return s;
+   poiSetRelease (s);
+   if (! poiLoad (s, kind, fileName)) {
+      poiSetRelease (s);
+      return NULL;
+   }
+   strlcpy (s->fileName, fileName, sizeof s->fileName);
+   s->mtime = st.st_mtime;
+   s->size = st.st_size;
+   return s;
+}
+
+/*! state of k-d tree search: best results sorted by squared chord */
+typedef struct {
+   const PoiSet *s;
+   double q [3];
+   double maxD2;
+   int nMax, n;
+   int *res;
+   double *d2;
+} PoiQuery;
+
+static void poiSearch (PoiQuery *pq, int lo, int hi, int axis) {
+   if (lo >= hi) return;
+   const int mid = (lo + hi) / 2;
+   const Poi *p = &pq->s->t [pq->s->tree [mid]];
+   const double dx = pq->q [0] - p->v [0], dy = pq->q [1] - p->v [1], dz = pq->q [2] - p->v [2];
+   const double d2 = dx * dx + dy * dy + dz * dz;
+   if (d2 <= ((pq->n == pq->nMax) ? pq->d2 [pq->n - 1] : pq->maxD2)) {  // insertion in sorted results
+      int k = (pq->n == pq->nMax) ? pq->n - 1 : pq->n++;
+      for (; (k > 0) && (pq->d2 [k - 1] > d2); k--) {
+         pq->d2 [k] = pq->d2 [k - 1];
+         pq->res [k] = pq->res [k - 1];
+      }
+      pq->d2 [k] = d2;
+      pq->res [k] = pq->s->tree [mid];
+   }
+   const double diff = pq->q [axis] - p->v [axis];
+   const int next = (axis + 1) % 3;
+   poiSearch (pq, (diff < 0) ? lo : mid + 1, (diff < 0) ? mid : hi, next);           // side of query first
+   if (diff * diff <= ((pq->n == pq->nMax) ? pq->d2 [pq->n - 1] : pq->maxD2))
+      poiSearch (pq, (diff < 0) ? mid + 1 : lo, (diff < 0) ? hi : mid, next);
+}
+
+/*! at most nMax points of s nearest to (lat, lon), within maxDist nautical miles if maxDist >= 0.
+   res: indexes in s->t, dist: orthodromic distances in nautical miles, both sorted by distance. return number found */
+int poiNearest (const PoiSet *s, double lat, double lon, int nMax, double maxDist, int *res, double *dist) {
+   if ((s == NULL) || (nMax <= 0)) return 0;
+   const double angle = (maxDist < 0) ? G_PI : fmin (maxDist / 60.0 * DEG_TO_RAD, G_PI);
+   const double chord = 2 * sin (angle / 2);
+   PoiQuery pq = {s, {0}, chord * chord * (1 + 1e-12), nMax, 0, res, dist};   // dist holds squared chords during search
+   Poi q = {.lat = lat, .lon = lon};
+   poiVector (&q);
+   memcpy (pq.q, q.v, sizeof pq.q);
+   poiSearch (&pq, 0, s->n, 0);
+   for (int k = 0; k < pq.n; k++) dist [k] = orthoDist (lat, lon, s->t [res [k]].lat, s->t [res [k]].lon);
+   return pq.n;
+}
+
+/*! free all points of interest */
+void poiFree (void) {
+   for (int k = 0; k < POI_N_KIND; k++) poiSetRelease (&poiSets [k]);
+}
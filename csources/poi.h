@@ -0,0 +1,3 @@
+extern const PoiSet *poiSet (int kind, const char *fileName);
+extern int    poiNearest (const PoiSet *s, double lat, double lon, int nMax, double maxDist, int *res, double *dist);
+extern void   poiFree (void);
@@ -11,6 +11,11 @@
 #include "r3util.h"
 #include "inline.h"
 #include "readgriball.h"
+#include "gribcatalog.h"
+
+Zone  layerZone [MAX_N_GRIB_LAYERS];       // composite wind: zones of layers over wind grib, decreasing priority
+void  *tLayerData [MAX_N_GRIB_LAYERS];     // composite wind: data of layers
+int   nGribLayers = 0;                     // number of layers loaded
 
 #define  EPSILON 0.001                 // for approximat value
 
@@ -29,8 +34,8 @@ double zoneTimeDiff (const Zone *zone1, const Zone *zone0) {
    values = [u1, v0, g0, w0,  u1, v1, g1, w1,  ...]
    g, w are optionnal
 */
-float *buildUVGWarray(const Zone *zone, const char *initialOfNames, const FlowP *gribData, size_t *outNValues) {
-   size_t nPoints = zone->nTimeStamp * zone->nbLat * zone->nbLon;
+float *buildUVGWarray(const Zone *zone, const char *initialOfNames, const void *gribData, size_t *outNValues) {
+   size_t nPoints = flowPlaneLen (zone);
    *outNValues = 0;
    if (! strchr(initialOfNames, 'u') || ! strchr(initialOfNames, 'v')) { // u, v should be present
       return NULL; 
@@ -47,25 +52,19 @@ float *buildUVGWarray(const Zone *zone, const char *initialOfNames, const FlowP
    if (!arr) return NULL;
    
    size_t idx = 0;
-   long iGrib;
 
-   for (size_t k = 0; k < zone->nTimeStamp; k++) {
-      for (long i = 0; i < zone->nbLat; i++) {
-         for (long j = 0; j < zone->nbLon; j++) {
-            iGrib = (k * zone->nbLat * zone->nbLon) + (i * zone->nbLon) + j;
-            arr[idx++] = gribData[iGrib].u;           // u allways sent
-            arr[idx++] = gribData[iGrib].v;           // v allways sent
-            if (hasG) arr[idx++] = gribData[iGrib].g; // g is an option
-            if (hasW) arr[idx++] = gribData[iGrib].w; // w is an option
-         }
-      }
+   for (size_t iGrib = 0; iGrib < nPoints; iGrib++) {
+      arr[idx++] = flowValue (gribData, zone, FLOW_U, iGrib);           // u allways sent
+      arr[idx++] = flowValue (gribData, zone, FLOW_V, iGrib);           // v allways sent
+      if (hasG) arr[idx++] = flowValue (gribData, zone, FLOW_G, iGrib); // g is an option
+      if (hasW) arr[idx++] = flowValue (gribData, zone, FLOW_W, iGrib); // w is an option
    }
    *outNValues = idx;
    return arr;
 }
 
 /*! print Grib u v ... for all lat lon time information */
-void printGrib (const Zone *zone, const FlowP *gribData) {
+void printGrib (const Zone *zone, const void *gribData) {
    long iGrib;
    printf ("printGribAll\n");
    for (size_t  k = 0; k < zone->nTimeStamp; k++) {
@@ -75,13 +74,15 @@ void printGrib (const Zone *zone, const FlowP *gribData) {
       for (int i = 0; i < zone->nbLat; i++) {
          for (int j = 0; j < zone->nbLon; j++) {
 	         iGrib = (k * zone->nbLat * zone->nbLon) + (i * zone->nbLon) + j;
+            double lon = zone->lonLeft + j * zone->lonStep;
+            if (! zone->anteMeridian) lon = norm180 (lon);
             printf (" %6.2f %6.2f %6.2f %6.2f %6.2f %6.2f\n", \
-               gribData [iGrib].lon, \
-	             gribData [iGrib].lat, \
-               gribData [iGrib].u, \
-               gribData [iGrib].v, \
-               gribData [iGrib].g, \
-               gribData [iGrib].w);
+               lon, \
+	             zone->latMin + i * zone->latStep, \
+               flowValue (gribData, zone, FLOW_U, iGrib), \
+               flowValue (gribData, zone, FLOW_V, iGrib), \
+               flowValue (gribData, zone, FLOW_G, iGrib), \
+               flowValue (gribData, zone, FLOW_W, iGrib));
          }
       }
       printf ("\n");
@@ -93,26 +94,25 @@ static bool checkGrib (const Zone *zone, int iFlow, CheckGrib *check) {
    const int maxUV = 100;
    const int maxW = 20;
    memset (check, 0, sizeof (CheckGrib));
-   for (size_t iGrib = 0; iGrib < zone->nTimeStamp * zone->nbLat * zone->nbLon; iGrib += 1) {
-      if ((fabs(tGribData [iFlow] [iGrib].u - MISSING) < EPSILON)) check->uMissing += 1;
-      else if (fabs (tGribData [iFlow] [iGrib].u) > maxUV) check->uStrange += 1;
+   for (size_t iGrib = 0; iGrib < flowPlaneLen (zone); iGrib += 1) {
+      const float u = flowValue (tGribData [iFlow], zone, FLOW_U, iGrib);
+      const float v = flowValue (tGribData [iFlow], zone, FLOW_V, iGrib);
+      const float g = flowValue (tGribData [iFlow], zone, FLOW_G, iGrib);
+      const float w = flowValue (tGribData [iFlow], zone, FLOW_W, iGrib);
+      if ((fabs(u - MISSING) < EPSILON)) check->uMissing += 1;
+      else if (fabs (u) > maxUV) check->uStrange += 1;
    
-      if (fabs(tGribData [iFlow] [iGrib].v - MISSING) < EPSILON) check->vMissing += 1;
-      else if (fabs (tGribData [iFlow] [iGrib].v) > maxUV) check->vStrange += 1;
-
-      if (fabs(tGribData [iFlow] [iGrib].w - MISSING) < EPSILON) check->wMissing += 1;
-      else if ((tGribData [iFlow] [iGrib].w > maxW) ||  (tGribData [iFlow] [iGrib].w < 0)) check->wStrange += 1;
+      if (fabs(v - MISSING) < EPSILON) check->vMissing += 1;
+      else if (fabs (v) > maxUV) check->vStrange += 1;
 
-      if (fabs (tGribData [iFlow] [iGrib].g - MISSING) < EPSILON) check->gMissing += 1;
-      else if ((tGribData [iFlow] [iGrib].g > maxUV) || (tGribData [iFlow] [iGrib].g < 0)) check->gStrange += 1;
+      if (fabs(w - MISSING) < EPSILON) check->wMissing += 1;
+      else if ((w > maxW) ||  (w < 0)) check->wStrange += 1;
 
-      if ((tGribData [iFlow] [iGrib].lat > zone->latMax) || (tGribData [iFlow] [iGrib].lat < zone->latMin) ||
-         (tGribData [iFlow] [iGrib].lon > zone->lonRight) || (tGribData [iFlow] [iGrib].lon < zone->lonLeft))
-		   check->outZone += 1;
+      if (fabs (g - MISSING) < EPSILON) check->gMissing += 1;
+      else if ((g > maxUV) || (g < 0)) check->gStrange += 1;
    }
    return (check->uMissing == 0) && (check->vMissing == 0) && (check->gMissing == 0) /* && (check->wMissing == 0)*/ && 
-          (check->uStrange == 0) && (check->vStrange == 0) && (check->gStrange == 0) && (check->wStrange == 0) && 
-          (check->outZone == 0);
+          (check->uStrange == 0) && (check->vStrange == 0) && (check->gStrange == 0) && (check->wStrange == 0);
 }
 
 /*! true if (wind) zone and currentZone intersect in geography */
@@ -172,42 +172,11 @@ bool isPresentGrib (const Zone *zone, const char *name) {
    return false;
 }
 
-/*! check lat, lon are consistent with indice 
-	return number of values */
-static int consistentGrib (const Zone *zone, int iFlow, double epsilon, int *nLatSuspects, int *nLonSuspects) {
-   int n = 0;
-   long iGrib;
-   double lat, lon;
-   *nLatSuspects = 0;
-   *nLonSuspects = 0;
-   for (size_t k = 0; k < zone->nTimeStamp; k++) {
-      for (int i = 0; i < zone->nbLat; i++) {
-         for (int j = 0; j < zone->nbLon; j++) {
-            n += 1;
-	          iGrib = (k * zone->nbLat * zone->nbLon) + (i * zone->nbLon) + j;
-            lat = zone->latMin + i * zone->latStep;  
-            lon = zone->lonLeft + j * zone->lonStep;
-            if (! zone->anteMeridian) 
-               lon = norm180 (lon);
-            if (fabs (lat - tGribData [iFlow][iGrib].lat) > epsilon) {
-               *nLatSuspects += 1;
-            }
-            if (fabs (lon - tGribData [iFlow][iGrib].lon) > epsilon) {
-               *nLonSuspects += 1;
-            }
-         }
-      }
-   }
-   return n;
-}
-
 /*! check Grib information and write (add) report in the buffer
     return false if something wrong  */
 bool checkGribInfoToStr (int type, Zone *zone, char *buffer, size_t maxLen) {
-   const double windEpsilon = 0.01;
-   const double currentEpsilon = 0.1;
    CheckGrib sCheck;
-   int nVal = 0, nLatSuspects, nLonSuspects;
+   int nVal = 0;
    bool OK = true;
    char str [MAX_SIZE_LINE] = "";
    const char *separator = "----------------------------------------------------------------------------------"; 
@@ -253,14 +222,7 @@ bool checkGribInfoToStr (int type, Zone *zone, char *buffer, size_t maxLen) {
       strlcat (buffer, str, maxLen);
    }
 
-   nVal = consistentGrib (zone, type, (type == WIND) ? windEpsilon : currentEpsilon, &nLatSuspects, &nLonSuspects);
-   if ((nLatSuspects > 0) || (nLonSuspects > 0)) {
-	   OK = false;
-      snprintf (str, MAX_SIZE_LINE, "n Val suspect Lat: %d, ratio: %.2lf %% \n", nLatSuspects, 100 * (double)nLatSuspects/(double) (nVal));
-      strlcat (buffer, str, maxLen);
-      snprintf (str, MAX_SIZE_LINE, "n Val suspect Lon: %d, ratio: %.2lf %% \n", nLonSuspects, 100 * (double)nLonSuspects/(double) (nVal));
-      strlcat (buffer, str, maxLen);
-   }
+   nVal = (int) flowPlaneLen (zone);   // lat, lon derived from zone: consistent by construction
    snprintf (str, MAX_SIZE_LINE, "n Val Values: %d\n", nVal); // at least this line
    strlcat (buffer, str, maxLen);
    snprintf (str, MAX_SIZE_LINE, "%s\n", (zone->wellDefined) ? (zone->allTimeStepOK) ? "Wind Zone Well defined" : "All Zone TimeSteps are not defined" : "Zone Undefined");
@@ -281,9 +243,6 @@ bool checkGribInfoToStr (int type, Zone *zone, char *buffer, size_t maxLen) {
    // check grib missing or strange values and out of zone for wind
    if (! checkGrib (zone, type, &sCheck)) {
       OK = false;
-      snprintf (str, MAX_SIZE_LINE, "out zone Values: %d, ratio: %.2lf %% \n", sCheck.outZone, 100 * (double)sCheck.outZone/(double) (nVal));
-      strlcat (buffer, str, maxLen);
-
       snprintf (str, MAX_SIZE_LINE, "u missing Values: %d, ratio: %.2lf %% \n", sCheck.uMissing, 100 * (double)sCheck.uMissing/(double) (nVal));
       strlcat (buffer, str, maxLen);
       snprintf (str, MAX_SIZE_LINE, "u strange Values: %d, ratio: %.2lf %% \n", sCheck.uStrange, 100 * (double)sCheck.uStrange/(double) (nVal));
@@ -373,7 +332,23 @@ static inline double arrondiMax (double v, double step) {
    return ((double) ceil (v/step)) * step;
 }
 
-/*! provide 4 wind points around point lat, lon */
+/*! lon unwrapped relative to zone, in [lonLeft, lonLeft + 360): a zone crossing antimeridian is contiguous */
+static inline double zoneLon (double lon, const Zone *zone) {
+   const double d = fmod (lon - zone->lonLeft, 360.0);
+   return zone->lonLeft + ((d < 0) ? d + 360.0 : d);
+}
+
+/*! east edge of zone in the unwrapped frame of zoneLon, whatever the convention of lonRight */
+static inline double zoneLonEast (const Zone *zone) {
+   return zone->lonLeft + (zone->nbLon - 1) * zone->lonStep;
+}
+
+/*! true if (lat, lon) is within zone. lon unwrapped by zoneLon */
+static inline bool isInZoneLon (double lat, double lon, const Zone *zone) {
+   return (lat >= zone->latMin) && (lat <= zone->latMax) && (lon <= zoneLonEast (zone));
+}
+
+/*! provide 4 wind points around point lat, lon. lon unwrapped by zoneLon */
 static inline void find4PointsAround (double lat, double lon,  double *latMin, 
    double *latMax, double *lonMin, double *lonMax, Zone *zone) {
 
@@ -386,11 +361,11 @@ static inline void find4PointsAround (double lat, double lon,  double *latMin,
    if (zone->latMin > *latMin) *latMin = zone->latMin;
    if (zone->latMax < *latMax) *latMax = zone->latMax; 
    if (zone->lonLeft > *lonMin) *lonMin = zone->lonLeft; 
-   if (zone->lonRight < *lonMax) *lonMax = zone->lonRight;
+   if (zoneLonEast (zone) < *lonMax) *lonMax = zoneLonEast (zone);
    
    if (zone->latMax < *latMin) *latMin = zone->latMax; 
    if (zone->latMin > *latMax) *latMax = zone->latMin; 
-   if (zone->lonRight < *lonMin) *lonMin = zone->lonRight; 
+   if (zoneLonEast (zone) < *lonMin) *lonMin = zoneLonEast (zone); 
    if (zone->lonLeft > *lonMax) *lonMax = zone->lonLeft;
 }
 
@@ -405,16 +380,44 @@ static inline long indLon (double lon, const Zone *zone) {
    return (long) round ((lon - zone->lonLeft)/zone->lonStep);
 }
 
+/*! bilinear interpolation at (lat, lon) in plane from time slice offset.
+   idx: indexes of corners (latMax, lonMin), (latMax, lonMax), (latMin, lonMax), (latMin, lonMin) in slice */
+static inline double bilinear (const float *plane, size_t offset, const long idx [4], double lat, double lon, \
+   double latMin, double latMax, double lonMin, double lonMax) {
+   const float *p = plane + offset;
+   const double a = interpolate (lon, lonMin, lonMax, p [idx [0]], p [idx [1]]);
+   const double b = interpolate (lon, lonMax, lonMin, p [idx [2]], p [idx [3]]);
+   return interpolate (lat, latMax, latMin, a, b);
+}
+
+/*! same as bilinear for quantized int16 plane. Decoding is affine so it is done once on the result */
+static inline double bilinearQ (const int16_t *plane, size_t offset, const long idx [4], double lat, double lon, \
+   double latMin, double latMax, double lonMin, double lonMax) {
+   const int16_t *p = plane + offset;
+   const double a = interpolate (lon, lonMin, lonMax, p [idx [0]], p [idx [1]]);
+   const double b = interpolate (lon, lonMax, lonMin, p [idx [2]], p [idx [3]]);
+   return interpolate (lat, latMax, latMin, a, b);
+}
+
+/*! bilinear interpolation of variable iVar, float or quantized according to zone */
+static inline double bilinearVar (const void *gribData, const Zone *zone, int iVar, size_t offset, const long idx [4], \
+   double lat, double lon, double latMin, double latMax, double lonMin, double lonMax) {
+   if (zone->quantized)
+      return zone->qOffset [iVar] + zone->qScale [iVar] * \
+         bilinearQ (flowPlaneQ (gribData, zone, iVar), offset, idx, lat, lon, latMin, latMax, lonMin, lonMax);
+   return bilinear (flowPlane (gribData, zone, iVar), offset, idx, lat, lon, latMin, latMax, lonMin, lonMax);
+}
+
 /*! interpolation to get u, v, g (gust), w (waves) at point (lat, lon)  and time t */
 static bool findFlow (double lat, double lon, double t, double *rU, double *rV, \
-   double *rG, double *rW, Zone *zone, const FlowP *gribData) {
+   double *rG, double *rW, Zone *zone, const void *gribData) {
 
    double t0,t1;
    double latMin, latMax, lonMin, lonMax;
-   double a, b, u0, u1, v0, v1, g0, g1, w0, w1;
+   double u0, u1, v0, v1, g0, g1, w0, w1;
    int iT0, iT1;
-   FlowP windP00, windP01, windP10, windP11;
-   if ((!zone->wellDefined) || (zone->nbLat == 0) || (! isInZone (lat, lon, zone) && par.constWindTws == 0) || (t < 0)){
+   lon = zoneLon (lon, zone);
+   if ((!zone->wellDefined) || (zone->nbLat == 0) || (! isInZoneLon (lat, lon, zone) && par.constWindTws == 0) || (t < 0)){
       *rU = 0; *rV = 0; *rG = 0; *rW = 0;
       return false;
    }
@@ -422,55 +425,27 @@ static bool findFlow (double lat, double lon, double t, double *rU, double *rV,
    findTimeAround (t, &iT0, &iT1, zone);
    find4PointsAround (lat, lon, &latMin, &latMax, &lonMin, &lonMax, zone);
    //printf ("lat %lf iT0 %d, iT1 %d, latMin %lf latMax %lf lonMin %lf lonMax %lf\n", p.lat, iT0, iT1, latMin, latMax, lonMin, lonMax);  
-   // 4 points at time t0
-   windP00 = gribData [iT0 * zone->nbLat * zone->nbLon + indLat(latMax, zone) * zone->nbLon + indLon(lonMin, zone)];  
-   windP01 = gribData [iT0 * zone->nbLat * zone->nbLon + indLat(latMax, zone) * zone->nbLon + indLon(lonMax, zone)];
-   windP10 = gribData [iT0 * zone->nbLat * zone->nbLon + indLat(latMin, zone) * zone->nbLon + indLon(lonMax, zone)];
-   windP11 = gribData [iT0 * zone->nbLat * zone->nbLon + indLat(latMin, zone) * zone->nbLon + indLon(lonMin, zone)];
-
-   // printf ("00lat %lf  01lat %lf  10lat %lf 11lat %lf\n", windP00.lat, windP01.lat,windP10.lat,windP11.lat); 
-   // printf ("00tws %lf  01tws %lf  10tws %lf 11tws %lf\n", windP00.tws, windP01.tws,windP10.tws,windP11.tws); 
-   // speed longitude interpolation at northern latitudes
-  
-   // interpolation  for u, v, w, g
-   a = interpolate (lon, windP00.lon, windP01.lon, windP00.u, windP01.u);
-   b = interpolate (lon, windP10.lon, windP11.lon, windP10.u, windP11.u); 
-   u0 = interpolate (lat, windP00.lat, windP10.lat, a, b);
-   
-   a = interpolate (lon, windP00.lon, windP01.lon, windP00.v, windP01.v); 
-   b = interpolate (lon, windP10.lon, windP11.lon, windP10.v, windP11.v); 
-   v0 = interpolate (lat, windP00.lat, windP10.lat, a, b);
-   
-   a = interpolate (lon, windP00.lon, windP01.lon, windP00.g, windP01.g); 
-   b = interpolate (lon, windP10.lon, windP11.lon, windP10.g, windP11.g); 
-   g0 = interpolate (lat, windP00.lat, windP10.lat, a, b);
-    
-   a = interpolate (lon, windP00.lon, windP01.lon, windP00.w, windP01.w); 
-   b = interpolate (lon, windP10.lon, windP11.lon, windP10.w, windP11.w); 
-   w0 = interpolate (lat, windP00.lat, windP10.lat, a, b);
-    
-   // 4 points at time t1
-   windP00 = gribData [iT1 * zone->nbLat * zone->nbLon + indLat(latMax, zone) * zone->nbLon + indLon(lonMin, zone)];  
-   windP01 = gribData [iT1 * zone->nbLat * zone->nbLon + indLat(latMax, zone) * zone->nbLon + indLon(lonMax, zone)];
-   windP10 = gribData [iT1 * zone->nbLat * zone->nbLon + indLat(latMin, zone) * zone->nbLon + indLon(lonMax, zone)];
-   windP11 = gribData [iT1 * zone->nbLat * zone->nbLon + indLat(latMin, zone) * zone->nbLon + indLon(lonMin, zone)];
-
-   // interpolatuon for  for u, v
-   a = interpolate (lon, windP00.lon, windP01.lon, windP00.u, windP01.u);
-   b = interpolate (lon, windP10.lon, windP11.lon, windP10.u, windP11.u); 
-   u1 = interpolate (lat, windP00.lat, windP10.lat, a, b);
-   
-   a = interpolate (lon, windP00.lon, windP01.lon, windP00.v, windP01.v); 
-   b = interpolate (lon, windP10.lon, windP11.lon, windP10.v, windP11.v); 
-   v1 = interpolate (lat, windP00.lat, windP10.lat, a, b);
-    
-   a = interpolate (lon, windP00.lon, windP01.lon, windP00.g, windP01.g); 
-   b = interpolate (lon, windP10.lon, windP11.lon, windP10.g, windP11.g); 
-   g1 = interpolate (lat, windP00.lat, windP10.lat, a, b);
-   
-   a = interpolate (lon, windP00.lon, windP01.lon, windP00.w, windP01.w); 
-   b = interpolate (lon, windP10.lon, windP11.lon, windP10.w, windP11.w); 
-   w1 = interpolate (lat, windP00.lat, windP10.lat, a, b);
+
+   // 4 corners within a time slice. lat, lon of corners are latMin.. lonMax (derived from zone)
+   const long idx [4] = {
+      indLat(latMax, zone) * zone->nbLon + indLon(lonMin, zone),
+      indLat(latMax, zone) * zone->nbLon + indLon(lonMax, zone),
+      indLat(latMin, zone) * zone->nbLon + indLon(lonMax, zone),
+      indLat(latMin, zone) * zone->nbLon + indLon(lonMin, zone)
+   };
+   const size_t slice = zone->nbLat * zone->nbLon;
+
+   // interpolation for u, v, g, w at time t0
+   u0 = bilinearVar (gribData, zone, FLOW_U, iT0 * slice, idx, lat, lon, latMin, latMax, lonMin, lonMax);
+   v0 = bilinearVar (gribData, zone, FLOW_V, iT0 * slice, idx, lat, lon, latMin, latMax, lonMin, lonMax);
+   g0 = bilinearVar (gribData, zone, FLOW_G, iT0 * slice, idx, lat, lon, latMin, latMax, lonMin, lonMax);
+   w0 = bilinearVar (gribData, zone, FLOW_W, iT0 * slice, idx, lat, lon, latMin, latMax, lonMin, lonMax);
+
+   // interpolation for u, v, g, w at time t1
+   u1 = bilinearVar (gribData, zone, FLOW_U, iT1 * slice, idx, lat, lon, latMin, latMax, lonMin, lonMax);
+   v1 = bilinearVar (gribData, zone, FLOW_V, iT1 * slice, idx, lat, lon, latMin, latMax, lonMin, lonMax);
+   g1 = bilinearVar (gribData, zone, FLOW_G, iT1 * slice, idx, lat, lon, latMin, latMax, lonMin, lonMax);
+   w1 = bilinearVar (gribData, zone, FLOW_W, iT1 * slice, idx, lat, lon, latMin, latMax, lonMin, lonMax);
    
    // finally, interpolation twd tws between t0 and t1
    t0 = zone->timeStamp [iT0];
@@ -483,6 +458,154 @@ static bool findFlow (double lat, double lon, double t, double *rU, double *rV,
    return true;
 }
 
+/*! batch version of findFlow for n points at same time t. Time bracket and time weight are shared.
+   Per point, the 8 corners (4 in space, 2 in time) are blended with precomputed weights for all variables.
+   out [i] receives u, v, gust, w of point i, and uCurr, vCurr if cur (2 float planes on same lattice) not NULL.
+   Points out of zone get 0 */
+static void findFlowBatch (double t, int n, const double lat [], const double lon [], WindVal out [], \
+   const Zone *zone, const void *gribData, const float *cur) {
+
+   int iT0, iT1;
+   if ((!zone->wellDefined) || (zone->nbLat == 0) || (t < 0)) {
+      memset (out, 0, n * sizeof (WindVal));
+      return;
+   }
+   findTimeAround (t, &iT0, &iT1, zone);
+   const double ct = interpolate (t, zone->timeStamp [iT0], zone->timeStamp [iT1], 0.0, 1.0);
+   const size_t slice = zone->nbLat * zone->nbLon;
+   const size_t len = flowPlaneLen (zone);
+   const float *pf = gribData;
+   const int16_t *pq = gribData;
+
+   for (int i = 0; i < n; i++) {
+      double latMin, latMax, lonMin, lonMax;
+      const double lonZ = zoneLon (lon [i], zone);
+      if (! isInZoneLon (lat [i], lonZ, zone) && par.constWindTws == 0) {
+         memset (&out [i], 0, sizeof (WindVal));
+         continue;
+      }
+      find4PointsAround (lat [i], lonZ, &latMin, &latMax, &lonMin, &lonMax, (Zone *) zone);
+      const double a = interpolate (lonZ, lonMin, lonMax, 0.0, 1.0);
+      const double b = interpolate (lat [i], latMax, latMin, 0.0, 1.0);
+      // same corner order as findFlow: (latMax, lonMin), (latMax, lonMax), (latMin, lonMax), (latMin, lonMin)
+      const size_t idx [4] = {
+         indLat(latMax, zone) * zone->nbLon + indLon(lonMin, zone),
+         indLat(latMax, zone) * zone->nbLon + indLon(lonMax, zone),
+         indLat(latMin, zone) * zone->nbLon + indLon(lonMax, zone),
+         indLat(latMin, zone) * zone->nbLon + indLon(lonMin, zone)
+      };
+      const double wSpace [4] = {(1 - a) * (1 - b), a * (1 - b), a * b, (1 - a) * b};
+      double acc [N_FLOW_PLANES] = {0};
+      double accCurr [2] = {0};
+      for (int c = 0; c < 8; c++) {
+         const size_t off = ((c < 4) ? iT0 : iT1) * slice + idx [c & 3];
+         const double wc = wSpace [c & 3] * ((c < 4) ? (1 - ct) : ct);
+         if (zone->quantized)
+            for (int iVar = 0; iVar < N_FLOW_PLANES; iVar++) acc [iVar] += wc * pq [iVar * len + off];
+         else
+            for (int iVar = 0; iVar < N_FLOW_PLANES; iVar++) acc [iVar] += wc * pf [iVar * len + off];
+         if (cur != NULL) {
+            accCurr [0] += wc * cur [off];
+            accCurr [1] += wc * cur [len + off];
+         }
+      }
+      if (zone->quantized)
+         for (int iVar = 0; iVar < N_FLOW_PLANES; iVar++) acc [iVar] = zone->qOffset [iVar] + zone->qScale [iVar] * acc [iVar];
+      out [i].u = acc [FLOW_U];
+      out [i].v = acc [FLOW_V];
+      out [i].gust = acc [FLOW_G];
+      out [i].w = acc [FLOW_W];
+      out [i].uCurr = accCurr [0];
+      out [i].vCurr = accCurr [1];
+   }
+}
+
+/*! composite wind index. For each cell of wind zone lattice, bit i of mask set if layer i intersects cell.
+   Candidate layers of a point are read in its cell: no search over all layers per call */
+static struct {
+   uint8_t *mask;
+   const void *windData;                   // wind data the index has been built for
+   long nbLat, nbLon;
+   double tDelta [MAX_N_GRIB_LAYERS];      // time difference in hours between layer and wind grib
+} composite;
+
+/*! cell of wind zone lattice index containing (lat, lon), -1 if outside */
+static inline long compositeCell (double lat, double lon) {
+   lon = zoneLon (lon, &zone);
+   const long iLat = (long) floor ((lat - zone.latMin) / zone.latStep);
+   const long iLon = (long) floor ((lon - zone.lonLeft) / zone.lonStep);
+   if ((iLat < 0) || (iLat >= zone.nbLat) || (iLon < 0) || (iLon >= zone.nbLon)) return -1;
+   return iLat * zone.nbLon + iLon;
+}
+
+/*! build composite index of the nGribLayers layers over wind zone. To call after wind or layers load.
+   return true if composite wind active */
+bool compositeBuild (void) {
+   free (composite.mask);
+   composite.mask = NULL;
+   composite.windData = NULL;
+   if ((nGribLayers <= 0) || ! zone.wellDefined || (zone.nbLat == 0) || (tGribData [WIND] == NULL)) return false;
+   if ((composite.mask = calloc (zone.nbLat * zone.nbLon, sizeof (uint8_t))) == NULL) {
+      fprintf (stderr, "In compositeBuild, Error Memory allocation\n");
+      return false;
+   }
+   for (int iL = 0; iL < nGribLayers; iL++) {
+      const Zone *lz = &layerZone [iL];
+      composite.tDelta [iL] = zoneTimeDiff (lz, &zone);
+      if (! lz->wellDefined || (lz->nbLat == 0)) continue;
+      const long iLat0 = CLAMP ((long) floor ((lz->latMin - zone.latMin) / zone.latStep), 0, zone.nbLat - 1);
+      const long iLat1 = CLAMP ((long) floor ((lz->latMax - zone.latMin) / zone.latStep), 0, zone.nbLat - 1);
+      // column [x, x + lonStep) in layer frame intersects layer [lonLeft, east], directly or across the wrap
+      for (long iLon = 0; iLon < zone.nbLon; iLon++) {
+         const double x = zoneLon (zone.lonLeft + iLon * zone.lonStep, lz);
+         if ((x > zoneLonEast (lz)) && (x + zone.lonStep < lz->lonLeft + 360.0)) continue;
+         for (long iLat = iLat0; iLat <= iLat1; iLat++)
+            composite.mask [iLat * zone.nbLon + iLon] |= (uint8_t) (1 << iL);
+      }
+   }
+   composite.windData = tGribData [WIND];
+   composite.nbLat = zone.nbLat;
+   composite.nbLon = zone.nbLon;
+   return true;
+}
+
+/*! true if composite index matches loaded wind */
+static inline bool compositeActive (void) {
+   return (composite.mask != NULL) && (composite.windData == tGribData [WIND])
+      && (composite.nbLat == zone.nbLat) && (composite.nbLon == zone.nbLon);
+}
+
+/*! weight of layer zone z at (lat, lon): 1 inside, decreasing to 0 in blending band along edges */
+static inline double layerWeight (double lat, double lon, const Zone *z) {
+   if (par.gribLayerBlend <= 0) return 1.0;
+   lon = zoneLon (lon, z);
+   const double d = fmin (fmin (lat - z->latMin, z->latMax - lat), fmin (lon - z->lonLeft, zoneLonEast (z) - lon));
+   return CLAMP (d / par.gribLayerBlend, 0.0, 1.0);
+}
+
+/*! composite wind at (lat, lon) and time t. Layers containing point at time t are taken by priority,
+   each one weighted by layerWeight of what remains, wind grib gets the rest */
+static void findFlowComposite (double lat, double lon, double t, double *rU, double *rV, double *rG, double *rW) {
+   double u, v, g, w, rem = 1.0;
+   const long cell = compositeCell (lat, lon);
+   unsigned mask = (cell < 0) ? 0 : composite.mask [cell];
+   *rU = *rV = *rG = *rW = 0;
+   for (int iL = 0; (mask != 0) && (rem > 0); iL++, mask >>= 1) {
+      if (! (mask & 1) || ! isInZoneLon (lat, zoneLon (lon, &layerZone [iL]), &layerZone [iL])) continue;
+      const double tL = t - composite.tDelta [iL];
+      if ((tL < 0) || (tL > layerZone [iL].timeStamp [layerZone [iL].nTimeStamp - 1])) continue;
+      const double wL = rem * layerWeight (lat, lon, &layerZone [iL]);
+      if (wL <= 0) continue;
+      findFlow (lat, lon, tL, &u, &v, &g, &w, &layerZone [iL], tLayerData [iL]);
+      *rU += wL * u; *rV += wL * v; *rG += wL * g; *rW += wL * w;
+      rem -= wL;
+   }
+   if (rem > 0) {
+      findFlow (lat, lon, t, &u, &v, &g, &w, &zone, tGribData [WIND]);
+      *rU += rem * u; *rV += rem * v; *rG += rem * g; *rW += rem * w;
+   }
+}
+
 /*! use findflow to get wind and waves */
 void findWindGrib (double lat, double lon, double t, double *u, double *v, \
    double *gust, double *w, double *twd, double *tws ) {
@@ -495,7 +618,8 @@ void findWindGrib (double lat, double lon, double t, double *u, double *v, \
       *gust = hypot (*u, *v); // m/s
       return;
    }
-   findFlow (lat, lon, t, u, v, gust, w, &zone, tGribData [WIND]);
+   if (compositeActive ()) findFlowComposite (lat, lon, t, u, v, gust, w);
+   else findFlow (lat, lon, t, u, v, gust, w, &zone, tGribData [WIND]);
    *twd = fTwd (*u, *v);
    *tws = fTws (*u, *v);
    if (par.constWave < 0) *w = 0;
@@ -525,6 +649,77 @@ void findCurrentGrib (double lat, double lon, double t, double *uCurr,\
    *tcs = fTws (*uCurr, *vCurr);
 }
 
+/*! current resampled on wind lattice and wind time stamps (CURRENT_ON_WIND). 2 float planes: u, v.
+   Valid while wind and current data are the ones it has been built from */
+static struct {
+   float *data;
+   const void *windData, *currentData;
+   Zone windZone, currentZone;
+} currentOnWind;
+
+/*! true if currentOnWind matches loaded wind and current */
+static bool currentOnWindValid (void) {
+   return (currentOnWind.data != NULL) 
+      && (currentOnWind.windData == tGribData [WIND]) && (currentOnWind.currentData == tGribData [CURRENT])
+      && (memcmp (&currentOnWind.windZone, &zone, sizeof (Zone)) == 0)
+      && (memcmp (&currentOnWind.currentZone, &currentZone, sizeof (Zone)) == 0);
+}
+
+/*! resample current on wind lattice and time stamps if par.currentOnWind,
+   so that findWindGribBatch returns current with wind in one lookup.
+   Kept if already built from same wind and current. return true if resampled current available */
+bool resampleCurrentOnWind (void) {
+   double uCurr, vCurr, tcd, tcs;
+   if (! par.currentOnWind || ! zone.wellDefined || (zone.nbLat == 0)
+      || (tGribData [WIND] == NULL) || (tGribData [CURRENT] == NULL && par.constCurrentS == 0)) return false;
+   if (currentOnWindValid ()) return true;
+
+   const size_t len = flowPlaneLen (&zone);
+   float *data = malloc (2 * len * sizeof (float));
+   if (data == NULL) {
+      fprintf (stderr, "In resampleCurrentOnWind, Error Memory allocation\n");
+      return false;
+   }
+   const double tDelta = zoneTimeDiff (&currentZone, &zone);
+   for (size_t iT = 0; iT < zone.nTimeStamp; iT++) {
+      for (int iLat = 0; iLat < zone.nbLat; iLat++) {
+         for (int iLon = 0; iLon < zone.nbLon; iLon++) {
+            const size_t i = (iT * zone.nbLat + iLat) * zone.nbLon + iLon;
+            findCurrentGrib (zone.latMin + iLat * zone.latStep, zone.lonLeft + iLon * zone.lonStep, 
+               zone.timeStamp [iT] - tDelta, &uCurr, &vCurr, &tcd, &tcs);
+            data [i] = uCurr;
+            data [len + i] = vCurr;
+         }
+      }
+   }
+   free (currentOnWind.data);
+   currentOnWind.data = data;
+   currentOnWind.windData = tGribData [WIND];
+   currentOnWind.currentData = tGribData [CURRENT];
+   currentOnWind.windZone = zone;
+   currentOnWind.currentZone = currentZone;
+   return true;
+}
+
+/*! batch version of findWindGrib for n points at same time t, for example parents of an isochrone.
+   return true if out also contains current (uCurr, vCurr) resampled by resampleCurrentOnWind */
+bool findWindGribBatch (double t, int n, const double lat [], const double lon [], WindVal out []) {
+   if ((par.constWindTws != 0) || compositeActive ()) {
+      for (int i = 0; i < n; i++)
+         findWindGrib (lat [i], lon [i], t, &out [i].u, &out [i].v, &out [i].gust, &out [i].w, &out [i].twd, &out [i].tws);
+      return false;
+   }
+   const bool withCurrent = par.currentOnWind && currentOnWindValid ();
+   findFlowBatch (t, n, lat, lon, out, &zone, tGribData [WIND], withCurrent ? currentOnWind.data : NULL);
+   for (int i = 0; i < n; i++) {
+      out [i].twd = fTwd (out [i].u, out [i].v);
+      out [i].tws = fTws (out [i].u, out [i].v);
+      if (par.constWave < 0) out [i].w = 0;
+      else if (par.constWave != 0) out [i].w = par.constWave;
+   }
+   return withCurrent;
+}
+
 /*! write Grib information in string */
 char *gribToStr (const Zone *zone, char *str, size_t maxLen) {
    char line [MAX_SIZE_LINE] = "";
@@ -586,7 +781,7 @@ char *gribToStrJson (const char *fileName, char *out, size_t maxLen) {
    char gribName [MAX_SIZE_FILE_NAME];
    char str [MAX_SIZE_TEXT] = "";
    char infoStr [MAX_SIZE_LINE] = "";
-   struct stat st;
+   const CatalogFile *file;
    char str0 [MAX_SIZE_NAME] = "";
    char str1 [MAX_SIZE_NAME] = "";
    char centreName [MAX_SIZE_NAME] = "";
@@ -596,21 +791,14 @@ char *gribToStrJson (const char *fileName, char *out, size_t maxLen) {
 
    buildRootName (fileName, gribName, sizeof (gribName));
 
-   if (stat (gribName, &st) != 0) {
-      fprintf (stderr, "In gribToStrJson Error stat: %s\n", gribName);
-      snprintf (out, maxLen, "{}\n");
-      return out;
-   }
-   if (! readGribLists (gribName, &gZone)) {
-      fprintf (stderr, "In gribToStrJson Error reading: %s\n", gribName);
-      snprintf (out, maxLen, "{}\n");
-      return out;
-   }
-   if (! readGribParameters (gribName, &gZone)) {
+   // metadata parsed once per file version by catalog
+   const Zone *catZone = catalogGribZone (gribName, &file);
+   if (catZone == NULL) {
       fprintf (stderr, "In gribToStrJson Error reading: %s\n", gribName);
       snprintf (out, maxLen, "{}\n");
       return out;
    }
+   gZone = *catZone;
    if (gZone.nbLat == 0) {
       fprintf (stderr, "In gribToStrJson Error no value available in: %s\n", gribName);
       snprintf (out, maxLen, "{}\n");
@@ -656,12 +844,12 @@ char *gribToStrJson (const char *fileName, char *out, size_t maxLen) {
    }
    strlcat (out, "],\n", maxLen);
 
-   tm_info = localtime_r (&st.st_mtime, &tm_buf);
+   tm_info = localtime_r (&file->mtime, &tm_buf);
    if (tm_info) strftime(strTime, sizeof strTime, "%Y-%m-%d %H:%M:%S", tm_info);
    
    char *gribBaseName = g_path_get_basename (fileName);
    snprintf (str, sizeof (str),  "  \"name\": \"%s\", \"fileSize\": %ld, \"fileTime\": \"%s\",\n", 
-            gribBaseName, st.st_size, strTime);
+            gribBaseName, (long) file->size, strTime);
    strlcat (out, str, maxLen);
    free (gribBaseName);
 
@@ -23,6 +23,13 @@
 #include "engine.h"
 #include "grib.h"
 #include "readgriball.h"
+#include "gribcache.h"
+#include "gribwatch.h"
+#include "gribcatalog.h"
+#include "coast.h"
+#include "poi.h"
+#include "corridor.h"
+#include "forbidzone.h"
 #include "polar.h"
 #include "inline.h"
 #include "option.h"
@@ -243,12 +250,17 @@ static char *testToJson (int serverPort, const char *clientIP, const char *userA
    char strWind [MAX_SIZE_LINE] = "";
    char strCurrent [MAX_SIZE_LINE] = "";
    char strMem [MAX_SIZE_LINE] = "";   
+   char strCache [MAX_SIZE_LINE] = "";
    char strConf [MAX_SIZE_LINE] = "";
    char str [MAX_SIZE_TEXT_FILE] = "";
+   int nCache;
+   size_t cacheBytes;
 
-   formatThousandSep (strWind, sizeof strWind, sizeof(FlowP) * (zone.nTimeStamp + 1) * zone.nbLat * zone.nbLon);
-   formatThousandSep (strCurrent, sizeof strCurrent, sizeof(FlowP) * (currentZone.nTimeStamp + 1) * currentZone.nbLat * currentZone.nbLon);
+   formatThousandSep (strWind, sizeof strWind, N_FLOW_PLANES * flowValueSize (&zone) * flowPlaneLen (&zone));
+   formatThousandSep (strCurrent, sizeof strCurrent, N_FLOW_PLANES * flowValueSize (&currentZone) * flowPlaneLen (&currentZone));
    formatThousandSep (strMem, sizeof strMem, memoryUsage ()); // KB ! 
+   gribCacheInfo (&nCache, &cacheBytes);
+   formatThousandSep (strCache, sizeof strCache, cacheBytes);
 
    if (fileExists (parameterFileName)) {
       snprintf (strConf, sizeof strConf, "Exist: %s", parameterFileName);
@@ -263,6 +275,7 @@ static char *testToJson (int serverPort, const char *clientIP, const char *userA
       "  \"Grib Reader\": \"%s\",\n"
       "  \"Memory for Grib Wind\": \"%s\",\n"
       "  \"Memory for Grib Current\": \"%s\",\n"
+      "  \"Grib Cache\": \"%d files, %s bytes\",\n"
       "  \"Compilation-date\": \"%s\",\n"
       "  \"PID\": %d,\n"
       "  \"Memory usage in KB\": \"%s\",\n"
@@ -270,7 +283,7 @@ static char *testToJson (int serverPort, const char *clientIP, const char *userA
       "  \"User Agent\": \"%s\",\n"
       "  \"Authorization-Level\": %d\n}\n",
       PROG_NAME, PROG_VERSION, PROG_AUTHOR, strConf, serverPort, gribReaderVersion (str, sizeof str), 
-      strWind, strCurrent, __DATE__, getpid (), strMem, clientIP, userAgent, level
+      strWind, strCurrent, nCache, strCache, __DATE__, getpid (), strMem, clientIP, userAgent, level
    );
    return out;
 }
@@ -392,10 +405,12 @@ static bool launchAction (int serverPort, int sock, ClientRequest *clientReq,
       paramToStrJson (&par, outBuffer, maxLen);
       break;
    case REQ_INIT:
+      gribWatchStop ();                         // watcher restarted with new parameters
       if (! initContext (parameterFileName, PATTERN))
          snprintf (outBuffer, maxLen, "{\n  \"_Error\": \"Init failed\",\n  \"serverPort\": %d\n}\n", serverPort);
       else
          snprintf (outBuffer, maxLen, "{\n  \"message\": \"Init done\",\n  \"serverPort\": %d\n}\n", serverPort);
+      if (par.gribWatch) gribWatchStart ();
       break;
    case REQ_FEEDBACK:
          handleFeedbackRequest (par.feedbackFileName, date, clientIPAddress, clientReq->feedback);
@@ -642,8 +657,7 @@ int main (int argc, char *argv[]) {
 
    // option case, launch optionManage
    if (argv[1][0] == '-') {
-      optionManage (argv [1][1]);
-      return EXIT_SUCCESS;
+      return optionManage (argv [1][1]) ? EXIT_SUCCESS : EXIT_FAILURE;
    }
 
    // No option, normal case, launch of server
@@ -685,6 +699,7 @@ int main (int argc, char *argv[]) {
       close (serverFd);
       return EXIT_FAILURE;
    }
+   if (par.gribWatch) gribWatchStart ();
    const double elapsed = monotonic () - start; 
    printf ("✅ Loaded in...: %.2lf seconds. Server listen on port: %d, Pid: %d\n", elapsed, serverPort, getpid ());
 
@@ -694,25 +709,28 @@ int main (int argc, char *argv[]) {
          close (serverFd);
          return EXIT_FAILURE;
       }
+      gribWatchAdopt ();                        // gribs decoded in background since last request
       handleClient (serverPort, clientFd, &address);
       fflush (stdout);
       fflush (stderr);
       close (clientFd);
    }
    close (serverFd);
-   free (tIsSea);
+   freeIsSea ();
+   freeCoastTiles ();
+   freeCoastDist ();
+   poiFree ();
+   corridorFree (&userCorridor);
+   forbidIndexFree ();
    free (isoDesc);
    free (isocArray);
    free (route.t);
    // freeHistoryRoute ();
-   free (tGribData [WIND]); 
-   free (tGribData [CURRENT]); 
+   gribWatchStop ();
+   gribCacheFree ();
+   catalogFree ();
    free (bigBuffer);
-   for (int i = 0; i < par.nForbidZone; i++) {
-      free(forbidZones[i].points);
-      forbidZones[i].points = NULL;
-      forbidZones[i].n = 0;
-   }
+   forbidZonesFree ();
    return EXIT_SUCCESS;
 }
 
@@ -5,6 +5,7 @@
 #pragma once
 //#include <sys/_types/_time_t.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <time.h>
 
 #define MAX_SIZE_RESOURCE_NAME 256              // Max size polar or grib name
@@ -33,9 +34,19 @@
 #define EARTH_RADIUS          3440.065          // Earth's radius in nautical miles
 #define RAD_TO_DEG            (180.0/G_PI)      // conversion radius to degree
 #define DEG_TO_RAD            (G_PI/180.0)      // conversion degree to radius
-#define SIZE_T_IS_SEA         (3601 * 1801)     // size of size is sea 
+#define IS_SEA_N_LON          3601              // number of columns of isSea grid (0.1 degree)
+#define IS_SEA_N_LAT          1801              // number of lines of isSea grid
+#define SIZE_T_IS_SEA         (IS_SEA_N_LON * IS_SEA_N_LAT) // size of size is sea 
+#define SIZE_IS_SEA_BITS      ((SIZE_T_IS_SEA + 7) / 8) // bytes of bit packed isSea table
+#define IS_SEA_MAGIC          "R3ISSEA"         // 8 bytes with '\0', header of binary isSea file
+#define COAST_SUB             20                // coastal tile: COAST_SUB x COAST_SUB cells of 0.005 degree per isSea cell
+#define COAST_TILE_BYTES      ((COAST_SUB * COAST_SUB + 7) / 8) // bit packed coastal tile
+#define COAST_N_WORDS         ((SIZE_T_IS_SEA + 63) / 64) // 64 bits words of coastal cell bitset
+#define COAST_MAGIC           "R3COAST"         // 8 bytes with '\0', header of coastal tiles file
+#define COAST_DIST_MAX        255               // cap of distance to coast table, in isSea cells
 #define MAX_N_WAY_POINT       10                // Max number of Way Points
 #define MAX_N_CMD             10
+#define MAX_N_CORRIDOR        256               // Max number of points of corridor polyline in request
 #define PROG_NAME             "RCube"         
 #define PROG_VERSION          "0.1"  
 #define PROG_AUTHOR           "René Rigault"
@@ -63,6 +74,13 @@
 #define MAX_N_DATA_DATE       4                 // Max number of date in grib file. 1 in practise
 #define MAX_N_DATA_TIME       4                 // Max number of time date in egrib file. 1 in practise
 #define MAX_N_SHORT_NAME      64                // Max number of short name in grib file
+#define MAX_N_GRIB_CACHE      16                // Max number of decoded grib files kept in memory
+#define GRIB_CACHE_MB         4096              // Default memory budget in MB for grib cache
+#define MAX_N_CATALOG_DIR     16                // Max number of directories in grib catalog
+#define SIDECAR_SUFFIX        ".r3c"            // grib sidecar file name is grib file name + suffix
+#define QUANTIZE_ROUTE_TOL    0.01              // max relative duration difference of routing with GRIB_QUANTIZE (option -Q)
+#define MAX_N_GRIB_THREADS    64                // Max number of threads for grib decoding
+#define MAX_N_GRIB_LAYERS     4                 // Max number of grib layers over wind grib in composite wind. <= 8
 #define MAX_N_GRIB_LAT        1024              // Max umber of latitudes in grib file
 #define MAX_N_GRIB_LON        2048              // Max number of longitudes in grib file
 #define MAX_SIZE_SHORT_NAME   16                // Max size of string representing very short name
@@ -72,8 +90,6 @@
 #define MAX_SIZE_DIR_NAME     1024              // Max size of directory name
 #define MAX_N_SHP_FILES       4                 // Max number of shape file
 #define SMALL_SIZE            5                 // for short string
-#define MAX_SIZE_FORBID_ZONE  100               // Max size per forbidden zone
-#define MAX_N_FORBID_ZONE     32                // Max number of forbidden zones
 #define N_METEO_ADMIN         4                 // administration: Weather Service US, DWD, etc
 
 #define MAX_N_COMPETITORS     10                // Number Max of competitors
@@ -81,6 +97,7 @@
 #define MAX_N_SECTORS         3600              // Max number of sectors for optimization of sectors
 #define LIMIT_SOG             100               // for SOG error detection
 #define MAX_SIZE_INFO         512               // for checkArrival
+#define CORRIDOR_CELL         1.0               // degrees, cell of corridor segment index
 
 enum {WIND, CURRENT};                           // for grib information, either WIND or CURRENT
 enum {WIND_POLAR, WAVE_POLAR, SAIL_POLAR};      // for polar information, either WIND or WAVE or SAIL
@@ -88,6 +105,7 @@ enum {BASIC, DD, DM, DMS};                      // degre, degre decimal, degre m
 enum {TRIBORD, BABORD};                         // amure TRIBORD = STARBOARD, BABORD = PORT
 enum {RUNNING, STOPPED, NO_SOLUTION, EXIST_SOLUTION};                   // for chooseDeparture.ret values and allCompetitors check
 enum {ROUTING_STOPPED = -2, ROUTING_ERROR = -1, ROUTING_RUNNING = 0};   // for routingLaunch
+enum {POI_PORT, POI_MARK, POI_N_KIND};           // points of interest: ports of tides file, marks of marks file
 
 #define MAX_TYPE              18
 enum {REQ_KILL = -1793, REQ_TEST = 0, REQ_ROUTING = 1, REQ_COORD = 2, REQ_FORBID = 3, REQ_POLAR = 4, 
@@ -140,6 +158,12 @@ typedef struct {
       double lat;                            // latitude
       double lon;                            // longitude
    } wp [MAX_N_WAY_POINT];                   // way points
+   int nCorridor;                            // number of points of corridor polyline. 0 if no corridor
+   double corridorWidth;                     // NM, half width of corridor
+   struct {
+      double lat;                            // latitude
+      double lon;                            // longitude
+   } corridor [MAX_N_CORRIDOR];              // routing restricted to band of corridorWidth around this polyline
    int nCmd;                                 // Number of commands fot TWA or GDG route
    struct {                                  // for Twa and Hdg based routing
       double angle;                          // angle (twa or hdg depeding on from Twa)
@@ -166,12 +190,56 @@ typedef struct {
    double lon;
 } Point;
 
-/*! Structure for polygon */
+/*! Structure for polygon ring. Rings of same forbidden zone (outer ring then holes) share zone
+   and are inside by even-odd rule */
 typedef struct {
     int n;
     Point *points;
+    int zone;
 } MyPolygon;
 
+/*! point of interest: port of tides file or mark of marks file */
+typedef struct {
+   double lat, lon;                      // position, indexed
+   double lat1, lon1;                    // marks: second point (gates)
+   double v [3];                         // unit vector of position, for index
+   int id;                               // ports: port id
+   char name [MAX_SIZE_NAME];
+   char what [MAX_SIZE_NAME];            // marks: type
+   char code [MAX_SIZE_NAME];            // marks: id
+   char status [MAX_SIZE_NAME];          // marks: status
+} Poi;
+
+/*! points of interest of one file, in file order, with k-d tree index */
+typedef struct {
+   char fileName [MAX_SIZE_FILE_NAME];
+   time_t mtime;
+   long long size;
+   Poi *t;
+   int n;
+   int *tree;                            // indexes of t: balanced implicit k-d tree, node of [lo, hi) at (lo + hi) / 2
+} PoiSet;
+
+/*! Corridor: band of halfWidth around polyline. Segments bucketed in cells of CORRIDOR_CELL degrees */
+typedef struct {
+   int n;                                // number of vertices
+   double *lat;
+   double *lon;                          // unwrapped: each vertex within 180 degrees of previous one
+   double *time;                         // hours after start at vertices. NULL if no time constraint
+   double halfWidth;                     // NM
+   double timeMargin;                    // hours, segment kept if its time span meets [t - timeMargin, t + timeMargin]
+   int *cellStart;                       // segments of cell c: cellSeg [cellStart [c] .. cellStart [c+1] - 1]
+   int *cellSeg;
+} Corridor;
+
+/*! High resolution tiles of coastal isSea cells (cells mixing land and sea) */
+typedef struct {
+   const uint8_t *mixed;                 // bit packed, COAST_N_WORDS * 8 bytes. bit i set if cell i has a tile. NULL if no tiles
+   const uint32_t *rank;                 // number of coastal cells before each 64 bits word of mixed
+   uint8_t *tiles;                       // COAST_TILE_BYTES per coastal cell, in cell order. bit row * COAST_SUB + col, 1 if sea
+   uint32_t nTiles;
+} CoastTiles;
+
 /* Structure for best departure time choice */
 typedef struct {
    int ret;
@@ -197,20 +265,19 @@ typedef struct {
    int vStrange;
    int gStrange;
    int wStrange;
-   int outZone;
 } CheckGrib;
 
-/*! Wind point */ 
-typedef struct {
-   float lat;                 // latitude
-   float lon;                 // longitude
-   float u;                   // east west component of wind or current in meter/s
-   float v;                   // north south component of wind or current in meter/s
-   float w;                   // waves height WW3 model
-   float g;                   // wind speed gust un meter/s
-   //float msl;                 // mean sea level pressure
-   //float prate;               // precipitation rate
-} FlowP;                      // either wind or current
+/*! Wind or current data (tGribData) is one array of N_FLOW_PLANES planes, one per variable.
+   Each plane has nTimeStamp * nbLat * nbLon values indexed by (iT, iLat, iLon).
+   Values are float, or int16 if zone quantized: value = qOffset [plane] + qScale [plane] * raw.
+   lat, lon of a point are derived from Zone. */
+enum {
+   FLOW_U,                    // east west component of wind or current in meter/s
+   FLOW_V,                    // north south component of wind or current in meter/s
+   FLOW_G,                    // wind speed gust un meter/s
+   FLOW_W,                    // waves height WW3 model
+   N_FLOW_PLANES
+};
 
 /*! zone description */
 typedef struct {
@@ -242,8 +309,27 @@ typedef struct {
    long   intervalBegin;
    long   intervalEnd;
    size_t intervalLimit;
+   bool   quantized;                     // true if data stored as int16 with scale and offset per plane
+   float  qScale [N_FLOW_PLANES];
+   float  qOffset [N_FLOW_PLANES];
 } Zone;
 
+/*! load restriction (GRIB_LOAD_BOX, GRIB_LOAD_MAX_STEP) and storage mode (GRIB_QUANTIZE) of decoded grib.
+   Part of key of grib cache and sidecar files */
+typedef struct {
+   double   latMin, lonLeft, latMax, lonRight;  // zeroed when box not active
+   int32_t  maxStep;
+   int32_t  quantize;
+} GribLoadKey;
+
+/*! settings of grib decoding taken from par (gribDecodeOfPar).
+   A background decoding works on a copy so that it never reads par */
+typedef struct {
+   GribLoadKey load;
+   int    threads;                       // GRIB_THREADS. 0: one per core
+   bool   sidecar;                       // GRIB_SIDECAR
+} GribDecode;
+
 /*! Point in isochrone */
 typedef struct {
    int    id;        // unique point Id
@@ -260,6 +346,15 @@ typedef struct {
    double orthoVmc;  // distance to the middle direction
 } Pp;
 
+/*! wind at one point, output of findWindGribBatch */
+typedef struct {
+   double u, v;      // m/s
+   double gust;      // m/s
+   double w;         // waves height
+   double twd, tws;  // true wind direction, speed in knots
+   double uCurr, vCurr; // current m/s, when resampled on wind grid (CURRENT_ON_WIND)
+} WindVal;
+
 /*! isochrone meta data */ 
 typedef struct {
    int    toIndexWp;       // index of waypoint targetted
@@ -395,6 +490,7 @@ typedef struct {
 typedef struct {
    int authent;                              // 1 if Authentication is enabled   
    int allwaysSea;                           // if 1 (true) then isSea is allways true. No earth avoidance !
+   int segmentCheck;                         // if 1 (true) segment from father to new point must not cross land
    int dashboardUTC;                         // true if VR Dashboard provide time in UTC. false if local time.
    int maxPoiVisible;                        // poi visible if <= maxPoiVisible
    int opt;                                  // 0 if no optimization, else number of opt algorithm
@@ -410,9 +506,26 @@ typedef struct {
    int jFactor;                              // factor for target point distance used in sectorOptimize
    int kFactor;                              // factor for target point distance used in sectorOptimize
    int nSectors;                             // number of sector for optimization by sector
+   int coarseFactor;                         // if > 1: coarse pass (tStep, cogStep x coarseFactor) then fine pass in corridor
+   double corridorWidth;                     // NM, half width of corridor around coarse route
+   double corridorTimeMargin;                // hours, time margin of corridor around coarse route
    char workingDir [MAX_SIZE_FILE_NAME];     // working directory
    char gribFileName [MAX_SIZE_FILE_NAME];   // name of grib file
    int  mostRecentGrib;                      // true if most recent grib in grib directory to be selected
+   int  gribCacheMb;                         // memory budget in MB for decoded grib files kept in cache
+   int  gribSidecar;                         // true if decoded grib written to and mapped from sidecar file
+   int  gribThreads;                         // number of threads for grib decoding. 0: one per core
+   int  gribQuantize;                        // true if wind and current data stored as int16 instead of float
+   int  currentOnWind;                       // true if current resampled on wind grid for routing: one lookup for both
+   int  gribWatch;                           // true if server decodes new grib files in background (inotify)
+   double gribLoadLatMin;                    // load box of grib files. Ignored if gribLoadLatMax <= gribLoadLatMin
+   double gribLoadLonLeft;
+   double gribLoadLatMax;
+   double gribLoadLonRight;
+   int  gribLoadMaxStep;                     // max forecast step in hours loaded from grib files. 0: all
+   char gribLayerFileName [MAX_N_GRIB_LAYERS][MAX_SIZE_FILE_NAME]; // composite wind: gribs over wind grib, decreasing priority
+   int  nGribLayers;                         // number of grib layers
+   double gribLayerBlend;                    // composite wind: width in degrees of blending band at layer edges
    double gribResolution;                    // grib lat step for mail request
    int gribTimeStep;                         // grib time step for mail request
    int gribTimeMax;                          // grib time max fir mail request
@@ -425,6 +538,7 @@ typedef struct {
    char helpFileName [MAX_SIZE_FILE_NAME];   // name of html help file
    char shpFileName [MAX_N_SHP_FILES][MAX_SIZE_FILE_NAME];    // name of SHP file for geo map
    char isSeaFileName [MAX_SIZE_FILE_NAME];  // name of file defining sea on earth
+   char coastFileName [MAX_SIZE_FILE_NAME];  // name of file with high resolution coastal tiles of isSea
    char cliHelpFileName [MAX_SIZE_FILE_NAME];// text help for cli mode
    char poiFileName [MAX_SIZE_FILE_NAME];    // list of point of interest
    char portFileName [MAX_SIZE_FILE_NAME];   // list of ports
@@ -486,8 +600,7 @@ typedef struct {
    char imapMailBox [MAX_SIZE_NAME];         // IMAP mail box
    char mailPw [MAX_SIZE_NAME];              // password for smtp and imap
    bool storeMailPw;                         // store Mail PW
-   int  nForbidZone;                         // number of forbidden zones
-   //char forbidZone [MAX_N_FORBID_ZONE][MAX_SIZE_LINE]; // array of forbid zones
+   int  nForbidZone;                         // number of forbidden zone rings (forbidZones)
    int techno;                               // additionnal info display for tech experts
    struct {                                  // list of NEMEA ports with for each item, portName and speed 
       char portName [MAX_SIZE_NAME];
@@ -6,7 +6,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <dirent.h>
 #include <unistd.h>
 #include <time.h>
@@ -16,6 +19,10 @@
 #include "r3types.h"
 #include "grib.h"
 #include "inline.h"
+#include "gribcatalog.h"
+#include "coast.h"
+#include "forbidzone.h"
+#include "poi.h"
 
 /* For virtual regatta Stamina calculation */
 struct {
@@ -28,9 +35,6 @@ struct {
    {"Normal", 1.0, {300, 300, 336}, {660, 660, 480}}
 };
 
-/*! forbid ones is a set of polygons */
-MyPolygon forbidZones [MAX_N_FORBID_ZONE];
-
 /*! dictionnary of meteo services */
 const struct MeteoElmt meteoTab [N_METEO_ADMIN] = {{7, "Weather service US"}, {78, "DWD Germany"}, {85, "Meteo France"}, {98,"ECMWF European"}};
 
@@ -58,7 +62,7 @@ PolMat wavePolMat;
 Par par;
 
 /*! table describing if sea or earth */
-char *tIsSea = NULL; 
+uint8_t *tIsSea = NULL; 
 
 /*! geographic zone covered by grib file */
 Zone zone;                             // wind
@@ -167,6 +171,86 @@ void initZone (Zone *zone) {
    printf ("%s\n", buffer);
 }
 
+/*! grib decoding settings of current parameters. Box is zeroed when not active */
+GribDecode gribDecodeOfPar (void) {
+   GribDecode dec;
+   memset (&dec, 0, sizeof dec);
+   if (par.gribLoadLatMax > par.gribLoadLatMin) {
+      dec.load.latMin = par.gribLoadLatMin;
+      dec.load.lonLeft = par.gribLoadLonLeft;
+      dec.load.latMax = par.gribLoadLatMax;
+      dec.load.lonRight = par.gribLoadLonRight;
+   }
+   dec.load.maxStep = MAX (par.gribLoadMaxStep, 0);
+   dec.load.quantize = par.gribQuantize ? 1 : 0;
+   dec.threads = par.gribThreads;
+   dec.sidecar = par.gribSidecar;
+   return dec;
+}
+
+/*! Restrict zone read from grib file to load box and max step of load before decoding.
+   Time stamps after load->maxStep are dropped (first one always kept).
+   Grid is cut to the points covering the box, aligned on the grib grid. For a global grid
+   the box may cross the first meridian of the grid.
+   Return false if box does not intersect zone */
+bool zoneRestrict (Zone *zone, const GribLoadKey *load) {
+   const double eps = 1e-6;
+   if ((load->maxStep > 0) && (zone->nTimeStamp > 1)) {
+      size_t n = 1;
+      while ((n < zone->nTimeStamp) && (zone->timeStamp [n] <= load->maxStep)) n += 1;
+      if (n < zone->nTimeStamp) {
+         zone->nTimeStamp = n;
+         zone->intervalLimit = 0;
+         if (n > 1) {
+            zone->intervalEnd = zone->timeStamp [n - 1] - zone->timeStamp [n - 2];
+            for (size_t i = 1; i < n; i++) {
+               if ((zone->timeStamp [i] - zone->timeStamp [i - 1]) == zone->intervalEnd) {
+                  zone->intervalLimit = i;
+                  break;
+               }
+            }
+         }
+      }
+   }
+   if ((load->latMax <= load->latMin) || (zone->latStep <= 0) || (zone->lonStep <= 0))
+      return true;
+
+   const long iLat0 = MAX (0, (long) floor ((load->latMin - zone->latMin) / zone->latStep + eps));
+   const long iLat1 = MIN (zone->nbLat - 1, (long) ceil ((load->latMax - zone->latMin) / zone->latStep - eps));
+
+   // longitudes of box relative to lonLeft of zone, in [0, 360)
+   const long nLon360 = lround (360.0 / zone->lonStep);
+   double d0 = fmod (load->lonLeft - zone->lonLeft, 360.0);
+   if (d0 < 0) d0 += 360.0;
+   double width = fmod (load->lonRight - load->lonLeft, 360.0);
+   if (width <= 0) width += 360.0;
+   long iLon0 = (long) floor (d0 / zone->lonStep + eps);
+   long iLon1 = (long) ceil ((d0 + width) / zone->lonStep - eps);
+   if (zone->nbLon >= nLon360)                       // global grid: indexes beyond nbLon wrap
+      iLon1 = MIN (iLon1, iLon0 + zone->nbLon - 1);
+   else {
+      if (iLon0 >= zone->nbLon) {                    // box begins west of zone
+         iLon0 = 0;
+         iLon1 -= nLon360;
+      }
+      iLon1 = MIN (iLon1, zone->nbLon - 1);
+   }
+   if ((iLat0 > iLat1) || (iLon0 > iLon1)) {
+      fprintf (stderr, "In zoneRestrict, Error load box does not intersect grib zone\n");
+      return false;
+   }
+
+   zone->latMin += iLat0 * zone->latStep;
+   zone->nbLat = iLat1 - iLat0 + 1;
+   zone->latMax = zone->latMin + (zone->nbLat - 1) * zone->latStep;
+   zone->nbLon = iLon1 - iLon0 + 1;
+   zone->lonLeft = norm180 (zone->lonLeft + iLon0 * zone->lonStep);
+   zone->lonRight = norm180 (zone->lonLeft + (zone->nbLon - 1) * zone->lonStep);
+   zone->anteMeridian = (zone->lonLeft > 0.0) && (zone->lonRight < 0.0);
+   zone->numberOfValues = zone->nbLat * zone->nbLon;
+   return true;
+}
+
 /*! return the name of the sail */
 char *fSailName (int val, char *str, size_t maxLen) {
    if (val > 0 && val <= (int) polMat.nSail) strlcpy (str, polMat.tSail[val-1].name, maxLen);
@@ -235,39 +319,34 @@ bool hasSlash(const char *name) {
 }
 
 /*! select most recent file in "directory" that contains "pattern0" and "pattern1" in name 
-  return true if found with name of selected file */
+  return true if found with name of selected file. Directory content comes from catalog (no rescan) */
 bool mostRecentFile (const char *directory, const char *pattern0, const char *pattern1, char *name, size_t maxLen) {
-   DIR *dir = opendir (directory);
-   if (dir == NULL) {
+   const CatalogFile *files;
+   size_t n;
+   if (! catalogFiles (directory, &files, &n)) {
       fprintf (stderr, "In mostRecentFile, Error opening: %s\n", directory);
       return false;
    }
 
-   struct dirent *entry;
-   struct stat statbuf;
    time_t latestTime = 0;
-   char filepath [MAX_SIZE_DIR_NAME + MAX_SIZE_FILE_NAME];
-
-   while ((entry = readdir(dir)) != NULL) {
-      snprintf (filepath, sizeof (filepath), "%s%s%s", directory, hasSlash(directory) ? "" : "/", entry->d_name);
-      if ((strstr (entry->d_name, pattern0) != NULL) 
-         && (strstr (entry->d_name, pattern1) != NULL)
-         && (stat(filepath, &statbuf) == 0) 
-         && (S_ISREG(statbuf.st_mode) 
-         && (statbuf.st_size > 0)  // select file only if not empty
-         && statbuf.st_mtime > latestTime)) {
-
-         latestTime = statbuf.st_mtime;
-         if (strlen (entry->d_name) < maxLen)
-            snprintf (name, maxLen, "%s/%s", directory, entry->d_name);
+
+   for (size_t i = 0; i < n; i++) {
+      if ((strstr (files [i].name, pattern0) != NULL) 
+         && (strstr (files [i].name, pattern1) != NULL)
+         && (strstr (files [i].name, SIDECAR_SUFFIX) == NULL) // decoded grib sidecar is not a grib
+         && (files [i].size > 0)  // select file only if not empty
+         && (files [i].mtime > latestTime)) {
+
+         latestTime = files [i].mtime;
+         if (strlen (files [i].name) < maxLen)
+            snprintf (name, maxLen, "%s/%s", directory, files [i].name);
          else {
             fprintf (stderr, "In mostRecentFile, Error File name:%s size is: %zu and exceed Max Size: %zu\n", \
-               entry->d_name, strlen (entry->d_name), maxLen);
+               files [i].name, strlen (files [i].name), maxLen);
             break;
          }
       }
    }
-   closedir(dir);
    return (latestTime > 0);
 }
 
@@ -579,93 +658,288 @@ char *lonToStr (double lon, int type, char *str, size_t maxLen) {
    return str;
 }
 
-/*! read issea file and fill table tIsSea. Return pointer*/
-char *readIsSea (const char *fileName) {
+/*! header of binary isSea file, followed by SIZE_IS_SEA_BITS bytes: bit (i & 7) of byte (i >> 3) is cell i */
+typedef struct {
+   char     magic [8];                  // IS_SEA_MAGIC
+   uint32_t nLon;                       // IS_SEA_N_LON
+   uint32_t nLat;                       // IS_SEA_N_LAT
+} IsSeaHeader;
+
+static void *isSeaMapBase = NULL;       // mmap of binary isSea file, NULL if table in heap
+static size_t isSeaMapLen = 0;
+static void forbidReset (void);
+
+/*! read text isSea file (one char '0' or '1' per cell) and return bit packed table allocated in heap */
+static uint8_t *readIsSeaText (const char *fileName) {
    FILE *f = NULL;
+   uint8_t *t = NULL;
+   char buf [65536];
+   size_t nRead;
    int i = 0;
-   char c;
-   char *tIsSea = NULL;
-   int nSea = 0;
    if ((f = fopen (fileName, "r")) == NULL) {
       fprintf (stderr, "In readIsSea, Error cannot open: %s\n", fileName);
       return NULL;
    }
-	 if ((tIsSea = (char *) malloc (SIZE_T_IS_SEA + 1)) == NULL) {
-		 fprintf (stderr, "In readIsSea, error Malloc");
-     fclose (f);
-		 return NULL;
-	 }
-
-   while (((c = fgetc (f)) != -1) && (i < SIZE_T_IS_SEA)) {
-      if (c == '1') nSea += 1;
-      tIsSea [i] = c - '0';
-      i += 1;
+   if ((t = calloc (SIZE_IS_SEA_BITS, 1)) == NULL) {
+      fprintf (stderr, "In readIsSea, error Malloc");
+      fclose (f);
+      return NULL;
+   }
+   while ((i < SIZE_T_IS_SEA) && ((nRead = fread (buf, 1, sizeof buf, f)) > 0)) {
+      for (size_t k = 0; (k < nRead) && (i < SIZE_T_IS_SEA); k++, i++)
+         if (buf [k] == '1') t [i >> 3] |= (uint8_t) (1u << (i & 7));
    }
    fclose (f);
-   // printf ("isSea file     : %s, Size: %d, nIsea: %d, Proportion sea: %lf\n", fileName, i, nSea, (double) nSea/ (double) i); 
-   return tIsSea;
+   return t;
+}
+
+/*! map binary isSea file. Private mapping: pages written by updateIsSeaWithForbiddenAreas are copied,
+   others are shared with other processes. return NULL if fileName is not a valid binary isSea file */
+static uint8_t *readIsSeaBin (const char *fileName) {
+   IsSeaHeader h;
+   struct stat st;
+   const int fd = open (fileName, O_RDONLY);
+   if (fd < 0) return NULL;
+   if ((fstat (fd, &st) != 0) || (pread (fd, &h, sizeof h, 0) != (ssize_t) sizeof h)
+      || (memcmp (h.magic, IS_SEA_MAGIC, sizeof h.magic) != 0)
+      || (h.nLon != IS_SEA_N_LON) || (h.nLat != IS_SEA_N_LAT)
+      || ((size_t) st.st_size != sizeof h + SIZE_IS_SEA_BITS)) {
+      close (fd);
+      return NULL;
+   }
+   void *base = mmap (NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+   close (fd);
+   if (base == MAP_FAILED) {
+      fprintf (stderr, "In readIsSea, Error mmap: %s\n", fileName);
+      return NULL;
+   }
+   isSeaMapBase = base;
+   isSeaMapLen = st.st_size;
+   return (uint8_t *) base + sizeof h;
+}
+
+/*! read issea file, binary (see isSeaToBin) or text, and return bit packed table.
+   Previous table must have been released by freeIsSea */
+uint8_t *readIsSea (const char *fileName) {
+   uint8_t *t = readIsSeaBin (fileName);
+   return (t != NULL) ? t : readIsSeaText (fileName);
 } 
 
+/*! release tIsSea, mapped or in heap */
+void freeIsSea (void) {
+   if (isSeaMapBase != NULL) munmap (isSeaMapBase, isSeaMapLen);
+   else free (tIsSea);
+   forbidReset ();
+   coastDistInvalidate ();
+   isSeaMapBase = NULL;
+   isSeaMapLen = 0;
+   tIsSea = NULL;
+}
+
+/*! convert text isSea file into binary bit packed file loadable by readIsSea with mmap */
+bool isSeaToBin (const char *textFileName, const char *binFileName) {
+   char tmpName [MAX_SIZE_FILE_NAME + 8];
+   IsSeaHeader h = {.nLon = IS_SEA_N_LON, .nLat = IS_SEA_N_LAT};
+   memcpy (h.magic, IS_SEA_MAGIC, sizeof h.magic);
+   uint8_t *t = readIsSeaText (textFileName);
+   if (t == NULL) return false;
+   snprintf (tmpName, sizeof tmpName, "%s.tmp", binFileName);
+   FILE *f = fopen (tmpName, "wb");
+   if (f == NULL) {
+      fprintf (stderr, "In isSeaToBin, Error cannot create: %s\n", tmpName);
+      free (t);
+      return false;
+   }
+   const bool ok = (fwrite (&h, sizeof h, 1, f) == 1) && (fwrite (t, SIZE_IS_SEA_BITS, 1, f) == 1);
+   free (t);
+   if ((fclose (f) != 0) || ! ok || (rename (tmpName, binFileName) != 0)) {
+      fprintf (stderr, "In isSeaToBin, Error writing: %s\n", binFileName);
+      remove (tmpName);
+      return false;
+   }
+   return true;
+}
+
 /*! fill str with polygon information */
-/*! return true if p is in polygon po
-  Ray casting algorithm */ 
-static bool isInPolygon (double lat, double lon, const MyPolygon *po) {
-   int i, j;
-   bool inside = false;
-   // printf ("isInPolygon lat:%.2lf lon: %.2lf\n", p.lat, p.lon);
-   for (i = 0, j = po->n - 1; i < po->n; j = i++) {
-      if ((po->points[i].lat > lat) != (po->points[j].lat > lat) &&
-         (lon < (po->points[j].lon - po->points[i].lon) * (lat - po->points[i].lat) / (po->points[j].lat - po->points[i].lat) + po->points[i].lon)) {
-         inside = !inside;
+/*! forbidden zone rasterized in tIsSea: identity of polygon and bounding box in isSea cells */
+typedef struct {
+   uint64_t hash;
+   int rowMin, rowMax, colMin, colMax;
+} ForbidApplied;
+
+static ForbidApplied *forbidApplied = NULL;   // zones rasterized in tIsSea
+static int nForbidApplied = 0;
+static uint8_t *isSeaPristine = NULL;         // tIsSea before forbidden zones, NULL until first zone
+
+/*! FNV-1a hash of points and sizes of rings po [0..nRings-1], points contiguous */
+static uint64_t polygonHash (const MyPolygon *po, int nRings) {
+   uint64_t h = 14695981039346656037ULL;
+   size_t nPoints = 0;
+   for (int r = 0; r < nRings; r++) {
+      nPoints += po [r].n;
+      h = (h ^ (uint64_t) po [r].n) * 1099511628211ULL;
+   }
+   const unsigned char *p = (const unsigned char *) po [0].points;
+   for (size_t k = 0; k < nPoints * sizeof (Point); k++) {
+      h ^= p [k];
+      h *= 1099511628211ULL;
+   }
+   return h;
+}
+
+/*! identity and bounding box in isSea cells of zone made of rings po [0..nRings-1] */
+static void forbidAppliedOf (const MyPolygon *po, int nRings, ForbidApplied *fa) {
+   double latMin = 90.0, latMax = -90.0, lonMin = 360.0, lonMax = -180.0;
+   for (int i = 0; i < po [0].n; i++) {          // holes inside outer ring
+      latMin = fmin (latMin, po [0].points [i].lat);
+      latMax = fmax (latMax, po [0].points [i].lat);
+      lonMin = fmin (lonMin, po [0].points [i].lon);
+      lonMax = fmax (lonMax, po [0].points [i].lon);
+   }
+   fa->hash = polygonHash (po, nRings);
+   fa->rowMin = CLAMP ((int) floor (-latMax * 10 + 900), 0, IS_SEA_N_LAT - 1);
+   fa->rowMax = CLAMP ((int) ceil (-latMin * 10 + 900), 0, IS_SEA_N_LAT - 1);
+   fa->colMin = CLAMP ((int) floor (lonMin * 10 + 1800), 0, IS_SEA_N_LON - 1);
+   fa->colMax = CLAMP ((int) ceil (lonMax * 10 + 1800), 0, IS_SEA_N_LON - 1);
+}
+
+/*! true if bounding boxes of a and b intersect */
+static inline bool forbidOverlap (const ForbidApplied *a, const ForbidApplied *b) {
+   return (a->rowMin <= b->rowMax) && (b->rowMin <= a->rowMax) && (a->colMin <= b->colMax) && (b->colMin <= a->colMax);
+}
+
+static int compareDouble (const void *a, const void *b) {
+   const double x = *(const double *) a, y = *(const double *) b;
+   return (x > y) - (x < y);
+}
+
+/*! set to land cells of tIsSea whose center is in zone made of rings po [0..nRings-1]. Scanline on rows of bounding box:
+   crossings of edges of all rings sorted, cells between pairs of crossings are inside (even-odd rule of ray casting,
+   holes excluded). cross: room for number of points of zone */
+static void forbidRasterize (const MyPolygon *po, int nRings, const ForbidApplied *fa, double *cross) {
+   for (int row = fa->rowMin; row <= fa->rowMax; row++) {
+      const double lat = 90.0 - row / 10.0;
+      int nCross = 0;
+      for (int r = 0; r < nRings; r++) {
+         for (int i = 0, j = po [r].n - 1; i < po [r].n; j = i++) {
+            const Point *a = &po [r].points [i], *b = &po [r].points [j];
+            if ((a->lat > lat) != (b->lat > lat))
+               cross [nCross++] = (b->lon - a->lon) * (lat - a->lat) / (b->lat - a->lat) + a->lon;
+         }
+      }
+      qsort (cross, nCross, sizeof (double), compareDouble);
+      for (int k = 0; k + 1 < nCross; k += 2) {
+         const int c0 = MAX ((int) ceil ((cross [k] + 180.0) * 10.0), fa->colMin);
+         const int c1 = MIN ((int) ceil ((cross [k + 1] + 180.0) * 10.0) - 1, fa->colMax);
+         for (int c = c0; c <= c1; c++) {
+            const int i = row * IS_SEA_N_LON + c;
+            tIsSea [i >> 3] &= (uint8_t) ~(1u << (i & 7));
+            if (isCoastal (i)) memset ((uint8_t *) coastTile (i), 0, COAST_TILE_BYTES); // whole cell land
+         }
       }
    }
-   return inside;
 }
 
-/*! return true if p is in forbid area */ 
-static bool isInForbidArea (double lat, double lon) {
-   for (int i = 0; i < par.nForbidZone; i++) {
-      if (isInPolygon (lat, lon, &forbidZones [i])) return true;
+/*! restore cells of bounding box of fa from pristine mask and coastal tiles file */
+static void forbidRestore (const ForbidApplied *fa) {
+   for (int row = fa->rowMin; row <= fa->rowMax; row++) {
+      for (int c = fa->colMin; c <= fa->colMax; c++) {
+         const int i = row * IS_SEA_N_LON + c;
+         const uint8_t bit = (uint8_t) (1u << (i & 7));
+         tIsSea [i >> 3] = (tIsSea [i >> 3] & ~bit) | (isSeaPristine [i >> 3] & bit);
+         if (isCoastal (i)) coastTileRestore (i);
+      }
    }
-   return false;
 }
 
-/*! complement according to forbidden areas */
+/*! forget forbidden zones rasterized, with pristine mask */
+static void forbidReset (void) {
+   free (forbidApplied);
+   free (isSeaPristine);
+   forbidApplied = NULL;
+   isSeaPristine = NULL;
+   nForbidApplied = 0;
+}
+
+/*! complement according to forbidden areas. Incremental: zones already rasterized and unchanged are kept,
+   zones removed or changed are restored from pristine mask, then new zones and zones overlapping
+   restored areas are rasterized */
 void updateIsSeaWithForbiddenAreas (void) {
    if (tIsSea == NULL) return;
-   if (par.nForbidZone <= 0) return;
-   for (int i = 0; i < SIZE_T_IS_SEA; i++) {
-      const double lon = (i % 3601) / 10.0 - 180.0;
-      const double lat = 90.0 - (i / (3601.0 * 10.0));
-      if (isInForbidArea (lat, lon)) tIsSea [i] = 0;
+   const int nZone = forbidNPolygons ();
+   ForbidApplied *cur = calloc (MAX (nZone, 1), sizeof (ForbidApplied));
+   bool *isNew = calloc (MAX (nZone, 1), sizeof (bool));
+   bool *isRemoved = calloc (MAX (nForbidApplied, 1), sizeof (bool));
+   int *first = malloc ((nZone + 1) * sizeof (int));   // rings of zone z: first [z] .. first [z + 1] - 1
+   double *cross = NULL;
+   int maxPoints = 0, nNew = 0, nRemoved = 0;
+   if ((cur == NULL) || (isNew == NULL) || (isRemoved == NULL) || (first == NULL)) {
+      fprintf (stderr, "In updateIsSeaWithForbiddenAreas, Error Malloc\n");
+      goto end;
+   }
+   for (int r = 0, z = -1; r < par.nForbidZone; r++)
+      if (forbidZones [r].zone != z) first [z = forbidZones [r].zone] = r;
+   first [nZone] = par.nForbidZone;
+   for (int z = 0; z < nZone; z++) {
+      int nPoints = 0;
+      for (int r = first [z]; r < first [z + 1]; r++) nPoints += forbidZones [r].n;
+      forbidAppliedOf (&forbidZones [first [z]], first [z + 1] - first [z], &cur [z]);
+      maxPoints = MAX (maxPoints, nPoints);
+      isNew [z] = true;
+      for (int a = 0; a < nForbidApplied; a++)
+         if (memcmp (&forbidApplied [a], &cur [z], sizeof (ForbidApplied)) == 0) isNew [z] = false;
+      nNew += isNew [z];
    }
+   for (int a = 0; a < nForbidApplied; a++) {
+      isRemoved [a] = true;
+      for (int z = 0; z < nZone; z++)
+         if (memcmp (&forbidApplied [a], &cur [z], sizeof (ForbidApplied)) == 0) isRemoved [a] = false;
+      nRemoved += isRemoved [a];
+   }
+   if ((nNew == 0) && (nRemoved == 0)) goto end;   // same zones
+
+   if ((cross = malloc (MAX (maxPoints, 1) * sizeof (double))) == NULL) {
+      fprintf (stderr, "In updateIsSeaWithForbiddenAreas, Error Malloc\n");
+      goto end;
+   }
+   if (isSeaPristine == NULL) {                    // first zones: mask still pristine
+      if ((isSeaPristine = malloc (SIZE_IS_SEA_BITS)) == NULL) {
+         fprintf (stderr, "In updateIsSeaWithForbiddenAreas, Error Malloc\n");
+         goto end;
+      }
+      memcpy (isSeaPristine, tIsSea, SIZE_IS_SEA_BITS);
+   }
+   for (int a = 0; a < nForbidApplied; a++)
+      if (isRemoved [a]) forbidRestore (&forbidApplied [a]);
+   for (int z = 0; z < nZone; z++) {
+      bool redo = isNew [z];
+      for (int a = 0; (a < nForbidApplied) && ! redo; a++)
+         redo = isRemoved [a] && forbidOverlap (&forbidApplied [a], &cur [z]);
+      if (redo) forbidRasterize (&forbidZones [first [z]], first [z + 1] - first [z], &cur [z], cross);
+   }
+   free (forbidApplied);
+   forbidApplied = cur;
+   nForbidApplied = nZone;
+   cur = NULL;
+   coastDistInvalidate ();
+end:
+   free (cur);
+   free (isNew);
+   free (isRemoved);
+   free (first);
+   free (cross);
 }
 
 /*! read forbid zone format
    [[lat, lon], [lat, lon] ...]
 ...*/
-static void forbidZoneAdd (char *line, int n) {
-   int idx = 0;
+static void forbidZoneAdd (char *line) {
    char *latToken, *lonToken;
-   // printf ("Forbid Zone    : %d\n", n);
-   Point *temp = (Point *) realloc (forbidZones [n].points, MAX_SIZE_FORBID_ZONE * sizeof(Point));
-   if (temp == NULL) {
-      fprintf (stderr, "In forbidZoneAdd, Error realloc with n = %d\n", n);
-      return;
-   }
-   forbidZones [n].points = temp;
-   
    if (((latToken = strtok (line, ",")) == NULL) || ((lonToken = strtok (NULL, "]")) == NULL)) return;
-   forbidZones [n].points[idx].lat = getCoord (latToken, MIN_LAT, MAX_LAT);  
-   forbidZones [n].points[idx].lon = getCoord (lonToken, MIN_LON, MAX_LON);
-   idx = 1;
-   while ((idx < MAX_SIZE_FORBID_ZONE) && ((latToken = strtok (NULL, ",")) != NULL) && ((lonToken = strtok (NULL, "]")) != NULL)) {
-      // printf ("latToken: %s, lonToken: %s\n", latToken, lonToken);
-      forbidZones [n].points[idx].lat = getCoord (latToken, MIN_LAT, MAX_LAT);  
-      forbidZones [n].points[idx].lon = getCoord (lonToken, MIN_LON, MAX_LON);
-      idx += 1;
-   }
-   forbidZones [n].n = idx;
+   do {
+      if (! forbidPointAdd (getCoord (latToken, MIN_LAT, MAX_LAT), getCoord (lonToken, MIN_LON, MAX_LON))) return;
+   } while (((latToken = strtok (NULL, ",")) != NULL) && ((lonToken = strtok (NULL, "]")) != NULL));
+   forbidRingClose (false);
 }
 
 /*! read parameter file and build par struct */
@@ -676,6 +950,7 @@ bool readParam (const char *fileName, bool initDisp) {
    char str [MAX_SIZE_LINE], strLat [MAX_SIZE_NAME] = "", strLon [MAX_SIZE_NAME] = "";
    char buffer [MAX_SIZE_TEXT];
    char *pLine = &buffer [0];
+   forbidZonesFree ();
    memset (&par, 0, sizeof (Par));
    par.opt = 1;
    par.tStep = 1.0;
@@ -686,6 +961,8 @@ bool readParam (const char *fileName, bool initDisp) {
    par.kFactor = 1;
    par.jFactor = 300;
    par.nSectors = MAX_N_SECTORS;
+   par.corridorWidth = 60.0;
+   par.corridorTimeMargin = 12.0;
    if (initDisp) {
       par.style = 1;
       par.showColors =2;
@@ -696,6 +973,8 @@ bool readParam (const char *fileName, bool initDisp) {
    par.xWind = 1.0;
    par.maxWind = 50.0;
    par.staminaVR = 100.0;
+   par.gribCacheMb = GRIB_CACHE_MB;
+   par.segmentCheck = 1;
    wayPoints.n = 0;
    wayPoints.totOrthoDist = 0.0;
    wayPoints.totLoxoDist = 0.0;
@@ -721,6 +1000,7 @@ bool readParam (const char *fileName, bool initDisp) {
       else if (sscanf (pLine, "DESC:%255[^\n]", par.description) > 0)
          g_strstrip (par.description);
       else if (sscanf (pLine, "ALLWAYS_SEA:%d", &par.allwaysSea) > 0);
+      else if (sscanf (pLine, "SEGMENT_CHECK:%d", &par.segmentCheck) > 0);
       else if (sscanf (pLine, "WD:%255s", par.workingDir) > 0);  // should be first !!!
       else if (sscanf (pLine, "POI:%255s", str) > 0) 
          buildRootName (str, par.poiFileName, sizeof (par.poiFileName));
@@ -781,12 +1061,22 @@ bool readParam (const char *fileName, bool initDisp) {
          buildRootName (str, par.gribFileName, sizeof (par.gribFileName));
       else if (sscanf (pLine, "CURRENT_GRIB:%255s", str) > 0)
          buildRootName (str, par.currentGribFileName, sizeof (par.currentGribFileName));
+      else if (sscanf (pLine, "GRIB_LAYER:%255s", str) > 0) {
+         if (par.nGribLayers < MAX_N_GRIB_LAYERS) {
+            buildRootName (str, par.gribLayerFileName [par.nGribLayers], sizeof (par.gribLayerFileName [0]));
+            par.nGribLayers += 1;
+         }
+         else fprintf (stderr, "In readParam, Error Number max of grib layers reached: %d\n", MAX_N_GRIB_LAYERS);
+      }
+      else if (sscanf (pLine, "GRIB_LAYER_BLEND:%lf", &par.gribLayerBlend) > 0);
       else if (sscanf (pLine, "WAVE_POL:%255s", str) > 0)
          buildRootName (str, par.wavePolFileName, sizeof (par.wavePolFileName));
       else if (sscanf (pLine, "POLAR:%255s", str) > 0)
          buildRootName (str, par.polarFileName, sizeof (par.polarFileName));
       else if (sscanf (pLine, "ISSEA:%255s", str) > 0)
          buildRootName (str, par.isSeaFileName, sizeof (par.isSeaFileName));
+      else if (sscanf (pLine, "COAST_TILES:%255s", str) > 0)
+         buildRootName (str, par.coastFileName, sizeof (par.coastFileName));
       else if (sscanf (pLine, "TIDES:%255s", str) > 0)
          buildRootName (str, par.tidesFileName, sizeof (par.tidesFileName));
       else if (sscanf (pLine, "MID_COUNTRY:%255s", str) > 0)
@@ -817,6 +1107,15 @@ bool readParam (const char *fileName, bool initDisp) {
       }
       else if (sscanf (pLine, "AUTHENT:%d", &par.authent) > 0);
       else if (sscanf (pLine, "MOST_RECENT_GRIB:%d", &par.mostRecentGrib) > 0);
+      else if (sscanf (pLine, "GRIB_CACHE_MB:%d", &par.gribCacheMb) > 0);
+      else if (sscanf (pLine, "GRIB_SIDECAR:%d", &par.gribSidecar) > 0);
+      else if (sscanf (pLine, "GRIB_THREADS:%d", &par.gribThreads) > 0);
+      else if (sscanf (pLine, "GRIB_LOAD_BOX:%lf,%lf,%lf,%lf", &par.gribLoadLatMin, &par.gribLoadLonLeft, 
+                       &par.gribLoadLatMax, &par.gribLoadLonRight) > 0);
+      else if (sscanf (pLine, "GRIB_LOAD_MAX_STEP:%d", &par.gribLoadMaxStep) > 0);
+      else if (sscanf (pLine, "GRIB_QUANTIZE:%d", &par.gribQuantize) > 0);
+      else if (sscanf (pLine, "CURRENT_ON_WIND:%d", &par.currentOnWind) > 0);
+      else if (sscanf (pLine, "GRIB_WATCH:%d", &par.gribWatch) > 0);
       else if (sscanf (pLine, "START_TIME:%lf", &par.startTimeInHours) > 0);
       else if (sscanf (pLine, "T_STEP:%lf", &par.tStep) > 0);
       else if (sscanf (pLine, "RANGE_COG:%d", &par.rangeCog) > 0);
@@ -857,6 +1156,9 @@ bool readParam (const char *fileName, bool initDisp) {
       else if (sscanf (pLine, "PENALTY1:%d", &par.penalty1) > 0);
       else if (sscanf (pLine, "PENALTY2:%d", &par.penalty2) > 0);
       else if (sscanf (pLine, "N_SECTORS:%d", &par.nSectors) > 0);
+      else if (sscanf (pLine, "COARSE_FACTOR:%d", &par.coarseFactor) > 0);
+      else if (sscanf (pLine, "CORRIDOR_WIDTH:%lf", &par.corridorWidth) > 0);
+      else if (sscanf (pLine, "CORRIDOR_TIME_MARGIN:%lf", &par.corridorTimeMargin) > 0);
       else if (sscanf (pLine, "WITH_WAVES:%d", &par.withWaves) > 0);
       else if (sscanf (pLine, "WITH_CURRENT:%d", &par.withCurrent) > 0);
       else if (sscanf (pLine, "ISOC_DISP:%d", &par.style) > 0);
@@ -880,13 +1182,7 @@ bool readParam (const char *fileName, bool initDisp) {
       else if (sscanf (pLine, "WINDY_API_KEY:%1024s", par.windyApiKey) > 0);
       else if (sscanf (pLine, "WEBKIT:%255[^\n]", par.webkit) > 0) g_strstrip (par.webkit);
       else if (strstr (pLine, "FORBID_ZONES:") != NULL) inForbidZone = true;
-      else if (inForbidZone && ((pt = strstr (pLine, "- [[")) != NULL)) {
-         if (par.nForbidZone < MAX_N_FORBID_ZONE) {
-            forbidZoneAdd (pLine + 2, par.nForbidZone);
-            par.nForbidZone += 1;
-         }
-         else fprintf (stderr, "In readParam, MAX_N_FORBID_ZONE: %d\n", MAX_N_FORBID_ZONE);
-      }
+      else if (inForbidZone && ((pt = strstr (pLine, "- [[")) != NULL)) forbidZoneAdd (pLine + 2);
       else if (sscanf (pLine, "SMTP_SERVER:%255s", par.smtpServer) > 0);
       else if (sscanf (pLine, "SMTP_USER_NAME:%255s", par.smtpUserName) > 0);
       else if (sscanf (pLine, "SMTP_TO:%255s", par.smtpTo) > 0);
@@ -937,6 +1233,7 @@ bool writeParam (const char *fileName, bool header, bool password, bool yaml) {
    fprintfNoNull (f, "DESC:             %s\n", par.description);
    fprintfNoNull (f, "WD:               %s\n", par.workingDir);
    fprintf (f, "ALLWAYS_SEA:      %d\n", par.allwaysSea);
+   fprintf (f, "SEGMENT_CHECK:    %d\n", par.segmentCheck);
    
    latToStr (par.pOr.lat, par.dispDms, strLat, sizeof (strLat));
    lonToStr (par.pOr.lon, par.dispDms, strLon, sizeof (strLon));
@@ -972,6 +1269,7 @@ bool writeParam (const char *fileName, bool header, bool password, bool yaml) {
    fprintfNoNull (f, "POLAR:            %s\n", par.polarFileName);
    fprintfNoNull (f, "WAVE_POL:         %s\n", par.wavePolFileName);
    fprintfNoNull (f, "ISSEA:            %s\n", par.isSeaFileName);
+   fprintfNoNull (f, "COAST_TILES:      %s\n", par.coastFileName);
    fprintfNoNull (f, "MID_COUNTRY:      %s\n", par.midFileName);
    fprintfNoNull (f, "TIDES:            %s\n", par.tidesFileName);
    fprintfNoNull (f, "HELP:             %s\n", par.helpFileName);
@@ -987,6 +1285,20 @@ bool writeParam (const char *fileName, bool header, bool password, bool yaml) {
    fprintfNoNull (f, "CURRENT_GRIB:     %s\n", par.currentGribFileName);
    fprintfNoNull (f, "CGRIB:            %s\n", par.gribFileName);
    fprintf (f, "MOST_RECENT_GRIB: %d\n", par.mostRecentGrib);
+   fprintf (f, "GRIB_CACHE_MB:    %d\n", par.gribCacheMb);
+   fprintfNoZero (f, "GRIB_SIDECAR:     %d\n", par.gribSidecar);
+   fprintfNoZero (f, "GRIB_THREADS:     %d\n", par.gribThreads);
+   if (par.gribLoadLatMax > par.gribLoadLatMin)
+      fprintf (f, "GRIB_LOAD_BOX:    %.2lf, %.2lf, %.2lf, %.2lf\n", 
+         par.gribLoadLatMin, par.gribLoadLonLeft, par.gribLoadLatMax, par.gribLoadLonRight);
+   fprintfNoZero (f, "GRIB_LOAD_MAX_STEP: %d\n", par.gribLoadMaxStep);
+   fprintfNoZero (f, "GRIB_QUANTIZE:    %d\n", par.gribQuantize);
+   fprintfNoZero (f, "CURRENT_ON_WIND:  %d\n", par.currentOnWind);
+   fprintfNoZero (f, "GRIB_WATCH:       %d\n", par.gribWatch);
+   for (int i = 0; i < par.nGribLayers; i++)
+      fprintf (f, "GRIB_LAYER:       %s\n", par.gribLayerFileName [i]);
+   if (par.gribLayerBlend > 0)
+      fprintf (f, "GRIB_LAYER_BLEND: %.2lf\n", par.gribLayerBlend);
    fprintf (f, "GRIB_RESOLUTION:  %.2lf\n", par.gribResolution);
    fprintfNoZero (f, "GRIB_TIME_STEP:   %d\n", par.gribTimeStep);
    fprintfNoZero (f, "GRIB_TIME_MAX:    %d\n", par.gribTimeMax);
@@ -1043,6 +1355,11 @@ bool writeParam (const char *fileName, bool header, bool password, bool yaml) {
    fprintf (f, "J_FACTOR:         %d\n", par.jFactor);
    fprintf (f, "K_FACTOR:         %d\n", par.kFactor);
    fprintf (f, "N_SECTORS:        %d\n", par.nSectors);
+   if (par.coarseFactor > 1) {
+      fprintf (f, "COARSE_FACTOR:    %d\n", par.coarseFactor);
+      fprintf (f, "CORRIDOR_WIDTH:   %.2lf\n", par.corridorWidth);
+      fprintf (f, "CORRIDOR_TIME_MARGIN: %.2lf\n", par.corridorTimeMargin);
+   }
    fprintfNoZero (f, "PYTHON:           %d\n", par.python);
    fprintfNoZero (f, "CURL_SYS:         %d\n", par.curlSys);
    fprintfNoNull (f, "SMTP_SCRIPT:      %s\n", par.smtpScript);
@@ -1061,7 +1378,7 @@ bool writeParam (const char *fileName, bool header, bool password, bool yaml) {
    for (int i = 0; i < par.nNmea; i++)
       fprintf (f, "NMEA:             %s %d\n", par.nmea [i].portName, par.nmea [i].speed); 
 
-   if (par.nForbidZone > 0) {
+   if ((par.nForbidZone > 0) && (par.forbidFileName [0] == '\0')) {   // zones of forbid file not duplicated
       fprintf (f, "FORBID_ZONES:\n");
       for (int i = 0; i < par.nForbidZone; i++) {
          fprintf (f, "  - [");
@@ -1161,40 +1478,16 @@ char *paramToStrJson (Par *par, char *out, size_t maxLen) {
    return out;
 }
 
-/*! return id and name of nearest port found in file fileName from lat, lon. return empty string if not found */
-int nearestPort (double lat, double lon, const char *fileName, char *res, size_t maxLen) {
-   const double minShomLat = 42.0;
-   const double maxShomLat = 52.0;
-   const double minShomLon = -6.0;
-   const double maxShomLon = 4.0;
-   double minDist = DBL_MAX;
-   FILE *f;
-   char str [MAX_SIZE_LINE];
-   double latPort, lonPort;
-   char portName [MAX_SIZE_NAME];
-   int id = 0, bestId = 0;
+/*! return id of nearest port of tides file fileName from lat, lon, its name in res and its distance in nm in *dist.
+   Ports kept in memory with spatial index (poi.c). return 0 and empty string if not found */
+int nearestPort (double lat, double lon, const char *fileName, char *res, size_t maxLen, double *dist) {
+   const PoiSet *s = poiSet (POI_PORT, fileName);
+   int k;
    res [0] = '\0';
-   if ((lat < minShomLat) || (lat > maxShomLat) || (lon < minShomLon) || (lon > maxShomLon))
-      return 0;
-
-   if ((f = fopen (fileName, "r")) == NULL) {
-      fprintf (stderr, "In nearestPort, Error cannot open: %s\n", fileName);
-      return 0;
-   }
-   while (fgets (str, MAX_SIZE_LINE, f) != NULL ) {
-      if (sscanf (str, "%lf,%lf,%63[^,],%d", &latPort, &lonPort, portName, &id) > 2) {
-         double d = orthoDist (lat, lon, latPort, lonPort);
-         if (d < minDist) {
-            minDist = d;
-            g_strstrip (portName);
-            strlcpy (res, portName, maxLen);
-            bestId = id;
-            //printf ("%s %.2lf %.2lf %.2lf %.2lf %.2lf \n", portName, d, lat, lon, latPort, lonPort);
-         }
-      }
-   }
-   fclose (f);
-   return bestId;
+   *dist = 0.0;
+   if ((s == NULL) || (poiNearest (s, lat, lon, 1, -1.0, &k, dist) == 0)) return 0;
+   strlcpy (res, s->t [k].name, maxLen);
+   return s->t [k].id;
 }
 
 /*! return seconds with decimals */
@@ -1243,181 +1536,20 @@ char *readTextFile (const char *fileName, char *errMessage, size_t maxLen) {
 
 /*! read CSV file marks (Virtual Regatta) */
 bool readMarkCSVToJson (const char *fileName, char *out, size_t maxLen) {
-   FILE *f = NULL;
-   char buffer [MAX_SIZE_TEXT_FILE];
-   char str [MAX_SIZE_TEXT];
-   char *what, *name, *id, *coord0, *coord1, *status, *end, *ptLon;
-   double lat0 = 0.0, lon0 = 0.0, lat1 = 0.0, lon1 = 0.0;
-   char empty [] = "";
-
-   if ((f = fopen (fileName, "r")) == NULL) {
+   const PoiSet *s = poiSet (POI_MARK, fileName);
+   if (s == NULL) {
       snprintf (out, maxLen,  "Error in readMarkCSVToJson: cannot open: %s\n", fileName);
       return false;
    }
-   strlcpy (out, "[\n", maxLen);
-   
-   while (fgets(buffer, sizeof buffer, f)) {
-      //buffer[strcspn(buffer, "\r\n")] = '\0';
-      char **t = g_strsplit(buffer, ";", -1);
-      if (t == NULL) continue;
-
-      what   = t[0] ? g_strstrip(t[0]) : empty;
-      name   = t[1] ? g_strstrip(t[1]) : empty;
-      id     = t[2] ? g_strstrip(t[2]) : empty;
-      coord0 = t[3] ? g_strstrip(t[3]) : empty;
-      coord1 = t[4] ? g_strstrip(t[4]) : empty;
-      status = t[5] ? g_strstrip(t[5]) : empty;
-
-      ptLon = coord0 ? strchr (coord0, '-') : NULL;
-      if (ptLon) *ptLon = '\0'; // cut coord end eliminate '-'
-      lat0 = getCoord (coord0, MIN_LAT, MAX_LAT);
-      lon0 = ptLon ? getCoord (ptLon + 1, MIN_LON, MAX_LON) : 0.0;
-
-      ptLon = coord1 ? strchr (coord1, '-') : NULL;
-      if (ptLon) *ptLon = '\0'; // cut coord end eliminate '-'
-      lat1 = getCoord (coord1, MIN_LAT, MAX_LAT);
-      lon1 = ptLon ? getCoord (ptLon + 1, MIN_LON, MAX_LON) : 0.0;
-
-      snprintf(str, sizeof str,
+   size_t len = strlcpy (out, "[\n", maxLen);
+   for (int i = 0; (i < s->n) && (len < maxLen); i++) {
+      const Poi *p = &s->t [i];
+      len += snprintf (out + len, maxLen - len,
          "  {\"what\": \"%s\", \"name\": \"%s\", \"id\": \"%s\", "
-         "\"lat0\": %.4lf, \"lon0\": %.4lf, \"lat1\": %.4lf, \"lon1\": %.4lf, \"status\": \"%s\"},\n",
-         what, name, id, lat0, lon0, lat1, lon1, status);
-
-      strlcat (out, str, maxLen);
-      g_strfreev(t);
-   }
-   end = strrchr (out, ',');
-   *end = '\0'; // trunk from last comma
-   strlcat (out, "\n]\n", maxLen);
-   fclose (f);
-   return true;
-}
-
-/**
- * @brief Reads a GeoJSON file and extracts forbidden zones as polygons.
- *
- * The function parses a GeoJSON FeatureCollection and reads all geometries
- * of type "Polygon". Only the first ring of each polygon is used (no holes).
- * GeoJSON coordinates are [lon, lat] but are stored as Point {lat, lon}.
- *
- * Memory for each polygon is dynamically allocated using realloc().
- *
- * @param fileName     Path to the GeoJSON file.
- * @param forbidZones  Array of polygons to fill.
- * @param maxZones     Maximum number of polygons that can be stored.
- * @param n            Output: number of polygons successfully read.
- *
- * @return true on success, false on error (file, format, or memory).
- */
-bool readGeoJson(const char *fileName, MyPolygon forbidZones[], int maxZones, int *n) {
-   char errMessage [MAX_SIZE_TEXT] = "";   
-   if (!fileName || !forbidZones || !n || maxZones <= 0) return false;
-   *n = 0;
-
-   char *txt = readTextFile(fileName, errMessage, sizeof(errMessage));
-   if (! txt) return false;
-   wipeSpace(txt); // txt  contain all JSON specification without spaces
-   if (txt[0] == '\0') { free (txt); return false; }
-
-   // init output
-   for (int i = 0; i < maxZones; i++) {
-      forbidZones[i].n = 0;
-      forbidZones[i].points = NULL;
-   }
-
-   const char *p = txt;
-
-   while (true) {
-      const char *cpos = strstr(p, "\"coordinates\"");
-      if (!cpos) break;
-
-      // Rough check that we're inside a Polygon feature (optional but helps)
-      bool isPolygon = false; 
-      {
-         const char *back = cpos;
-         for (int k = 0; k < 5000 && back > txt; k++, back--) {
-            if (back[0] == '{') break;
-         }
-         if (strstr(back, "\"type\"") && strstr(back, "Polygon")) isPolygon = true;
-      }
-
-      p = cpos + strlen("\"coordinates\"");
-
-      const char *b = strchr(p, '[');
-      if (!b) { free(txt); return false; }
-      p = b;
-
-      if (!isPolygon) { p++; continue; }
-
-      if (*n >= maxZones) { free(txt); return false; }
-
-      // Expect: coordinates: [[[lon,lat],[lon,lat], ... ], ...]
-      p = strstr (p, "[[["); //list of rings, ring0, first point in ring0
-      p += 3;
-      MyPolygon *poly = &forbidZones[*n];
-      poly->n = 0;
-      poly->points = NULL;
-
-      int cap = 0;
-
-      while (true) {
-         double lon = 0.0, lat = 0.0;
-         int consumed;
-         if (sscanf(p, "%lf,%lf] %n", &lon, &lat, &consumed) != 2) return false;
-         p += consumed;
-         // GeoJSON point order: [lon, lat]
-         if (poly->n >= MAX_SIZE_FORBID_ZONE) { free(txt); return false; }
-
-         if (poly->n >= cap) {
-            int newCap = (cap == 0) ? 64 : cap * 2;
-            if (newCap > MAX_SIZE_FORBID_ZONE) newCap = MAX_SIZE_FORBID_ZONE;
-
-            Point *temp = (Point *)realloc(poly->points, (size_t)newCap * sizeof(Point));
-            if (!temp) {
-               fprintf(stderr, "readGeoJson: realloc failed for zone %d\n", *n);
-               free(txt);
-               return false;
-            }
-            poly->points = temp;
-            cap = newCap;
-         }
-
-         poly->points[poly->n].lat = lat;
-         poly->points[poly->n].lon = lon;
-         poly->n++;
-
-         if (*p == ',') { // next point
-            p++;
-            if (*p++ != '[') { free (txt); return false; } 
-            continue;
-         }
-
-         if (*p == ']') { // end ring0
-            p++;
-            break;
-         }
-
-         free(txt);
-         return false;
-      }
-
-      // Skip remaining rings (holes) until end of rings list ']'
-      if (*p == ',') {
-         int depth = 0;
-         while (*p) {
-            if (*p == '[') depth++;
-            else if (*p == ']') {
-               if (depth == 0) { p++; break; }
-               depth--;
-            }
-            p++;
-         }
-      } else {
-         if (*p == ']') p++;
-      }
-      (*n)++;
+         "\"lat0\": %.4lf, \"lon0\": %.4lf, \"lat1\": %.4lf, \"lon1\": %.4lf, \"status\": \"%s\"}%s\n",
+         p->what, p->name, p->code, p->lat, p->lon, p->lat1, p->lon1, p->status, (i < s->n - 1) ? "," : "");
    }
-   free(txt);
+   strlcat (out, "]\n", maxLen);
    return true;
 }
 
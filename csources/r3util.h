@@ -3,6 +3,7 @@
 #pragma once
 #include "r3types.h"
 #include <stdbool.h>
+#include <stdint.h>
 
 extern Zone zone;                      // wind
 extern Zone currentZone;               // current
@@ -10,9 +11,6 @@ extern Zone currentZone;               // current
 /*! list of wayPoint */
 extern WayPointList wayPoints;
 
-/*! forbid zones */
-extern MyPolygon forbidZones [MAX_N_FORBID_ZONE];
-
 /*! Meteo service */
 extern struct MeteoElmt meteoTab [N_METEO_ADMIN];
 
@@ -29,7 +27,7 @@ extern PolMat wavePolMat;
 /*! parameters desciption */
 extern Par par;
 
-extern char *tIsSea;                   // array of byte. 0 if earth, 1 if sea
+extern uint8_t *tIsSea;                // bit packed table. bit 0 if earth, 1 if sea
 
 /*! for competitors */
 extern CompetitorsList competitors;
@@ -40,6 +38,8 @@ extern void   wipeSpace(char *str);
 extern void   normalizeSpaces (char *s);
 extern void   printFloat (char *buf, size_t len, double v);
 extern void   initZone (Zone *zone);
+extern GribDecode gribDecodeOfPar (void);
+extern bool   zoneRestrict (Zone *zone, const GribLoadKey *load);
 extern char   *epochToStr (time_t t, bool seconds, char *str, size_t len);
 extern struct tm gribDateToTm (long intDate, double nHours);
 extern bool   isDayLight (struct tm *tm0, double t, double lat, double lon);
@@ -61,7 +61,9 @@ extern char   *newDateWeekDay (long intDate, double myTime, char *res, size_t ma
 extern char   *newDateWeekDayVerbose (long intDate, double myTime, char *res, size_t maxLen);
 extern bool   readParam (const char *fileName, bool initDisp);
 extern bool   writeParam (const char *fileName, bool header, bool password, bool yaml);
-extern char   *readIsSea (const char *fileName);
+extern uint8_t *readIsSea (const char *fileName);
+extern void   freeIsSea (void);
+extern bool   isSeaToBin (const char *textFileName, const char *binFileName);
 extern void   updateIsSeaWithForbiddenAreas (void);
 extern bool   hasSlash (const char *name);
 extern bool   mostRecentFile (const char *directory, const char *pattern0, const char *pattern1, char *name, size_t maxLen);
@@ -69,10 +71,9 @@ extern double fPenalty (int shipIndex, int type, double tws, double energy, doub
 extern double fPointLoss (int shipIndex, int type, double tws, bool fullPack);
 extern double fTimeToRecupOnePoint (double tws);
 extern char   *paramToStrJson (Par *par, char *buffer, size_t maxLen);
-extern int    nearestPort (double lat, double lon, const char *fileName, char *str, size_t maxLen);
+extern int    nearestPort (double lat, double lon, const char *fileName, char *str, size_t maxLen, double *dist);
 extern double monotonic (void);
 extern char   *readTextFile (const char *fileName, char *errMessage, size_t maxLen);
 extern bool   readMarkCSVToJson (const char *fileName, char *out, size_t maxLen);
-extern bool   readGeoJson(const char *fileName, MyPolygon forbidZones[], int maxZones, int *n);
 
 
@@ -1,10 +1,11 @@
 /*! grib data description */
-extern FlowP *tGribData [];            // wind, current
+extern void *tGribData [];             // wind, current: N_FLOW_PLANES planes (u, v, g, w)
 
 extern char * gribReaderVersion (char *str, size_t maxLen);
 extern bool readGribLists (const char *fileName, Zone *zone);
 extern bool readGribParameters (const char *fileName, Zone *zone);
 extern bool readGribAll (const char *fileName, Zone *zone, int iFlow);
+extern bool readGribAllTo (const char *fileName, Zone *zone, int iFlow, void **data, const GribDecode *dec);
 
 
 
@@ -16,7 +16,11 @@
 #define EPSILON  0.001        // for approximat value
 #define GUST_GFS 180          // id of gust in GFS files
 
-FlowP *tGribData [2] = {NULL, NULL};   // wind, current
+#ifndef GRIB_DEBUG
+#define GRIB_DEBUG 0          // 1: check bulk extraction against codes_grib_iterator
+#endif
+
+void *tGribData [2] = {NULL, NULL};    // wind, current: N_FLOW_PLANES planes (u, v, g, w)
 
 /*! return version of ECCODE API */
 char *gribReaderVersion (char *str, size_t maxLen) {
@@ -29,10 +33,11 @@ static inline long indLat (double lat, const Zone *zone) {
    return (long) round ((lat - zone->latMin)/zone->latStep);
 }
 
-/*! return indice of lon in gribData wind or current */
+/*! return indice of lon in gribData wind or current, relative to lonLeft in [lonLeft, lonLeft + 360) */
 static inline long indLon (double lon, const Zone *zone) {
-   if (lon < zone->lonLeft) lon += 360;
-   return (long) round ((lon - zone->lonLeft)/zone->lonStep);
+   double d = fmod (lon - zone->lonLeft, 360.0);
+   if (d < -0.5 * zone->lonStep) d += 360.0;
+   return (long) round (d / zone->lonStep);
 }
 
 /*! Modify array with new value if not already in array. Return new array size*/
@@ -173,37 +178,114 @@ bool readGribParameters (const char *fileName, Zone *zone) {
    return true;
 }
 
-/*! find index in gribData table */
-static inline long indexOf (int timeStep, double lat, double lon, const Zone *zone) {
-   const long iLat = indLat (lat, zone);
-   const long iLon = indLon (lon, zone);
-   int iT = -1;
-   for (iT = 0; iT < (int) zone->nTimeStamp; iT++) {
+/*! find index of timeStep in zone->timeStamp, -1 if not found */
+static inline int indexOfTime (long timeStep, const Zone *zone) {
+   for (int iT = 0; iT < (int) zone->nTimeStamp; iT++) {
       if (timeStep == zone->timeStamp [iT])
-         break;
+         return iT;
    }
-   if (iT == -1) {
-      fprintf (stderr, "In indexOf, Error Cannot find index of time: %d\n", timeStep);
-      return -1;
+   fprintf (stderr, "In indexOfTime, Error Cannot find index of time: %ld\n", timeStep);
+   return -1;
+}
+
+/*! Regular lat lon geometry of one message, from grid keys */
+typedef struct {
+   long ni, nj;
+   long iScansNegatively, jScansPositively, jPointsAreConsecutive;
+   double lat1, lon1, di, dj;
+} GridGeom;
+
+/*! read geometry keys of message h. Return false if not available */
+static bool readGeom (codes_handle *h, GridGeom *g) {
+   if (codes_get_long (h, "Ni", &g->ni) != CODES_SUCCESS
+      || codes_get_long (h, "Nj", &g->nj) != CODES_SUCCESS
+      || codes_get_double (h, "latitudeOfFirstGridPointInDegrees", &g->lat1) != CODES_SUCCESS
+      || codes_get_double (h, "longitudeOfFirstGridPointInDegrees", &g->lon1) != CODES_SUCCESS
+      || codes_get_double (h, "iDirectionIncrementInDegrees", &g->di) != CODES_SUCCESS
+      || codes_get_double (h, "jDirectionIncrementInDegrees", &g->dj) != CODES_SUCCESS)
+      return false;
+   if (codes_get_long (h, "iScansNegatively", &g->iScansNegatively) != CODES_SUCCESS) g->iScansNegatively = 0;
+   if (codes_get_long (h, "jScansPositively", &g->jScansPositively) != CODES_SUCCESS) g->jScansPositively = 0;
+   if (codes_get_long (h, "jPointsAreConsecutive", &g->jPointsAreConsecutive) != CODES_SUCCESS) g->jPointsAreConsecutive = 0;
+   return (g->ni > 0) && (g->nj > 0);
+}
+
+/*! longitude of column i as the iterator gives it, normalized as in zone */
+static inline double geomLon (const GridGeom *g, long i, const Zone *zone) {
+   double lon = g->lon1 + (g->iScansNegatively ? -i : i) * g->di;
+   if (zone->anteMeridian) {
+      if (lon >= 360.0) lon -= 360.0;
+      if (lon < 0.0) lon += 360.0;
+      return lon;
    }
-   //printf ("iT: %d iLon :%d iLat: %d\n", iT, iLon, iLat); 
-   return  (iT * zone->nbLat * zone->nbLon) + (iLat * zone->nbLon) + iLon;
+   return norm180 (lon);
 }
 
-/*! read grib file using eccodes C API 
-   return true if OK */
-bool readGribAll (const char *fileName, Zone *zone, int iFlow) {
-   if ((iFlow == WIND && par.constWindTws > 0) || (iFlow == CURRENT && par.constCurrentS > 0)) { // constant wind or current. Dont read file
-      initZone (zone);
-      return true;
+/*! latitude of row j */
+static inline double geomLat (const GridGeom *g, long j) {
+   return g->lat1 + (g->jScansPositively ? j : -j) * g->dj;
+}
+
+/*! scatter values of one message into time slice iT of plane var (FLOW_U, FLOW_V, FLOW_G, FLOW_W).
+   Points outside zone (load box) are skipped */
+static bool scatterValues (const double *values, const GridGeom *g, int iT, int var, const Zone *zone, float *gribData) {
+   long *iLonOf = malloc (g->ni * sizeof (long));
+   if (iLonOf == NULL) {
+      fprintf (stderr, "In scatterValues, Error malloc\n");
+      return false;
+   }
+   for (long i = 0; i < g->ni; i++) {
+      iLonOf [i] = indLon (geomLon (g, i, zone), zone);
+      if (iLonOf [i] >= zone->nbLon) iLonOf [i] = -1;
+   }
+   float *slice = flowPlane (gribData, zone, var) + (long) iT * zone->nbLat * zone->nbLon;
+   for (long j = 0; j < g->nj; j++) {
+      const long iLat = indLat (geomLat (g, j), zone);
+      if (iLat < 0 || iLat >= zone->nbLat) continue;
+      float *row = slice + iLat * zone->nbLon;
+      for (long i = 0; i < g->ni; i++) {
+         if (iLonOf [i] < 0) continue;
+         row [iLonOf [i]] = values [g->jPointsAreConsecutive ? i * g->nj + j : j * g->ni + i];
+      }
+   }
+   free (iLonOf);
+   return true;
+}
+
+#if GRIB_DEBUG
+/*! compare bulk scatter in gribData with the iterator walk of message h */
+static void checkAgainstIterator (codes_handle *h, int iT, int var, const Zone *zone, const float *gribData) {
+   int err = 0;
+   double lat, lon, val;
+   long nDiff = 0, n = 0;
+   codes_iterator *iter = codes_grib_iterator_new (h, 0, &err);
+   if (err != CODES_SUCCESS) return;
+   while (codes_grib_iterator_next (iter, &lat, &lon, &val)) {
+      if (! (zone -> anteMeridian)) lon = norm180 (lon);
+      const long iLat = indLat (lat, zone), iLon = indLon (lon, zone);
+      if (iLat < 0 || iLat >= zone->nbLat || iLon >= zone->nbLon) continue;
+      const long iGrib = (long) iT * zone->nbLat * zone->nbLon + iLat * zone->nbLon + iLon;
+      if (fabs (flowPlane (gribData, zone, var) [iGrib] - val) > EPSILON) nDiff += 1;
+      n += 1;
    }
+   codes_grib_iterator_delete (iter);
+   fprintf (stderr, "In checkAgainstIterator, iT: %d, var: %d, points: %ld, mismatch: %ld\n", iT, var, n, nDiff);
+}
+#endif
+
+/*! read grib file using eccodes C API into *data (previous *data is freed),
+   restricted to load box and max step of dec. par is not read.
+   return true if OK */
+bool readGribAllTo (const char *fileName, Zone *zone, int iFlow, void **data, const GribDecode *dec) {
+   (void) iFlow;
    FILE* f = NULL;
    int err = 0;
-   long iGrib;
    long bitmapPresent  = 0, timeStep, oldTimeStep;
-   double lat, lon, val, indicatorOfParameter;
+   double indicatorOfParameter;
    char shortName [MAX_SIZE_SHORT_NAME];
-   size_t lenName;
+   size_t lenName, nValues, capValues = 0;
+   double *values = NULL;
+   GridGeom geom;
    //char str [MAX_SIZE_LINE];
    zone->wellDefined = false;
    if (! readGribLists (fileName, zone)) {
@@ -212,30 +294,31 @@ bool readGribAll (const char *fileName, Zone *zone, int iFlow) {
    if (! readGribParameters (fileName, zone)) {
       return false;
    }
+   if (! zoneRestrict (zone, &dec->load)) { // only load box and steps up to max step are stored
+      return false;
+   }
    if (zone -> nDataDate > 1) {
       fprintf (stderr, "In readGribAll, Error Grib file with more than 1 dataDate not supported nDataDate: %zu\n", 
          zone -> nDataDate);
       return false;
    }
 
-   if (tGribData [iFlow] != NULL) {
-      free (tGribData [iFlow]); 
-      tGribData [iFlow] = NULL;
+   if (*data != NULL) {
+      free (*data); 
+      *data = NULL;
    }
-   if ((tGribData [iFlow] = calloc ((zone->nTimeStamp + 1) * zone->nbLat * zone->nbLon, sizeof (FlowP))) == NULL) { // nTimeStamp + 1
-      fprintf (stderr, "In readGribAll, Error calloc tGribData [iFlow]\n");
+   if ((*data = calloc (N_FLOW_PLANES * flowPlaneLen (zone), sizeof (float))) == NULL) {
+      fprintf (stderr, "In readGribAll, Error calloc data\n");
       return false;
    }
    // printf ("In readGribAll.: %s allocated\n", 
-      // formatThousandSep (str, sizeof (str), sizeof(FlowP) * (zone->nTimeStamp + 1) * zone->nbLat * zone->nbLon));
+      // formatThousandSep (str, sizeof (str), N_FLOW_PLANES * sizeof (float) * flowPlaneLen (zone)));
    
    // Message handle. Required in all the ecCodes calls acting on a message.
    codes_handle* h = NULL;
-   // Iterator on lat/lon/values.
-   codes_iterator* iter = NULL;
    if ((f = fopen (fileName, "rb")) == NULL) {
-      free (tGribData [iFlow]); 
-      tGribData [iFlow] = NULL;
+      free (*data); 
+      *data = NULL;
       fprintf (stderr, "In readGribAll, Error Unable to open file %s\n", fileName);
       return false;
    }
@@ -258,6 +341,13 @@ bool readGribAll (const char *fileName, Zone *zone, int iFlow) {
       CODES_CHECK(codes_get_string (h, "shortName", shortName, &lenName), 0);
       CODES_CHECK(codes_get_long (h, "step", &timeStep), 0);
 
+      if ((dec->load.maxStep > 0) && (timeStep > zone->timeStamp [zone->nTimeStamp - 1])) { // after max step
+         codes_handle_delete (h);
+         h = NULL;
+         zone->nMessage += 1;
+         continue;
+      }
+
       long progressTime = timeStep - oldTimeStep;
 
       // check timeStep move well. This test is not very useful.
@@ -275,54 +365,68 @@ bool readGribAll (const char *fileName, Zone *zone, int iFlow) {
       err = codes_get_double(h, "indicatorOfParameter", &indicatorOfParameter);
       if (err != CODES_SUCCESS) 
          indicatorOfParameter = -1;
- 
-      // A new iterator on lat/lon/values is created from the message handle h.
-      iter = codes_grib_iterator_new(h, 0, &err);
-      if (err != CODES_SUCCESS) CODES_CHECK(err, 0);
- 
-      // Loop on all the lat/lon/values.
-      while (codes_grib_iterator_next(iter, &lat, &lon, &val)) {
-         if (! (zone -> anteMeridian))
-            lon = norm180 (lon);
-         // printf ("lon : %.2lf\n", lon);
-         iGrib = indexOf (timeStep, lat, lon, zone);
-   
-         if (iGrib <= -1) {
-            fprintf (stderr, "In readGribAll: Error iGrib : %ld\n", iGrib); 
-            free (tGribData [iFlow]); 
-            tGribData [iFlow] = NULL;
-            codes_handle_delete (h);
-            codes_grib_iterator_delete (iter);
-            iter = NULL;
-            h = NULL;
-            fclose (f);
-            return false;
+
+      int var = -1;                                                // plane of tGribData
+      if ((strcmp (shortName, "10u") == 0) || (strcmp (shortName, "ucurr") == 0)) var = FLOW_U;
+      else if ((strcmp (shortName, "10v") == 0) || (strcmp (shortName, "vcurr") == 0)) var = FLOW_V;
+      else if (strcmp (shortName, "gust") == 0) var = FLOW_G;
+      else if (strcmp (shortName, "swh") == 0) var = FLOW_W;      // waves
+      else if (indicatorOfParameter == GUST_GFS) var = FLOW_G;     // find gust in GFS file specific parameter = 180
+      if (var < 0) {                                               // not stored
+         codes_handle_delete (h);
+         h = NULL;
+         zone->nMessage += 1;
+         continue;
+      }
+
+      // whole value array at once, then scatter with geometry from keys
+      const int iT = indexOfTime (timeStep, zone);
+      bool ok = (iT >= 0) && readGeom (h, &geom) 
+         && (codes_get_size (h, "values", &nValues) == CODES_SUCCESS)
+         && (nValues == (size_t) (geom.ni * geom.nj));
+      if (ok && nValues > capValues) {
+         free (values);
+         capValues = nValues;
+         if ((values = malloc (capValues * sizeof (double))) == NULL) {
+            capValues = 0;
+            ok = false;
          }
-         // printf("%.2f %.2f %.2lf %ld %ld %s\n", lat, lon, val, timeStep, iGrib, shortName);
-         tGribData [iFlow] [iGrib].lat = lat; 
-         tGribData [iFlow] [iGrib].lon = lon; 
-         if ((strcmp (shortName, "10u") == 0) || (strcmp (shortName, "ucurr") == 0))
-            tGribData [iFlow] [iGrib].u = val;
-         else if ((strcmp (shortName, "10v") == 0) || (strcmp (shortName, "vcurr") == 0))
-            tGribData [iFlow] [iGrib].v = val;
-         else if (strcmp (shortName, "gust") == 0)
-            tGribData [iFlow] [iGrib].g = val;
-         else if (strcmp (shortName, "swh") == 0)     // waves
-            tGribData [iFlow] [iGrib].w = val;
-         else if (indicatorOfParameter == GUST_GFS)   // find gust in GFS file specific parameter = 180
-            tGribData [iFlow] [iGrib].g = val;
       }
-      codes_grib_iterator_delete (iter);
+      ok = ok && (codes_get_double_array (h, "values", values, &nValues) == CODES_SUCCESS)
+         && scatterValues (values, &geom, iT, var, zone, *data);
+      if (! ok) {
+         fprintf (stderr, "In readGribAll: Error extracting message: %d, shortName: %s\n", zone->nMessage, shortName); 
+         free (values);
+         free (*data); 
+         *data = NULL;
+         codes_handle_delete (h);
+         fclose (f);
+         return false;
+      }
+#if GRIB_DEBUG
+      checkAgainstIterator (h, iT, var, zone, *data);
+#endif
       codes_handle_delete (h);
-      iter = NULL;
       h = NULL;
       // printf ("nMessage: %d\n", zone->nMessage);
       zone->nMessage += 1;
    }
    // printf ("readGribAll:%s done.\n", fileName);
  
+   free (values);
    fclose (f);
    zone->wellDefined = true;
    return true;
 }
 
+/*! read grib file using eccodes C API into tGribData [iFlow] with settings of par
+   return true if OK */
+bool readGribAll (const char *fileName, Zone *zone, int iFlow) {
+   if ((iFlow == WIND && par.constWindTws > 0) || (iFlow == CURRENT && par.constCurrentS > 0)) { // constant wind or current. Dont read file
+      initZone (zone);
+      return true;
+   }
+   const GribDecode dec = gribDecodeOfPar ();
+   return readGribAllTo (fileName, zone, iFlow, &tGribData [iFlow], &dec);
+}
+
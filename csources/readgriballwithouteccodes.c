@@ -4,28 +4,35 @@
 #include <stdbool.h>
 #include <string.h>
 #include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "glibwrapper.h"
 #include "r3types.h"
 #include "r3util.h"
 #include "inline.h"
 
-FlowP *tGribData [2] = {NULL, NULL};   // wind, current
+void *tGribData [2] = {NULL, NULL};    // wind, current: N_FLOW_PLANES planes (u, v, g, w)
 
 /*! GRIB2 reader without ecCodes/GLib
  * Supports:
  *   - Section 3: GDT 3.0 (regular lat/lon), di/dj signs from La2/Lo2 (wrap 360°)
  *   - Section 4: PDT 4.x (lead time extracted), minimal metadata
- *   - Section 5: DRT 5.0 (simple packing) and 5.3 (IEEE float)
+ *   - Section 5: DRT 5.0 (simple packing), 5.2/5.3 (complex packing, 5.3 with spatial differencing)
+ *                and 5.4 (IEEE float, 32 or 64 bits)
  *   - Section 6: bitmap indicator 255 (none) or 0 (bitmap here). 254 (prev) -> unsupported
  *   - Section 7: data unpacking with/without bitmap
+ * Messages are decoded in parallel by GRIB_THREADS threads (0: one per core).
  * Variables mapped:
  *   - discipline 0, cat 2, param 2 -> "10u"  (10 m U wind)
  *   - discipline 0, cat 2, param 3 -> "10v"  (10 m V wind)
  *   - discipline 0, cat 2, param 22 -> "gust" (wind gust)
  *   - discipline 10, cat 0, param {3,5,8} -> "swh" (WW3 heights: HTSGW/WVHGT/SWELL)
- * Only these 4 contribute to timeStamp list and to FlowP fields.
+ * Only these 4 contribute to timeStamp list and to planes of tGribData.
  * Fot current, ucurr and vcurr replace 10 and 10v.
  * 
  *
@@ -93,7 +100,63 @@ static uint32_t bitGet(BitReader *br, int nbits){
    return v;
 }
 
+#define UNPACK_CHUNK 4096   // values unpacked per call before scaling
+
+/*! Bulk extraction of n unsigned integers of nbits (1..32) starting at bit bitPos.
+   Byte aligned 8, 12, 16 and 24 bits widths are specialised, other widths read
+   one 64 bits word per value; the last bytes go through bitGet. */
+static void unpackBits(const uint8_t *buf, size_t len, size_t bitPos, int nbits, size_t n, uint32_t *out){
+   size_t k = 0;
+   if((bitPos & 7) == 0 && (bitPos >> 3) < len){
+      const uint8_t *p = buf + (bitPos >> 3);
+      const size_t avail = len - (bitPos >> 3);
+      switch(nbits){
+      case 8:
+         for(; k < n && k < avail; k++) out[k] = p[k];
+         break;
+      case 12:
+         for(; k + 1 < n && (k/2)*3 + 3 <= avail; k += 2){
+            const uint8_t *q = p + (k/2)*3;
+            out[k]   = ((uint32_t)q[0] << 4) | (q[1] >> 4);
+            out[k+1] = ((uint32_t)(q[1] & 0x0f) << 8) | q[2];
+         }
+         break;
+      case 16:
+         for(; k < n && 2*k + 2 <= avail; k++)
+            out[k] = ((uint32_t)p[2*k] << 8) | p[2*k+1];
+         break;
+      case 24:
+         for(; k < n && 3*k + 3 <= avail; k++)
+            out[k] = ((uint32_t)p[3*k] << 16) | ((uint32_t)p[3*k+1] << 8) | p[3*k+2];
+         break;
+      default:
+         break;
+      }
+      bitPos += k * (size_t)nbits;
+   }
+   for(; k < n && (bitPos >> 3) + 8 <= len; k++){
+      const uint64_t w = rdU64BE(buf + (bitPos >> 3));
+      out[k] = (uint32_t)((w << (bitPos & 7)) >> (64 - nbits));
+      bitPos += (size_t)nbits;
+   }
+   BitReader br = {buf, len, bitPos};
+   for(; k < n; k++) out[k] = bitGet(&br, nbits);
+}
+
 #if GRIB_DEBUG
+/*! check bulk unpacker against bit by bit reader */
+static void debugCheckUnpack(const uint8_t *s7, size_t s7Len, int nbits, size_t n){
+   if(!s7 || nbits<=0 || nbits>32) return;
+   uint32_t *bulk = malloc(n * sizeof(uint32_t));
+   if(!bulk) return;
+   unpackBits(s7, s7Len, 0, nbits, n, bulk);
+   BitReader br; bitInit(&br, s7, s7Len);
+   size_t nDiff = 0;
+   for(size_t i=0;i<n;i++) if(bitGet(&br, nbits) != bulk[i]) nDiff++;
+   fprintf(stderr, "[S7] unpack check nbits=%d n=%zu: %zu mismatch\n", nbits, n, nDiff);
+   free(bulk);
+}
+
 static void debugPeekS7Integers(const uint8_t *s7, size_t s7Len, int nbits, int howMany){
    if(!s7 || s7Len==0 || nbits<=0) return;
    BitReader br; bitInit(&br, s7, s7Len);
@@ -355,39 +418,189 @@ static bool parseSec4(const uint8_t *s, uint32_t bodyLen, int discipline, Sec4In
    return true;
 }
 
+static int bmBitAt(const uint8_t *bm, size_t bmBytes, size_t k) {
+   if(!bm) return 1;               // no bitmap => all present
+   size_t byte = k >> 3;
+   if(byte >= bmBytes) return 1;   // safety
+   int bit = 7 - (int)(k & 7);
+   return ( (bm[byte] >> bit) & 1u );
+}
+
 // =============================== Section 5 ==================================
-// DRT 5.0 (simple packing) and 5.3 (IEEE float)
+// DRT 5.0 (simple packing), 5.2 (complex packing), 5.3 (complex packing with
+// spatial differencing) and 5.4 (IEEE float)
 typedef struct {
-   int drt;        // 0: simple packing, 3: IEEE float, else: unsupported
+   int drt;        // 0: simple, 2: complex, 3: complex + spatial diff, 4: IEEE float
+   uint32_t nData; // number of packed values in Section 7
    float refV;
    int16_t bScale;
    int16_t dScale;
-   int nBits;
+   int nBits;      // simple: bits per value, complex: bits per group reference
+   int precision;  // IEEE: 1 = 32 bits, 2 = 64 bits
+   // complex packing (5.2 / 5.3)
+   int missingMgmt;           // 0: none, 1: primary, 2: primary and secondary
+   uint32_t nGroups;
+   int refGroupWidth;
+   int nBitsGroupWidth;
+   uint32_t refGroupLength;
+   int groupLengthInc;
+   uint32_t lastGroupLength;
+   int nBitsGroupLength;
+   int orderSpatial;          // 5.3 only: 1 or 2
+   int nOctetsExtra;          // 5.3 only: size of extra descriptors
 } Sec5Info;
 
 static bool parseSec5(const uint8_t *s, uint32_t bodyLen, Sec5Info *out){
    if(!s || bodyLen < 5 || !out) return false;
    int drt = (int)rdU16BE(s+4);
-   if(drt == 0){
+   Sec5Info d = {0};
+   d.drt   = drt;
+   d.nData = rdU32BE(s+0);
+   if(drt == 0 || drt == 2 || drt == 3){
       if(bodyLen < 16) return false;
-      Sec5Info d;
-      d.drt    = 0;
       d.refV   = rdIEEE32BE(s+6);
 
       d.bScale = readS16beFlexible(s+10);
       d.dScale = readS16beFlexible(s+12);
 
       d.nBits  = (int)rdU8(s+14);
+      if(drt == 0){ *out = d; return true; }
+
+      if(bodyLen < ((drt == 3) ? 44u : 42u)) return false;
+      d.missingMgmt      = (int)rdU8(s+17);
+      d.nGroups          = rdU32BE(s+26);
+      d.refGroupWidth    = (int)rdU8(s+30);
+      d.nBitsGroupWidth  = (int)rdU8(s+31);
+      d.refGroupLength   = rdU32BE(s+32);
+      d.groupLengthInc   = (int)rdU8(s+36);
+      d.lastGroupLength  = rdU32BE(s+37);
+      d.nBitsGroupLength = (int)rdU8(s+41);
+      if(drt == 3){
+         d.orderSpatial = (int)rdU8(s+42);
+         d.nOctetsExtra = (int)rdU8(s+43);
+      }
       *out = d;
       return true;
-   } else if(drt == 3){
-      Sec5Info d = {0};
-      d.drt = 3;   // IEEE floats in Section 7
+   } else if(drt == 4){
+      if(bodyLen < 7) return false;
+      d.precision = (int)rdU8(s+6);   // IEEE floats in Section 7
       *out = d;
       return true;
    } else {
-      return false; // unsupported (e.g. 5.2, 5.40/41)
+      return false; // unsupported (e.g. 5.40/41 JPEG2000, 5.42 CCSDS)
+   }
+}
+
+/*! sign and magnitude integer on n octets (extra descriptors of 5.3) */
+static int64_t rdSignMag(const uint8_t *p, int n){
+   uint64_t v = 0;
+   for(int i=0;i<n;i++) v = (v<<8) | p[i];
+   const uint64_t sign = 1ULL << (8*n - 1);
+   return (v & sign) ? -(int64_t)(v & (sign-1)) : (int64_t)v;
+}
+
+static inline void bitAlign(BitReader *br){
+   br->bitpos = (br->bitpos + 7) & ~(size_t)7;
+}
+
+/*! Complex packing (5.2) and complex packing with spatial differencing (5.3).
+   Fill vals [nPts] honouring bitmap; missing values are NaN. */
+static bool unpackComplex(const Sec5Info *s5, const uint8_t *s7, size_t s7Len,
+                          const uint8_t *bm, size_t bmBytes, size_t nPts, float *vals){
+   const size_t ng = s5->nGroups;
+   const size_t nData = s5->nData;
+   if(s5->nBits > 32 || s5->nBitsGroupWidth > 32 || s5->nBitsGroupLength > 32) return false;
+
+   int64_t ival1 = 0, ival2 = 0, minsd = 0;
+   size_t off7 = 0;
+   if(s5->drt == 3){
+      const int n = s5->nOctetsExtra, order = s5->orderSpatial;
+      if(order < 1 || order > 2 || n < 1 || n > 4) return false;
+      if(s7Len < (size_t)(order + 1) * n) return false;
+      ival1 = rdSignMag(s7, n);
+      if(order == 2) ival2 = rdSignMag(s7 + n, n);
+      minsd = rdSignMag(s7 + order * n, n);
+      off7 = (size_t)(order + 1) * n;
+   }
+
+   uint32_t *gRef = malloc(ng * sizeof(uint32_t));
+   uint32_t *gLen = malloc(ng * sizeof(uint32_t));
+   uint8_t  *gWidth = malloc(ng);
+   int64_t  *iv = malloc((nData ? nData : 1) * sizeof(int64_t));
+   uint8_t  *miss = malloc(nData ? nData : 1);
+   bool ok = false;
+   if(!gRef || !gLen || !gWidth || !iv || !miss) goto end;
+
+   BitReader br; bitInit(&br, s7 + off7, s7Len - off7);
+   for(size_t g=0;g<ng;g++) gRef[g] = bitGet(&br, s5->nBits);
+   bitAlign(&br);
+   for(size_t g=0;g<ng;g++){
+      uint32_t w = (uint32_t)s5->refGroupWidth + bitGet(&br, s5->nBitsGroupWidth);
+      if(w > 32) goto end;
+      gWidth[g] = (uint8_t)w;
+   }
+   bitAlign(&br);
+   size_t total = 0;
+   for(size_t g=0;g<ng;g++){
+      gLen[g] = s5->refGroupLength + (uint32_t)s5->groupLengthInc * bitGet(&br, s5->nBitsGroupLength);
+      if(g == ng-1) gLen[g] = s5->lastGroupLength;
+      total += gLen[g];
+   }
+   bitAlign(&br);
+   if(total != nData) goto end;
+
+   // group unpacking: value = group reference + packed increment
+   const uint32_t refMiss1 = (s5->nBits > 0) ? (uint32_t)((1ULL << s5->nBits) - 1) : 0;
+   size_t k = 0;
+   for(size_t g=0;g<ng;g++){
+      const int w = gWidth[g];
+      if(w == 0){
+         uint8_t m = (s5->nBits > 0) &&
+                     ((s5->missingMgmt >= 1 && gRef[g] == refMiss1) ||
+                      (s5->missingMgmt == 2 && gRef[g] == refMiss1 - 1));
+         for(uint32_t l=0;l<gLen[g];l++){ iv[k] = gRef[g]; miss[k] = m; k++; }
+      } else {
+         const uint32_t maxV = (uint32_t)((1ULL << w) - 1);
+         for(uint32_t l=0;l<gLen[g];l++){
+            uint32_t x = bitGet(&br, w);
+            miss[k] = (s5->missingMgmt >= 1 && x == maxV) ||
+                      (s5->missingMgmt == 2 && x == maxV - 1);
+            iv[k] = (int64_t)gRef[g] + x;
+            k++;
+         }
+      }
+   }
+   if(br.bitpos > br.len * 8) goto end;
+
+   // spatial differencing reconstruction on non missing values
+   if(s5->drt == 3){
+      int64_t last = 0, penultimate = 0;
+      size_t c = 0;
+      for(size_t i=0;i<nData;i++){
+         if(miss[i]) continue;
+         if(c == 0) iv[i] = ival1;
+         else if(s5->orderSpatial == 2 && c == 1) iv[i] = ival2;
+         else if(s5->orderSpatial == 1) iv[i] += minsd + last;
+         else iv[i] += minsd + 2*last - penultimate;
+         penultimate = last;
+         last = iv[i];
+         c++;
+      }
+   }
+
+   const double twoE = ldexp(1.0, s5->bScale);
+   const double dec  = pow(10.0, -(double)s5->dScale);
+   k = 0;
+   for(size_t p=0;p<nPts;p++){
+      if(bmBitAt(bm, bmBytes, p) && k < nData){
+         vals[p] = miss[k] ? NAN : (float)((s5->refV + (double)iv[k] * twoE) * dec);
+         k++;
+      } else vals[p] = NAN;
    }
+   ok = true;
+end:
+   free(gRef); free(gLen); free(gWidth); free(iv); free(miss);
+   return ok;
 }
 
 // =============================== Section 6 ==================================
@@ -408,15 +621,19 @@ typedef struct {
    int haveS1, haveS3, haveS4, haveS5, haveS6, haveS7;
 } MsgParse;
 
-static int bmBitAt(const uint8_t *bm, size_t bmBytes, size_t k) {
-   if(!bm) return 1;               // no bitmap => all present
-   size_t byte = k >> 3;
-   if(byte >= bmBytes) return 1;   // safety
-   int bit = 7 - (int)(k & 7);
-   return ( (bm[byte] >> bit) & 1u );
+/* Row range [j0, j1] of grid g3 covering latitudes of clip. False if rows are not contiguous in scan */
+static bool clipRows(const Sec3Grid *g3, const Zone *clip, int *j0, int *j1){
+   if(!clip || !scanAdjI(g3->scanFlags) || scanBoustro(g3->scanFlags) || g3->dj == 0) return false;
+   double ja = (clip->latMin - g3->lat1) / g3->dj;
+   double jb = (clip->latMax - g3->lat1) / g3->dj;
+   *j0 = (int)MAX(0, floor(fmin(ja, jb) - 0.5));
+   *j1 = (int)MIN(g3->Nj - 1, ceil(fmax(ja, jb) + 0.5));
+   return *j0 <= *j1;
 }
 
-static int parseGrib2Message(const uint8_t *buf, size_t len, int wantData,
+/* Parse message. If wantData, decode values in *outValues.
+   If clip not NULL, simple packed rows outside latitudes of clip may be skipped (left NaN) */
+static int parseGrib2Message(const uint8_t *buf, size_t len, int wantData, const Zone *clip,
                              MsgParse *out, float **outValues)
 {
    if(len < 16 || memcmp(buf,"GRIB",4)!=0) return -1;
@@ -480,6 +697,7 @@ static int parseGrib2Message(const uint8_t *buf, size_t len, int wantData,
               sn, mp.s5.drt, (double)mp.s5.refV, (int)mp.s5.bScale,
               (int)mp.s5.dScale, (int)mp.s5.nBits, (unsigned)mp.sec7Len);
       if(mp.s5.drt==0 && mp.haveS7) debugPeekS7Integers(mp.sec7, mp.sec7Len, mp.s5.nBits, 12);
+      if(mp.s5.drt==0 && mp.haveS7) debugCheckUnpack(mp.sec7, mp.sec7Len, mp.s5.nBits, mp.s5.nData);
    }
 #endif
 
@@ -500,36 +718,75 @@ static int parseGrib2Message(const uint8_t *buf, size_t len, int wantData,
 
    if(mp.s5.drt == 0){
       /* Simple packing (5.0) with optional bitmap */
-      BitReader br; bitInit(&br, mp.sec7, mp.sec7Len);
       const double twoE = ldexp(1.0, mp.s5.bScale);
       const double dec  = pow(10.0, -(double)mp.s5.dScale);
+      const int nBits   = mp.s5.nBits;
 
-      if(mp.s5.nBits == 0){
+      if(nBits == 0){
          float v = (float)(mp.s5.refV * dec);
          for(size_t k=0;k<nPts;k++){
             vals[k] = bmBitAt(bm, bmBytes, k) ? v : NAN;
          }
+      } else if(nBits > 32){
+         free(vals); return -1;
       } else {
-         for(size_t k=0;k<nPts;k++){
-            if(bmBitAt(bm, bmBytes, k)){
-               uint32_t D = bitGet(&br, mp.s5.nBits);
-               double   X = mp.s5.refV + (double)D * twoE;
-               vals[k] = (float)(X * dec);
-            } else {
-               vals[k] = NAN;
+         // Y = (R + X * 2^E) * 10^-D folded into Y = a + b * X
+         const double a = mp.s5.refV * dec, b = twoE * dec;
+         uint32_t ibuf[UNPACK_CHUNK];
+         size_t bitPos = 0;
+         if(!bm){
+            size_t kBegin = 0, kEnd = nPts;
+            int j0, j1;
+            if(clipRows(&mp.s3, clip, &j0, &j1)){
+               kBegin = (size_t)j0 * (size_t)Ni;
+               kEnd   = (size_t)(j1 + 1) * (size_t)Ni;
+               for(size_t k=0;k<kBegin;k++) vals[k] = NAN;
+               for(size_t k=kEnd;k<nPts;k++) vals[k] = NAN;
+               bitPos = kBegin * (size_t)nBits;
+            }
+            for(size_t k0=kBegin;k0<kEnd;k0+=UNPACK_CHUNK){
+               const size_t n = (kEnd - k0 < UNPACK_CHUNK) ? kEnd - k0 : UNPACK_CHUNK;
+               unpackBits(mp.sec7, mp.sec7Len, bitPos, nBits, n, ibuf);
+               bitPos += n * (size_t)nBits;
+               float *restrict v = vals + k0;
+               for(size_t i=0;i<n;i++) v[i] = (float)(a + b * (double)ibuf[i]);
+            }
+         } else {
+            size_t i = 0, n = 0;
+            for(size_t k=0;k<nPts;k++){
+               if(bmBitAt(bm, bmBytes, k)){
+                  if(i == n){
+                     n = UNPACK_CHUNK; i = 0;
+                     unpackBits(mp.sec7, mp.sec7Len, bitPos, nBits, n, ibuf);
+                     bitPos += n * (size_t)nBits;
+                  }
+                  vals[k] = (float)(a + b * (double)ibuf[i++]);
+               } else {
+                  vals[k] = NAN;
+               }
             }
          }
       }
    }
-   else if(mp.s5.drt == 3){
-      /* IEEE floats in S7 (5.3), with optional bitmap */
+   else if(mp.s5.drt == 2 || mp.s5.drt == 3){
+      /* Complex packing (5.2), with spatial differencing (5.3) */
+      if(!unpackComplex(&mp.s5, mp.sec7, mp.sec7Len, bm, bmBytes, nPts, vals)){
+         free(vals); return -1;
+      }
+   }
+   else if(mp.s5.drt == 4){
+      /* IEEE floats in S7 (5.4), with optional bitmap */
       const uint8_t *q = mp.sec7;
+      const size_t size = (mp.s5.precision == 2) ? 8 : 4;
       size_t off7 = 0, nAvail = mp.sec7Len;
       for(size_t k=0;k<nPts;k++){
          if(bmBitAt(bm, bmBytes, k)){
-            if(off7 + 4 > nAvail){ free(vals); return -1; }
-            vals[k] = rdIEEE32BE(q + off7);
-            off7 += 4;
+            if(off7 + size > nAvail){ free(vals); return -1; }
+            if(size == 8){
+               uint64_t u = rdU64BE(q + off7); double x; memcpy(&x, &u, sizeof(double));
+               vals[k] = (float)x;
+            } else vals[k] = rdIEEE32BE(q + off7);
+            off7 += size;
          } else {
             vals[k] = NAN;
          }
@@ -537,7 +794,7 @@ static int parseGrib2Message(const uint8_t *buf, size_t len, int wantData,
    }
    else {
       free(vals);
-      return -1; // unsupported packing (e.g. 5.2 / 5.40 / 5.41)
+      return -1; // unsupported packing (e.g. 5.40 / 5.41)
    }
 
    if(outValues) *outValues = vals; else free(vals);
@@ -549,18 +806,13 @@ static inline long indLat(double lat, const Zone *zone){
    return (long)llround( (lat - zone->latMin) / zone->latStep );
 }
 
-// Wrap-aware longitude indexer around lonLeft in [lonLeft, lonLeft+360)
+// Wrap-aware longitude indexer around lonLeft in [lonLeft, lonLeft+360). -1 if outside zone
 static inline long indLonWrap(double lon, const Zone *zone){
-   double L = lon;
-   double base = zone->lonLeft;
-   // Normalise delta in [-180,180)
-   double d = L - base;
-   while(d < -180.0) d += 360.0;
-   while(d >= 180.0) d -= 360.0;
+   double d = fmod(lon - zone->lonLeft, 360.0);
+   if(d < -0.5 * zone->lonStep) d += 360.0;
+   if(d >= 360.0 - 0.5 * zone->lonStep) d -= 360.0;
    long i = (long)llround( d / zone->lonStep );
-   if(i < 0) i += zone->nbLon;
-   if(i >= zone->nbLon) i -= zone->nbLon;
-   return i;
+   return (i < zone->nbLon) ? i : -1;
 }
 
 static inline long idxTij(int iT, int iLon, int iLat, const Zone *zone){
@@ -576,44 +828,99 @@ static int findTimeIndex(long timeStep, const Zone *zone){
    return -1;
 }
 
-// ============================== Public: Lists ================================
-bool readGribLists(const char *fileName, Zone *zone){
-   if(!fileName || !zone) return false;
-
+// ============================ File mapping ==================================
+/* Map whole file read-only. Return NULL on error */
+static const uint8_t *mapGribFile(const char *fileName, size_t *len){
    struct stat st;
-   if(stat(fileName, &st) != 0){
-      fprintf(stderr, "readGribLists: cannot stat %s\n", fileName);
-      return false;
-   }
-   FILE *f = fopen(fileName, "rb");
-   if(!f){
-      fprintf(stderr, "readGribLists: cannot open %s\n", fileName);
-      return false;
+   int fd = open(fileName, O_RDONLY);
+   if(fd < 0){ fprintf(stderr, "mapGribFile: cannot open %s\n", fileName); return NULL; }
+   if(fstat(fd, &st) != 0 || st.st_size < 16){
+      close(fd); fprintf(stderr, "mapGribFile: cannot stat or empty %s\n", fileName); return NULL;
    }
+   void *m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if(m == MAP_FAILED){ fprintf(stderr, "mapGribFile: mmap failed %s\n", fileName); return NULL; }
+   madvise(m, (size_t)st.st_size, MADV_SEQUENTIAL);
+   *len = (size_t)st.st_size;
+   return (const uint8_t*)m;
+}
+
+static void unmapGribFile(const uint8_t *buf, size_t len){
+   if(buf) munmap((void*)buf, len);
+}
+
+// ============================== Message index ===============================
+/* One GRIB2 message of the file, found during the single indexing pass */
+typedef struct {
+   size_t offset;       // from start of file
+   size_t len;          // total length of message
+   long   step;         // lead time in hours, -1 if unknown
+   int    iT;           // index of step in zone->timeStamp, -1 if not decoded
+   int    var;          // plane written: FLOW_U, FLOW_V, FLOW_G, FLOW_W or -1 if not used
+} GribMsgIndex;
+
+/* plane of tGribData written by shortName, -1 if none */
+static int varFor(const char *sn){
+   if(strcmp(sn,"10u")==0 || strcmp(sn,"ucurr")==0) return FLOW_U;
+   if(strcmp(sn,"10v")==0 || strcmp(sn,"vcurr")==0) return FLOW_V;
+   if(strcmp(sn,"gust")==0) return FLOW_G;
+   if(strcmp(sn,"swh")==0) return FLOW_W;
+   return -1;
+}
+
+/* Fill grid part of zone from Section 3 of first message */
+static void gridToZone(const Sec3Grid *g3, Zone *zone){
+   zone->nbLon = g3->Ni;
+   zone->nbLat = g3->Nj;
+   zone->lonStep = fabs(g3->di);
+   zone->latStep = fabs(g3->dj);
+
+   double latStart = g3->lat1;
+   double latEnd   = g3->lat1 + (g3->Nj - 1) * g3->dj;
+   double lonStart = g3->lon1;
+   double lonEnd   = g3->lon1 + (g3->Ni - 1) * g3->di;
 
-   uint8_t *buf = (uint8_t*)malloc((size_t)st.st_size);
-   if(!buf){ fclose(f); fprintf(stderr,"readGribLists: malloc failed\n"); return false; }
-   if(fread(buf,1,(size_t)st.st_size,f) != (size_t)st.st_size){
-      fclose(f); free(buf); fprintf(stderr,"readGribLists: short read\n"); return false;
+   zone->latMin = fmin(latStart, latEnd);
+   zone->latMax = fmax(latStart, latEnd);
+
+   zone->lonLeft  = norm180(lonStart);
+   zone->lonRight = norm180(lonEnd);
+
+   if(norm180(zone->lonLeft) > 0.0 && norm180(zone->lonRight) < 0.0){
+      zone->anteMeridian = true;   // crosses +180/-180
+   } else {
+      zone->anteMeridian = false;
+      zone->lonLeft  = norm180(zone->lonLeft);
+      zone->lonRight = norm180(zone->lonRight);
    }
-   fclose(f);
+   zone->numberOfValues = (long)zone->nbLon * (long)zone->nbLat;
+}
+
+/* Single pass over mapped file.
+   Fill zone lists (shortNames, timeStamps, dates) and, if withGrid, grid parameters of first message.
+   If outIdx not NULL, return malloc'ed index of messages and its size in outN */
+static bool indexGrib(const uint8_t *buf, size_t len, Zone *zone, bool withGrid, GribMsgIndex **outIdx, size_t *outN){
+   GribMsgIndex *idx = NULL;
+   size_t n = 0, cap = 0;
+   bool haveGrid = false;
 
    memset(zone, 0, sizeof(*zone));
    zone->editionNumber = 2;
    zone->stepUnits     = 1;   /* hours */
 
-   const uint8_t *p = buf, *end = buf + st.st_size;
+   const uint8_t *p = buf, *end = buf + len;
    while((p = findNextGrib(p, end)) != NULL){
-      if(p + 16 > end) break;
       if(memcmp(p,"GRIB",4)!=0 || p[7]!=2){ p++; continue; }
 
       int discipline = (int)rdU8(p+6);
       uint64_t totalLen = rdU64BE(p+8);
-      if(totalLen < 16 || p + totalLen > end){ break; }
+      if(totalLen < 16 || totalLen > (uint64_t)(end - p)){ break; }
 
       size_t off = 16;
       Sec1Info s1={0}; bool haveS1=false;
+      Sec3Grid g3={0}; bool haveS3=false;
       Sec4Info s4={0}; bool haveS4=false;
+      bool wantS3 = withGrid && !haveGrid;
 
       while(off + 5 <= totalLen){
          uint32_t sLen = rdU32BE(p+off);
@@ -624,22 +931,31 @@ bool readGribLists(const char *fileName, Zone *zone){
 
          if(sNum == 1 && !haveS1){
             haveS1 = parseSec1(s, bodyLen, &s1);
+         } else if(sNum == 3 && wantS3 && !haveS3){
+            haveS3 = parseSec3LatLon(s, bodyLen, &g3);
          } else if(sNum == 4 && !haveS4){
             haveS4 = parseSec4(s, bodyLen, discipline, &s4);
          }
 
-         if(haveS1 && haveS4) break;
+         if(haveS1 && haveS4 && (haveS3 || !wantS3)) break;
          off += sLen;
       }
 
       if(haveS1){
-         zone->centreId = s1.centerId;
+         if(zone->nMessage == 0) zone->centreId = s1.centerId;
          long dataDate = (long)(s1.refYear*10000 + s1.refMonth*100 + s1.refDay);
          long dataTime = (long)(s1.refHour*100 + s1.refMinute);
          zone->nDataDate = updateLongUnique(dataDate, zone->nDataDate, MAX_N_DATA_DATE, zone->dataDate);
          zone->nDataTime = updateLongUnique(dataTime, zone->nDataTime, MAX_N_DATA_TIME, zone->dataTime);
       }
+      if(wantS3){
+         if(!haveS3){ free(idx); return false; }  // first message must describe a regular lat/lon grid
+         gridToZone(&g3, zone);
+         haveGrid = true;
+      }
 
+      long h = -1;
+      int var = -1;
       if(haveS4){
          const char *sn = shortNameFor(s4.discipline, s4.category, s4.parameter);
 
@@ -652,26 +968,33 @@ bool readGribLists(const char *fileName, Zone *zone){
             zone->nShortName++;
          }
 
-         // sn = shortName calculé via shortNameFor(s0.discipline, s4.category, s4.parameter)
-         bool isCur = isCurrentTriplet(discipline, s4.category, s4.parameter, NULL);
-
-         bool keepForTime = (
-            strcmp(sn,"10u")==0 || strcmp(sn,"10v")==0 ||
-            strcmp(sn,"gust")==0 || strcmp(sn,"swh")==0 ||
-            strcmp(sn,"ucurr")==0 || strcmp(sn,"vcurr")==0 ||  // via shortName
-            isCur                                                // sécurité si shortName reste "unknown"
-         );
-
-         if(keepForTime){
-            int h = pdtLeadHours(s4.pdtn, s4.pdt, s4.pdtLen);
+         var = varFor(sn);
+         if(var >= 0){
+            h = pdtLeadHours(s4.pdtn, s4.pdt, s4.pdtLen);
             if(h >= 0){
                zone->nTimeStamp = updateLongUnique(h, zone->nTimeStamp, MAX_N_TIME_STAMPS, zone->timeStamp);
             }
          }
       }
 
+      if(outIdx){
+         if(n >= cap){
+            size_t newCap = (cap == 0) ? 256 : cap * 2;
+            GribMsgIndex *tmp = (GribMsgIndex*)realloc(idx, newCap * sizeof(GribMsgIndex));
+            if(!tmp){ free(idx); fprintf(stderr, "indexGrib: realloc failed\n"); return false; }
+            idx = tmp; cap = newCap;
+         }
+         idx[n].offset = (size_t)(p - buf);
+         idx[n].len    = (size_t)totalLen;
+         idx[n].step   = h;
+         idx[n].iT     = -1;
+         idx[n].var    = (h >= 0) ? var : -1;
+         n++;
+      }
+      zone->nMessage += 1;
       p += totalLen;
    }
+   if(withGrid && !haveGrid){ free(idx); return false; }
 
    for(size_t i=0;i<zone->nShortName;i++){
       if(strcmp(zone->shortName[i], "unknown")==0){
@@ -695,30 +1018,30 @@ bool readGribLists(const char *fileName, Zone *zone){
       zone->intervalBegin = zone->intervalEnd = 3;
    }
 
-   free(buf);
+   if(outIdx){ *outIdx = idx; *outN = n; }
    return true;
 }
 
+// ============================== Public: Lists ================================
+bool readGribLists(const char *fileName, Zone *zone){
+   if(!fileName || !zone) return false;
+   size_t len = 0;
+   const uint8_t *buf = mapGribFile(fileName, &len);
+   if(!buf) return false;
+   bool ok = indexGrib(buf, len, zone, false, NULL, NULL);
+   unmapGribFile(buf, len);
+   return ok;
+}
+
 // =========================== Public: Parameters =============================
 bool readGribParameters(const char *fileName, Zone *zone){
    if(!fileName || !zone) return false;
-
-   struct stat st;
-   if(stat(fileName, &st) != 0){ fprintf(stderr,"readGribParameters: stat fail\n"); return false; }
-
-   FILE *f = fopen(fileName, "rb");
-   if(!f){ fprintf(stderr,"readGribParameters: open fail\n"); return false; }
-
-   uint8_t hdr[16];
-   if(fread(hdr,1,16,f)!=16){ fclose(f); fprintf(stderr,"readGribParameters: short read\n"); return false; }
-   if(memcmp(hdr,"GRIB",4)!=0 || hdr[7]!=2){ fclose(f); fprintf(stderr,"readGribParameters: not GRIB2\n"); return false; }
-   uint64_t totalLen = rdU64BE(hdr+8);
-
-   uint8_t *msg = (uint8_t*)malloc((size_t)totalLen);
-   if(!msg){ fclose(f); fprintf(stderr,"readGribParameters: malloc fail\n"); return false; }
-   fseek(f,0,SEEK_SET);
-   if(fread(msg,1,(size_t)totalLen,f)!=(size_t)totalLen){ free(msg); fclose(f); fprintf(stderr,"readGribParameters: short read 2\n"); return false; }
-   fclose(f);
+   size_t len = 0;
+   const uint8_t *msg = mapGribFile(fileName, &len);
+   if(!msg) return false;
+   if(memcmp(msg,"GRIB",4)!=0 || msg[7]!=2){ unmapGribFile(msg, len); fprintf(stderr,"readGribParameters: not GRIB2\n"); return false; }
+   uint64_t totalLen = rdU64BE(msg+8);
+   if(totalLen > len){ unmapGribFile(msg, len); fprintf(stderr,"readGribParameters: short file\n"); return false; }
 
    size_t off = 16;
    Sec1Info s1={0}; bool haveS1=false;
@@ -740,231 +1063,185 @@ bool readGribParameters(const char *fileName, Zone *zone){
       if(haveS1 && haveS3) break;
       off += sLen;
    }
+   unmapGribFile(msg, len);
 
    if(haveS1) zone->centreId = s1.centerId;
    zone->editionNumber = 2;
    zone->stepUnits = 1; // hours
 
-   if(!haveS3){ free(msg); return false; }
-
-   zone->nbLon = g3.Ni;
-   zone->nbLat = g3.Nj;
-   zone->lonStep = fabs(g3.di);
-   zone->latStep = fabs(g3.dj);
+   if(!haveS3) return false;
+   gridToZone(&g3, zone);
+   return true;
+}
 
-   double latStart = g3.lat1;
-   double latEnd   = g3.lat1 + (g3.Nj - 1) * g3.dj;
-   double lonStart = g3.lon1;
-   double lonEnd   = g3.lon1 + (g3.Ni - 1) * g3.di;
+// ============================== Scatter =====================================
+/* Store decoded values of one message in time slice iT of plane var of data.
+   Section 3 gives first point and signed increments, so the k-th value of the scan is at
+   (lat1 + j*dj, lon1 + i*di) with i, j counted from first point. Scan flags give
+   adjacency (i or j consecutive) and boustrophedon (every other row reversed).
+   NaN (missing in bitmap) are stored as 0. */
+static void scatterMessage(const Sec3Grid *g3, const float *vals, int iT, int var, const Zone *zone, float *data){
+   const int Ni = g3->Ni, Nj = g3->Nj;
+   float *plane = flowPlane(data, zone, var);
+   const bool adjI  = scanAdjI(g3->scanFlags);     // 0 => adjacent along i (row-major)
+   const bool boust = scanBoustro(g3->scanFlags);  // 1 => boustrophedon
+   const int nRows = adjI ? Nj : Ni;
+   const int nCols = adjI ? Ni : Nj;
+   size_t lin = 0;
+
+   for(int r=0; r<nRows; r++){
+      const bool reverse = boust && ((r & 1) != 0);
+      for(int c=0; c<nCols; c++, lin++){
+         const int cc = reverse ? (nCols - 1 - c) : c;
+         const int i = adjI ? cc : r;
+         const int j = adjI ? r : cc;
+
+         double lat = g3->lat1 + j * g3->dj;
+         double lon = g3->lon1 + i * g3->di;
+         if(!zone->anteMeridian) lon = norm180(lon);
 
-   zone->latMin = fmin(latStart, latEnd);
-   zone->latMax = fmax(latStart, latEnd);
+         long iLat = indLat(lat, zone);
+         long iLon = indLonWrap(lon, zone);
+         if(iLat < 0 || iLat >= zone->nbLat || iLon < 0 || iLon >= zone->nbLon) continue;
 
-   zone->lonLeft  = norm180(lonStart);
-   zone->lonRight = norm180(lonEnd);
+         float v = vals[lin];
+         if(isnan(v)) v = 0.0f;  // prefer 0 to nan
+         plane[idxTij(iT, (int)iLon, (int)iLat, zone)] = v;
+      }
+   }
+}
 
-   if(norm180(zone->lonLeft) > 0.0 && norm180(zone->lonRight) < 0.0){
-      zone->anteMeridian = true;   // crosses +180/-180
-   } else {
-      zone->anteMeridian = false;
-      zone->lonLeft  = norm180(zone->lonLeft);
-      zone->lonRight = norm180(zone->lonRight);
+// ============================== Parallel decode =============================
+/* Shared by decode threads. Each message writes one field of one time plane,
+   so messages can be decoded and scattered in any order without lock */
+typedef struct {
+   const uint8_t *buf;
+   const GribMsgIndex *idx;
+   size_t nIdx;
+   const Zone *zone;
+   float *data;
+   atomic_size_t next;        // next message to take
+} DecodeJob;
+
+static void *decodeWorker(void *arg){
+   DecodeJob *job = (DecodeJob*)arg;
+   size_t m;
+   while((m = atomic_fetch_add(&job->next, 1)) < job->nIdx){
+      const GribMsgIndex *e = &job->idx[m];
+      if(e->iT < 0) continue;
+      MsgParse mp; float *vals = NULL;
+      if(parseGrib2Message(job->buf + e->offset, e->len, /*wantData=*/1, job->zone, &mp, &vals) == 0 && vals){
+         scatterMessage(&mp.s3, vals, e->iT, e->var, job->zone, job->data);
+      }
+      free(vals);
    }
+   return NULL;
+}
 
-   zone->numberOfValues = (long)zone->nbLon * (long)zone->nbLat;
+/* Give time index to messages to decode. If same field and step appear twice,
+   only last message is kept as in sequential order. Return number of messages to decode */
+static size_t planMessages(GribMsgIndex *idx, size_t nIdx, const Zone *zone){
+   int last[MAX_N_TIME_STAMPS][N_FLOW_PLANES];
+   size_t nWork = 0;
+   memset(last, -1, sizeof(last));
+   for(size_t m=0; m<nIdx; m++){
+      int iT = (idx[m].var >= 0) ? findTimeIndex(idx[m].step, zone) : -1;
+      if(iT < 0) continue;
+      int iV = idx[m].var;
+      if(last[iT][iV] >= 0){ idx[last[iT][iV]].iT = -1; nWork--; }
+      last[iT][iV] = (int)m;
+      idx[m].iT = iT;
+      nWork++;
+   }
+   return nWork;
+}
 
-   free(msg);
-   return true;
+/* Decode planned messages with nThreads threads. Fallback to caller thread */
+static void decodeMessages(const uint8_t *buf, const GribMsgIndex *idx, size_t nIdx, size_t nWork, const Zone *zone, float *data, int threads){
+   pthread_t th[MAX_N_GRIB_THREADS];
+   DecodeJob job = {.buf = buf, .idx = idx, .nIdx = nIdx, .zone = zone, .data = data};
+   atomic_init(&job.next, 0);
+
+   long nThreads = (threads > 0) ? threads : sysconf(_SC_NPROCESSORS_ONLN);
+   nThreads = CLAMP(nThreads, 1, MAX_N_GRIB_THREADS);
+   if((size_t)nThreads > nWork) nThreads = (long)MAX(nWork, 1);
+
+   int nStarted = 0;
+   for(int t=1; t<nThreads; t++){   // caller thread is worker 0
+      if(pthread_create(&th[nStarted], NULL, decodeWorker, &job) != 0){
+         fprintf(stderr, "decodeMessages: pthread_create failed, continue with %d threads\n", nStarted + 1);
+         break;
+      }
+      nStarted++;
+   }
+   decodeWorker(&job);
+   for(int t=0; t<nStarted; t++) pthread_join(th[t], NULL);
 }
 
 // ============================== Public: All data ============================
-/* Decode entire file and fill tGribData[iFlow] with FlowP.
-   - lat/lon are pre-filled for each (t,i,j) from Zone geometry
-   - values mapped by shortName to u/v/g/w
-   - waves: missing values forced to 0.0 (cosmetic)
+/* Decode entire file and fill planes u, v, g, w of *data (previous *data is freed).
+   File is mapped once and indexed in a single pass: Zone metadata come from the index,
+   then only messages mapped to u/v/g/w are decoded from the same mapping, in parallel.
+   Zone is restricted to load box and max step of dec (zoneRestrict): other messages are skipped,
+   rows outside box are not unpacked when possible, and only the subset is stored.
+   par is not read: safe in a background thread.
+   - lat/lon are not stored: derived from Zone geometry
+   - values mapped by shortName to planes u/v/g/w
+   - missing values forced to 0.0
 */
-bool readGribAll (const char *fileName, Zone *zone, int iFlow){
-   if ((iFlow == WIND && par.constWindTws > 0) || (iFlow == CURRENT && par.constCurrentS > 0)) { // constant wind or current. Dont read file
-      initZone (zone);
-      return true;
-   }
+bool readGribAllTo (const char *fileName, Zone *zone, int iFlow, void **data, const GribDecode *dec){
+   (void) iFlow;
    if(!fileName || !zone) return false;
 
-   zone->wellDefined = false;
-
-   if(!readGribLists(fileName, zone)) return false;
-   if(!readGribParameters(fileName, zone)) return false;
+   size_t len = 0, nIdx = 0;
+   GribMsgIndex *idx = NULL;
+   const uint8_t *buf = mapGribFile(fileName, &len);
+   if(!buf) return false;
 
-   if(zone->nDataDate > 1){
-      fprintf(stderr, "readGribAll: more than 1 dataDate not supported (n=%zu)\n", zone->nDataDate);
+   if(!indexGrib(buf, len, zone, true, &idx, &nIdx)){
+      fprintf(stderr, "readGribAll: cannot index %s\n", fileName);
+      unmapGribFile(buf, len);
       return false;
    }
+   zone->wellDefined = false;
 
-   size_t totalPts = (size_t)zone->nTimeStamp * (size_t)zone->nbLat * (size_t)zone->nbLon;
-   if(tGribData[iFlow]){ free(tGribData[iFlow]); tGribData[iFlow] = NULL; }
-   tGribData[iFlow] = (FlowP*)calloc(totalPts, sizeof(FlowP));
-   if(!tGribData[iFlow]){
-      fprintf(stderr, "readGribAll: calloc tGribData failed\n");
+   /* Only load box and steps up to max step of par are decoded and stored */
+   if(!zoneRestrict(zone, &dec->load)){
+      free(idx); unmapGribFile(buf, len);
       return false;
    }
 
-   /* Pre-fill lat/lon for all grid points (time-invariant geometry) */
-   for(int j=0;j<zone->nbLat;j++){
-      double lat = zone->latMin + j * zone->latStep * ((zone->latMax>=zone->latMin)?1.0:-1.0);
-      for(int i=0;i<zone->nbLon;i++){
-         double lon = zone->lonLeft + i * zone->lonStep;
-         if(!zone->anteMeridian) lon = norm180(lon);
-         for(size_t t=0;t<zone->nTimeStamp;t++){
-            long k = idxTij((int)t, i, j, zone);
-            tGribData[iFlow][k].lat = (float)lat;
-            tGribData[iFlow][k].lon = (float)lon;
-         }
-      }
+   if(zone->nDataDate > 1){
+      fprintf(stderr, "readGribAll: more than 1 dataDate not supported (n=%zu)\n", zone->nDataDate);
+      free(idx); unmapGribFile(buf, len);
+      return false;
    }
 
-   /* Read entire file */
-   struct stat st;
-   if(stat(fileName,&st)!=0){ fprintf(stderr,"readGribAll: stat fail\n"); return false; }
-   FILE *f = fopen(fileName,"rb");
-   if(!f){ fprintf(stderr,"readGribAll: open fail\n"); return false; }
-
-   uint8_t *buf = (uint8_t*)malloc((size_t)st.st_size);
-   if(!buf){ fclose(f); fprintf(stderr,"readGribAll: malloc fail\n"); return false; }
-   if(fread(buf,1,(size_t)st.st_size,f) != (size_t)st.st_size){
-      fclose(f); free(buf); fprintf(stderr,"readGribAll: short read\n"); return false;
+   size_t totalPts = N_FLOW_PLANES * flowPlaneLen(zone);
+   if(*data){ free(*data); *data = NULL; }
+   *data = calloc(totalPts, sizeof(float));
+   if(!*data){
+      fprintf(stderr, "readGribAll: calloc data failed\n");
+      free(idx); unmapGribFile(buf, len);
+      return false;
    }
-   fclose(f);
 
-   const uint8_t *p = buf, *end = buf + st.st_size;
-   zone->nMessage = 0;
    zone->allTimeStepOK = true;
+   size_t nWork = planMessages(idx, nIdx, zone);
+   decodeMessages(buf, idx, nIdx, nWork, zone, *data, dec->threads);
 
-   while((p = findNextGrib(p, end)) != NULL){
-      uint64_t totalLen = rdU64BE(p+8);
-      if(totalLen < 16 || p + totalLen > end) break;
-      int discipline = (int)rdU8(p+6);
-
-
-
-      MsgParse mp; float *vals = NULL;
-      if(parseGrib2Message(p, (size_t)totalLen, /*wantData=*/1, &mp, &vals) == 0){
-         const char *sn = shortNameFor(rdU8(p+6), mp.s4.category, mp.s4.parameter);
-
-         bool writeU = (strcmp(sn,"10u")==0 || strcmp(sn,"ucurr")==0);
-         bool writeV = (strcmp(sn,"10v")==0 || strcmp(sn,"vcurr")==0);
-         bool writeG = (strcmp(sn,"gust")==0);
-         bool writeW = (strcmp(sn,"swh")==0);
-
-         // Si sn=="unknown" mais triplet “courant”, force U/V
-         bool isU=false;
-         bool isCur = isCurrentTriplet(discipline, mp.s4.category, mp.s4.parameter, &isU);
-
-         int h = pdtLeadHours(mp.s4.pdtn, mp.s4.pdt, mp.s4.pdtLen);
-         int iT = (h>=0) ? findTimeIndex(h, zone) : -1;
-
-         if(vals && iT>=0 && (writeU||writeV||writeG||writeW)){
-            /* Respect Section 3 scanning mode for the S7 walk (order only) */
-            const int Ni = mp.s3.Ni, Nj = mp.s3.Nj;
-            const double lat1 = mp.s3.lat1, lon1 = mp.s3.lon1, di = mp.s3.di, dj = mp.s3.dj;
-            const int scan = mp.s3.scanFlags;
-
-            /* Use S3 geometry for directions; keep scan flags only for adjacency & boustrophedon */
-            const bool iPlus = (di > 0);
-            const bool jPlus = (dj > 0);
-            const bool adjI  = scanAdjI(scan);     // 0 => adjacent along i (row-major)
-            const bool boust = scanBoustro(scan);  // 1 => boustrophedon
-
-
-            size_t lin = 0;
-
-            if(adjI){
-               int jStart = jPlus ? 0 : (Nj-1);
-               int jStep  = jPlus ? 1 : -1;
-
-               for(int jj=0; jj<Nj; jj++){
-                  int j = jStart + jj*jStep;
-
-                  bool thisIPlus = iPlus ^ (boust && ((jj & 1) != 0));
-                  int iStart = thisIPlus ? 0 : (Ni-1);
-                  int iStep  = thisIPlus ? 1 : -1;
-
-                  for(int ii=0; ii<Ni; ii++){
-                     int i = iStart + ii*iStep;
-                     if(lin >= (size_t)Ni*(size_t)Nj) break;
-
-                     double lat = lat1 + j * dj;
-                     double lon = lon1 + i * di;
-                     if(!zone->anteMeridian) lon = norm180(lon);
-
-                     long iLat = indLat(lat, zone);
-                     long iLon = indLonWrap(lon, zone);
-                     if(iLat < 0 || iLat >= zone->nbLat || iLon < 0 || iLon >= zone->nbLon){
-                        lin++; continue;
-                     }
-
-                     float v = vals[lin++];
-
-                     long k = idxTij(iT, (int)iLon, (int)iLat, zone);
-                     if (isnan (v)) v = 0.0f;  // prefer 0 to nan 
-                     if (isCur && strcmp(sn,"unknown")==0){
-                        if (isU) tGribData[iFlow][k].u = v; else tGribData[iFlow][k].v = v;
-                     } else {
-                        if (isnan (v)) v = 0.0f;  // prefer 0 to nan 
-                        if (writeU) tGribData[iFlow][k].u = v;
-                        if (writeV) tGribData[iFlow][k].v = v;
-                        if (writeG) tGribData[iFlow][k].g = v;
-                        if (writeW) tGribData[iFlow][k].w = v;
-                     }
-
-                  }
-               }
-            } else {
-               bool baseIPlus = iPlus;
-               int iStartBase = baseIPlus ? 0 : (Ni-1);
-               int iStepBase  = baseIPlus ? 1 : -1;
-
-               for(int ii=0; ii<Ni; ii++){
-                  int i = iStartBase + ii*iStepBase;
-
-                  bool thisJPlus = jPlus ^ (boust && ((ii & 1) != 0));
-                  int jStart = thisJPlus ? 0 : (Nj-1);
-                  int jStep  = thisJPlus ? 1 : -1;
-
-                  for(int jj=0; jj<Nj; jj++){
-                     int j = jStart + jj*jStep;
-                     if(lin >= (size_t)Ni*(size_t)Nj) break;
-
-                     double lat = lat1 + j * dj;
-                     double lon = lon1 + i * di;
-                     if(!zone->anteMeridian) lon = norm180(lon);
-
-                     long iLat = indLat(lat, zone);
-                     long iLon = indLonWrap(lon, zone);
-                     if(iLat < 0 || iLat >= zone->nbLat || iLon < 0 || iLon >= zone->nbLon){
-                        lin++; continue;
-                     }
-
-                     float v = vals[lin++];
-
-                     long k = idxTij(iT, (int)iLon, (int)iLat, zone);
-                     if(writeU) tGribData[iFlow][k].u = v;
-                     if(writeV) tGribData[iFlow][k].v = v;
-                     if(writeG) tGribData[iFlow][k].g = v;
-                     if(writeW) tGribData[iFlow][k].w = isnan(v) ? 0.0f : v;
-                  }
-               }
-            }
-         }
-
-         free(vals);
-      }
-
-      zone->nMessage += 1;
-      p += totalLen;
-   }
-
-   free((void*)buf);
+   free(idx);
+   unmapGribFile(buf, len);
    zone->wellDefined = true;
    return true;
 }
 
+/* Decode entire file into tGribData[iFlow] with settings of par, see readGribAllTo */
+bool readGribAll (const char *fileName, Zone *zone, int iFlow){
+   if ((iFlow == WIND && par.constWindTws > 0) || (iFlow == CURRENT && par.constCurrentS > 0)) { // constant wind or current. Dont read file
+      initZone (zone);
+      return true;
+   }
+   const GribDecode dec = gribDecodeOfPar();
+   return readGribAllTo(fileName, zone, iFlow, &tGribData[iFlow], &dec);
+}